@@ -0,0 +1,246 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "matrix.hpp"
+#include "matrix_batch.hpp"
+
+// Throughput of the main Matrix operations over sizes 2 .. 4096. Every
+// benchmark reports bytes/s for the data it has to touch and, where there
+// is arithmetic, FLOP/s for the operations the textbook algorithm does, so
+// numbers from different sizes and versions compare directly.
+
+namespace {
+constexpr int64_t kMinSize = 2;
+constexpr int64_t kMaxSize = 4096;
+// Fraction-free elimination divides at every step, so the integer sweep
+// stops where one run would take minutes.
+constexpr int64_t kMaxIntDeterminantSize = 1024;
+
+std::vector<double> RandomValues(size_t count, uint64_t seed) {
+    std::vector<double> values;
+    values.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        values.push_back(static_cast<double>(seed >> 11) / static_cast<double>(1ULL << 53) - 0.5);
+    }
+
+    return values;
+}
+
+matrix::Matrix<double> RandomMatrix(size_t size, uint64_t seed) {
+    std::vector<double> values = RandomValues(size * size, seed);
+    return matrix::Matrix<double>(size, values.begin(), values.end());
+}
+
+// Tridiagonal (-1, 2, -1): the intermediate values of fraction-free
+// elimination stay small, so no size overflows int.
+matrix::Matrix<int> TridiagonalMatrix(size_t size) {
+    std::vector<int> values(size * size, 0);
+    for (size_t i = 0; i < size; ++i) {
+        values[i * size + i] = 2;
+        if (i + 1 < size) {
+            values[i * size + i + 1] = -1;
+            values[(i + 1) * size + i] = -1;
+        }
+    }
+
+    return matrix::Matrix<int>(size, values.begin(), values.end());
+}
+
+// Cyclic shift: multiplying by it keeps the magnitudes of the other
+// operand, so a product can be repeated in place for any iteration count.
+matrix::Matrix<double> ShiftMatrix(size_t size) {
+    std::vector<double> values(size * size, 0.0);
+    for (size_t i = 0; i < size; ++i)
+        values[i * size + (i + 1) % size] = 1.0;
+
+    return matrix::Matrix<double>(size, values.begin(), values.end());
+}
+
+void SetThroughput(benchmark::State &state, double flops, double bytes) {
+    double iterations = static_cast<double>(state.iterations());
+    if (flops > 0)
+        state.counters["FLOP/s"] = benchmark::Counter(flops * iterations, benchmark::Counter::kIsRate);
+
+    state.SetBytesProcessed(static_cast<int64_t>(bytes * iterations));
+}
+
+void BM_DeterminantDouble(benchmark::State &state) {
+    size_t size = static_cast<size_t>(state.range(0));
+    matrix::Matrix<double> matrix1 = RandomMatrix(size, 1);
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(matrix1.GetDeterminant());
+
+    double n = static_cast<double>(size);
+    SetThroughput(state, 2.0 / 3.0 * n * n * n, n * n * sizeof(double));
+}
+
+void BM_DeterminantInt(benchmark::State &state) {
+    size_t size = static_cast<size_t>(state.range(0));
+    matrix::Matrix<int> matrix1 = TridiagonalMatrix(size);
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(matrix1.GetDeterminant());
+
+    // Two multiplies, a subtraction and a division per updated element.
+    double n = static_cast<double>(size);
+    SetThroughput(state, 4.0 / 3.0 * n * n * n, n * n * sizeof(int));
+}
+
+void BM_MultiplyAssign(benchmark::State &state) {
+    size_t size = static_cast<size_t>(state.range(0));
+    matrix::Matrix<double> matrix1 = RandomMatrix(size, 1);
+    matrix::Matrix<double> shift = ShiftMatrix(size);
+
+    for (auto _ : state) {
+        matrix1 *= shift;
+        benchmark::DoNotOptimize(matrix1.GetData());
+    }
+
+    double n = static_cast<double>(size);
+    SetThroughput(state, 2.0 * n * n * n, 3.0 * n * n * sizeof(double));
+}
+
+// Same product through Strassen-Winograd; the FLOP/s counter stays in
+// classical flops, so it reads as the speedup over the cubic algorithm.
+void BM_MultiplyAssignStrassen(benchmark::State &state) {
+    matrix::SetMultiplyMode(matrix::MultiplyMode::Strassen);
+    BM_MultiplyAssign(state);
+    matrix::SetMultiplyMode(matrix::MultiplyMode::Fast);
+}
+
+// 4096 determinants of 4 x 4 matrices per iteration, one Matrix each
+// against one MatrixBatch.
+constexpr size_t kBatchCount = 4096;
+constexpr size_t kBatchSize = 4;
+
+void BM_DeterminantSmallMatrices(benchmark::State &state) {
+    std::vector<matrix::Matrix<double>> matrices;
+    for (size_t k = 0; k < kBatchCount; ++k)
+        matrices.push_back(RandomMatrix(kBatchSize, k + 1));
+
+    for (auto _ : state)
+        for (const matrix::Matrix<double> &matrix1 : matrices)
+            benchmark::DoNotOptimize(matrix1.GetDeterminant());
+
+    double n = static_cast<double>(kBatchSize);
+    SetThroughput(state, kBatchCount * 2.0 / 3.0 * n * n * n, kBatchCount * n * n * sizeof(double));
+}
+
+void BM_DeterminantBatch(benchmark::State &state) {
+    matrix::MatrixBatch<double> batch(kBatchCount, kBatchSize, kBatchSize);
+    for (size_t k = 0; k < kBatchCount; ++k)
+        batch.Set(k, RandomMatrix(kBatchSize, k + 1));
+
+    for (auto _ : state) {
+        std::vector<double> dets = batch.Determinant();
+        benchmark::DoNotOptimize(dets.data());
+    }
+
+    double n = static_cast<double>(kBatchSize);
+    SetThroughput(state, kBatchCount * 2.0 / 3.0 * n * n * n, kBatchCount * n * n * sizeof(double));
+}
+
+void BM_Transpose(benchmark::State &state) {
+    size_t size = static_cast<size_t>(state.range(0));
+    matrix::Matrix<double> matrix1 = RandomMatrix(size, 1);
+
+    for (auto _ : state) {
+        matrix::Matrix<double> transpose = matrix1.Transpose();
+        benchmark::DoNotOptimize(transpose.GetData());
+    }
+
+    double n = static_cast<double>(size);
+    SetThroughput(state, 0, 2.0 * n * n * sizeof(double));
+}
+
+void BM_TransposeInPlace(benchmark::State &state) {
+    size_t size = static_cast<size_t>(state.range(0));
+    matrix::Matrix<double> matrix1 = RandomMatrix(size, 1);
+
+    for (auto _ : state) {
+        matrix1.TransposeInPlace();
+        benchmark::DoNotOptimize(matrix1.GetData());
+    }
+
+    double n = static_cast<double>(size);
+    SetThroughput(state, 0, 2.0 * n * n * sizeof(double));
+}
+
+void BM_Add(benchmark::State &state) {
+    size_t size = static_cast<size_t>(state.range(0));
+    matrix::Matrix<double> matrix1 = RandomMatrix(size, 1);
+    matrix::Matrix<double> matrix2 = RandomMatrix(size, 2);
+    matrix::Matrix<double> result = matrix1;
+
+    for (auto _ : state) {
+        result = matrix1 + matrix2;
+        benchmark::DoNotOptimize(result.GetData());
+    }
+
+    double n = static_cast<double>(size);
+    SetThroughput(state, n * n, 3.0 * n * n * sizeof(double));
+}
+
+void BM_AddAssign(benchmark::State &state) {
+    size_t size = static_cast<size_t>(state.range(0));
+    matrix::Matrix<double> matrix1 = RandomMatrix(size, 1);
+    matrix::Matrix<double> matrix2 = RandomMatrix(size, 2);
+
+    for (auto _ : state) {
+        matrix1 += matrix2;
+        matrix1 -= matrix2;
+        benchmark::DoNotOptimize(matrix1.GetData());
+    }
+
+    double n = static_cast<double>(size);
+    SetThroughput(state, 2.0 * n * n, 6.0 * n * n * sizeof(double));
+}
+
+void BM_FusedExpression(benchmark::State &state) {
+    size_t size = static_cast<size_t>(state.range(0));
+    matrix::Matrix<double> matrix1 = RandomMatrix(size, 1);
+    matrix::Matrix<double> matrix2 = RandomMatrix(size, 2);
+    matrix::Matrix<double> matrix3 = RandomMatrix(size, 3);
+    matrix::Matrix<double> result = matrix1;
+
+    for (auto _ : state) {
+        result = matrix1 + matrix2 - 2.0 * matrix3;
+        benchmark::DoNotOptimize(result.GetData());
+    }
+
+    double n = static_cast<double>(size);
+    SetThroughput(state, 3.0 * n * n, 4.0 * n * n * sizeof(double));
+}
+
+void BM_ConstructFromIterators(benchmark::State &state) {
+    size_t size = static_cast<size_t>(state.range(0));
+    std::vector<double> values = RandomValues(size * size, 1);
+
+    for (auto _ : state) {
+        matrix::Matrix<double> matrix1(size, values.begin(), values.end());
+        benchmark::DoNotOptimize(matrix1.GetData());
+    }
+
+    double n = static_cast<double>(size);
+    SetThroughput(state, 0, 2.0 * n * n * sizeof(double));
+}
+} // namespace
+
+BENCHMARK(BM_DeterminantDouble)->RangeMultiplier(2)->Range(kMinSize, kMaxSize)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_DeterminantInt)->RangeMultiplier(2)->Range(kMinSize, kMaxIntDeterminantSize)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_MultiplyAssign)->RangeMultiplier(2)->Range(kMinSize, kMaxSize)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_MultiplyAssignStrassen)->RangeMultiplier(2)->Range(512, kMaxSize)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_DeterminantSmallMatrices)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_DeterminantBatch)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Transpose)->RangeMultiplier(2)->Range(kMinSize, kMaxSize)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_TransposeInPlace)->RangeMultiplier(2)->Range(kMinSize, kMaxSize)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Add)->RangeMultiplier(2)->Range(kMinSize, kMaxSize)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_AddAssign)->RangeMultiplier(2)->Range(kMinSize, kMaxSize)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_FusedExpression)->RangeMultiplier(2)->Range(kMinSize, kMaxSize)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ConstructFromIterators)->RangeMultiplier(2)->Range(kMinSize, kMaxSize)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,68 @@
+from argparse import ArgumentParser
+from json import load
+from sys import exit
+
+# Compares two JSON reports of the benchmarks binary
+# (--benchmark_out=<file> --benchmark_out_format=json) and fails when the
+# throughput of any benchmark present in both dropped by more than the
+# threshold. With --benchmark_repetitions the median of the repetitions is
+# compared, otherwise the single run.
+
+THROUGHPUT_KEYS = ["FLOP/s", "bytes_per_second", "items_per_second"]
+
+
+def load_throughput(path):
+    with open(path) as file:
+        report = load(file)
+
+    runs = {}
+    medians = {}
+    for entry in report["benchmarks"]:
+        key = next((key for key in THROUGHPUT_KEYS if key in entry), None)
+        if key is None:
+            continue
+
+        if entry.get("run_type") == "aggregate":
+            if entry.get("aggregate_name") == "median":
+                medians[entry["run_name"]] = (key, entry[key])
+        else:
+            runs.setdefault(entry.get("run_name", entry["name"]), (key, entry[key]))
+
+    runs.update(medians)
+    return runs
+
+
+parser = ArgumentParser(description="Compare benchmark throughput against a baseline")
+parser.add_argument("baseline", help="JSON report to compare against")
+parser.add_argument("current", help="JSON report of the run under test")
+parser.add_argument("--threshold", type=float, default=0.1,
+                    help="largest allowed relative drop of throughput (default 0.1)")
+args = parser.parse_args()
+
+baseline = load_throughput(args.baseline)
+current = load_throughput(args.current)
+
+regressions = 0
+for name, (key, value) in current.items():
+    if name not in baseline:
+        print(f"{name:<40} {'new':>10}")
+        continue
+
+    base_key, base_value = baseline[name]
+    if base_key != key or base_value <= 0:
+        print(f"{name:<40} {'skipped':>10}")
+        continue
+
+    change = value / base_value - 1
+    is_regression = change < -args.threshold
+    regressions += is_regression
+    print(f"{name:<40} {change:>+10.1%} {key}{'  REGRESSION' if is_regression else ''}")
+
+for name in baseline.keys() - current.keys():
+    print(f"{name:<40} {'missing':>10}")
+
+if regressions:
+    print(f"{regressions} benchmark(s) slower than the baseline by more than {args.threshold:.0%}")
+    exit(1)
+
+print("NO REGRESSIONS")
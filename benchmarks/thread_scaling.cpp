@@ -0,0 +1,83 @@
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "matrix.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+template <typename Func> double MeasureSeconds(Func &&func, size_t repeats) {
+    double best = 0;
+    for (size_t i = 0; i < repeats; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (i == 0 || elapsed.count() < best)
+            best = elapsed.count();
+    }
+
+    return best;
+}
+
+matrix::Matrix<double> MakeMatrix(size_t size, uint64_t seed) {
+    std::vector<double> nums;
+    nums.reserve(size * size);
+    for (size_t i = 0; i < size * size; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        nums.push_back(static_cast<double>(seed >> 11) / (1ULL << 53) * 2 - 1);
+    }
+
+    return matrix::Matrix<double>{size, nums.begin(), nums.end()};
+}
+} // namespace
+
+// Usage: thread_scaling [size] [repeats]
+// Prints best-of-repeats times of a product and a determinant for thread
+// counts doubling up to the hardware concurrency, and the speedup over one thread.
+int main(int argc, char *argv[]) {
+    size_t size = (argc > 1) ? std::stoul(argv[1]) : 1024;
+    size_t repeats = (argc > 2) ? std::stoul(argv[2]) : 3;
+    size_t max_threads = std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+
+    matrix::Matrix<double> lhs = MakeMatrix(size, 37);
+    matrix::Matrix<double> rhs = MakeMatrix(size, 11);
+
+    std::vector<size_t> thread_counts;
+    for (size_t threads = 1; threads < max_threads; threads *= 2)
+        thread_counts.push_back(threads);
+    thread_counts.push_back(max_threads);
+
+    double multiply_base = 0;
+    double determinant_base = 0;
+
+    std::cout << "size " << size << ", " << max_threads << " hardware threads" << std::endl;
+    std::cout << std::setw(8) << "threads" << std::setw(14) << "multiply, s" << std::setw(10)
+              << "speedup" << std::setw(16) << "determinant, s" << std::setw(10) << "speedup"
+              << std::endl;
+
+    for (size_t threads : thread_counts) {
+        matrix::SetThreadCount(threads);
+
+        double multiply = MeasureSeconds([&] { matrix::Matrix<double> product = lhs * rhs; }, repeats);
+        double determinant = MeasureSeconds([&] {
+            volatile double det = lhs.GetDeterminant();
+            static_cast<void>(det);
+        }, repeats);
+
+        if (threads == 1) {
+            multiply_base = multiply;
+            determinant_base = determinant;
+        }
+
+        std::cout << std::setw(8) << threads << std::fixed << std::setprecision(4)
+                  << std::setw(14) << multiply << std::setw(10) << multiply_base / multiply
+                  << std::setw(16) << determinant << std::setw(10)
+                  << determinant_base / determinant << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+namespace matrix {
+namespace details {
+    // Matrix storage and scratch buffers start on a cache line, which is
+    // also the width of the widest vector register. Aligned heap requests
+    // are several times slower than plain ones, so buffers smaller than
+    // kAlignedStorageBytes, too small for the alignment to pay off, keep
+    // the natural alignment of the element type.
+    constexpr size_t kStorageAlignment = 64;
+    constexpr size_t kAlignedStorageBytes = 1024;
+
+    template <typename T> constexpr size_t StorageAlignment(size_t size) {
+        return (size * sizeof(T) < kAlignedStorageBytes) ? alignof(T) : std::max(alignof(T), kStorageAlignment);
+    }
+
+    // Row stride, in elements, that starts every row on a cache line. Used
+    // for scratch copies only: a Matrix itself always stores rows back to
+    // back.
+    template <typename T> size_t PaddedStride(size_t column_count) {
+        if constexpr (kStorageAlignment % sizeof(T) != 0) {
+            return column_count;
+        } else {
+            constexpr size_t kLine = kStorageAlignment / sizeof(T);
+            return (column_count + kLine - 1) / kLine * kLine;
+        }
+    }
+
+    // Uninitialized storage for size elements, aligned as StorageAlignment.
+    template <typename T> class AlignedBuffer {
+    public:
+        explicit AlignedBuffer(size_t size = 0,
+                               std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+            : data_((size == 0) ? nullptr
+                                : static_cast<T *>(resource->allocate(size * sizeof(T), StorageAlignment<T>(size)))),
+              size_(size), resource_(resource) {}
+
+        AlignedBuffer(const AlignedBuffer &other) = delete;
+        AlignedBuffer &operator=(const AlignedBuffer &other) = delete;
+
+        AlignedBuffer(AlignedBuffer &&other) noexcept { Swap(other); }
+
+        AlignedBuffer &operator=(AlignedBuffer &&other) noexcept {
+            Swap(other);
+            return *this;
+        }
+
+        ~AlignedBuffer() {
+            if (data_ != nullptr)
+                resource_->deallocate(data_, size_ * sizeof(T), StorageAlignment<T>(size_));
+        }
+
+        T *data() const { return data_; }
+        size_t size() const { return size_; }
+        std::pmr::memory_resource *resource() const { return resource_; }
+
+    private:
+        void Swap(AlignedBuffer &other) noexcept {
+            std::swap(data_, other.data_);
+            std::swap(size_, other.size_);
+            std::swap(resource_, other.resource_);
+        }
+
+        T *data_ = nullptr;
+        size_t size_ = 0;
+        std::pmr::memory_resource *resource_ = std::pmr::get_default_resource();
+    }; // class AlignedBuffer
+
+    // Thread-local recycler behind GetScratchResource. Requests are rounded
+    // up to a power of two and freed blocks wait on a list per size class,
+    // so a temporary of a size seen before costs a list pop and a push.
+    // Blocks larger than kLargestBlock go to the upstream resource directly.
+    class ScratchPool : public std::pmr::memory_resource {
+    public:
+        static constexpr size_t kSmallestBlock = kStorageAlignment;
+        static constexpr size_t kLargestBlock = size_t{1} << 20;
+
+        ScratchPool() = default;
+
+        ScratchPool(const ScratchPool &other) = delete;
+        ScratchPool &operator=(const ScratchPool &other) = delete;
+
+        ~ScratchPool() override {
+            for (size_t index = 0; index < kClassCount; ++index)
+                for (void *block : free_[index])
+                    upstream_->deallocate(block, kSmallestBlock << index, kStorageAlignment);
+        }
+
+    private:
+        static constexpr size_t kClassCount = 15; // 64 B .. 1 MiB
+
+        static size_t ClassIndex(size_t bytes) {
+            size_t index = 0;
+            while ((kSmallestBlock << index) < bytes)
+                ++index;
+
+            return index;
+        }
+
+        void *do_allocate(size_t bytes, size_t alignment) override {
+            if (bytes > kLargestBlock || alignment > kStorageAlignment)
+                return upstream_->allocate(bytes, alignment);
+
+            size_t index = ClassIndex(bytes);
+            if (free_[index].empty())
+                return upstream_->allocate(kSmallestBlock << index, kStorageAlignment);
+
+            void *block = free_[index].back();
+            free_[index].pop_back();
+            return block;
+        }
+
+        void do_deallocate(void *ptr, size_t bytes, size_t alignment) override {
+            if (bytes > kLargestBlock || alignment > kStorageAlignment) {
+                upstream_->deallocate(ptr, bytes, alignment);
+                return;
+            }
+
+            free_[ClassIndex(bytes)].push_back(ptr);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+            return this == &other;
+        }
+
+        std::pmr::memory_resource *upstream_ = std::pmr::new_delete_resource();
+        std::vector<void *> free_[kClassCount];
+    }; // class ScratchPool
+} // namespace details
+
+// Pool of the calling thread for short-lived buffers. The library takes its
+// own temporaries (determinant scratch, materialized operands) from it, so
+// they neither lock the global heap nor contend with other threads. User
+// code may pass it to matrices that are destroyed on the same thread before
+// the thread exits; the pool is not synchronized.
+inline std::pmr::memory_resource *GetScratchResource() {
+    thread_local details::ScratchPool pool;
+    return &pool;
+}
+} // namespace matrix
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Signed integer of unbounded size, with just the operations the exact
+// determinant needs to rebuild its result: multiply-add of a machine word,
+// subtraction, comparison and conversion. Sign and magnitude are kept
+// apart; the magnitude is little-endian 64-bit limbs without leading zero
+// limbs, so zero has no limbs.
+
+namespace matrix {
+class BigInt {
+public:
+    BigInt() = default;
+
+    BigInt(int64_t value) : is_negative_(value < 0) {
+        uint64_t magnitude = is_negative_ ? uint64_t{0} - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+        if (magnitude != 0)
+            limbs_.push_back(magnitude);
+    }
+
+    static BigInt FromUnsigned(uint64_t value) {
+        BigInt result;
+        if (value != 0)
+            result.limbs_.push_back(value);
+
+        return result;
+    }
+
+    bool IsZero() const { return limbs_.empty(); }
+    bool IsNegative() const { return is_negative_; }
+    size_t GetBitCount() const {
+        return limbs_.empty() ? 0 : 64 * limbs_.size() - static_cast<size_t>(__builtin_clzll(limbs_.back()));
+    }
+
+    bool operator==(const BigInt &other) const = default;
+
+    // *this = *this * factor + addend on the magnitude; the sign is kept.
+    BigInt &MultiplyAdd(uint64_t factor, uint64_t addend) {
+        unsigned __int128 carry = addend;
+        for (uint64_t &limb : limbs_) {
+            carry += static_cast<unsigned __int128>(limb) * factor;
+            limb = static_cast<uint64_t>(carry);
+            carry >>= 64;
+        }
+
+        if (carry != 0)
+            limbs_.push_back(static_cast<uint64_t>(carry));
+
+        Trim();
+        return *this;
+    }
+
+    BigInt operator-() const {
+        BigInt result = *this;
+        if (!result.IsZero())
+            result.is_negative_ = !result.is_negative_;
+
+        return result;
+    }
+
+    BigInt &operator-=(const BigInt &other) { return *this = *this - other; }
+
+    friend BigInt operator-(const BigInt &lhs, const BigInt &rhs) {
+        if (lhs.is_negative_ != rhs.is_negative_) {
+            BigInt result = lhs;
+            result.AddMagnitude(rhs);
+            return result;
+        }
+
+        // Same signs: the difference of the magnitudes, sign flipped when
+        // the right one is larger.
+        bool is_smaller = CompareMagnitudes(lhs, rhs) < 0;
+        BigInt result = is_smaller ? rhs : lhs;
+        result.SubtractMagnitude(is_smaller ? lhs : rhs);
+        result.is_negative_ = !result.IsZero() && (lhs.is_negative_ != is_smaller);
+        return result;
+    }
+
+    friend bool operator<(const BigInt &lhs, const BigInt &rhs) {
+        if (lhs.is_negative_ != rhs.is_negative_)
+            return lhs.is_negative_;
+
+        int order = CompareMagnitudes(lhs, rhs);
+        return lhs.is_negative_ ? order > 0 : order < 0;
+    }
+
+    // Magnitudes only: negative, zero or positive as |lhs| <, =, > |rhs|.
+    static int CompareMagnitudes(const BigInt &lhs, const BigInt &rhs) {
+        if (lhs.limbs_.size() != rhs.limbs_.size())
+            return (lhs.limbs_.size() < rhs.limbs_.size()) ? -1 : 1;
+
+        for (size_t i = lhs.limbs_.size(); i-- > 0;)
+            if (lhs.limbs_[i] != rhs.limbs_[i])
+                return (lhs.limbs_[i] < rhs.limbs_[i]) ? -1 : 1;
+
+        return 0;
+    }
+
+    template <typename T> requires std::is_integral_v<T>
+    bool FitsIn() const {
+        if (limbs_.size() > 1)
+            return false;
+
+        uint64_t magnitude = limbs_.empty() ? 0 : limbs_[0];
+        if (!is_negative_)
+            return magnitude <= static_cast<uint64_t>(std::numeric_limits<T>::max());
+
+        if constexpr (std::is_unsigned_v<T>)
+            return false;
+        else
+            return magnitude <= uint64_t{0} - static_cast<uint64_t>(static_cast<int64_t>(std::numeric_limits<T>::min()));
+    }
+
+    // Exact value as T; throws std::range_error when it does not fit.
+    template <typename T> requires std::is_integral_v<T>
+    T To() const {
+        if (!FitsIn<T>())
+            throw std::range_error("Integer does not fit the requested type");
+
+        uint64_t magnitude = limbs_.empty() ? 0 : limbs_[0];
+        return static_cast<T>(is_negative_ ? uint64_t{0} - magnitude : magnitude);
+    }
+
+    // Nearest double, or an infinity past its range.
+    double ToDouble() const {
+        double result = 0;
+        for (size_t i = limbs_.size(); i-- > 0;)
+            result = result * 0x1p64 + static_cast<double>(limbs_[i]);
+
+        return is_negative_ ? -result : result;
+    }
+
+    std::string ToString() const {
+        if (IsZero())
+            return "0";
+
+        // Groups of 19 decimal digits, the most that fit a limb, least
+        // significant first.
+        constexpr uint64_t kGroup = 10'000'000'000'000'000'000ULL;
+        std::vector<uint64_t> magnitude = limbs_;
+        std::vector<uint64_t> groups;
+        while (!magnitude.empty()) {
+            unsigned __int128 remainder = 0;
+            for (size_t i = magnitude.size(); i-- > 0;) {
+                unsigned __int128 current = (remainder << 64) | magnitude[i];
+                magnitude[i] = static_cast<uint64_t>(current / kGroup);
+                remainder = current % kGroup;
+            }
+
+            groups.push_back(static_cast<uint64_t>(remainder));
+            while (!magnitude.empty() && magnitude.back() == 0)
+                magnitude.pop_back();
+        }
+
+        std::string text = is_negative_ ? "-" : "";
+        text += std::to_string(groups.back());
+        for (size_t i = groups.size() - 1; i-- > 0;) {
+            std::string group = std::to_string(groups[i]);
+            text.append(19 - group.size(), '0');
+            text += group;
+        }
+
+        return text;
+    }
+
+    friend std::ostream &operator<<(std::ostream &out, const BigInt &value) { return out << value.ToString(); }
+private:
+    void AddMagnitude(const BigInt &other) {
+        limbs_.resize(std::max(limbs_.size(), other.limbs_.size()), 0);
+
+        unsigned __int128 carry = 0;
+        for (size_t i = 0; i < limbs_.size(); ++i) {
+            carry += limbs_[i];
+            if (i < other.limbs_.size())
+                carry += other.limbs_[i];
+
+            limbs_[i] = static_cast<uint64_t>(carry);
+            carry >>= 64;
+        }
+
+        if (carry != 0)
+            limbs_.push_back(static_cast<uint64_t>(carry));
+    }
+
+    // |*this| -= |other|, with |other| <= |*this|.
+    void SubtractMagnitude(const BigInt &other) {
+        uint64_t borrow = 0;
+        for (size_t i = 0; i < limbs_.size(); ++i) {
+            uint64_t subtrahend = (i < other.limbs_.size()) ? other.limbs_[i] : 0;
+            uint64_t difference = limbs_[i] - subtrahend - borrow;
+            borrow = (limbs_[i] < subtrahend || (limbs_[i] == subtrahend && borrow != 0)) ? 1 : 0;
+            limbs_[i] = difference;
+        }
+
+        Trim();
+    }
+
+    void Trim() {
+        while (!limbs_.empty() && limbs_.back() == 0)
+            limbs_.pop_back();
+
+        if (limbs_.empty())
+            is_negative_ = false;
+    }
+
+    bool is_negative_ = false;
+    std::vector<uint64_t> limbs_;
+}; // class BigInt
+} // namespace matrix
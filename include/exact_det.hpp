@@ -0,0 +1,286 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include "allocator.hpp"
+#include "big_int.hpp"
+#include "thread_pool.hpp"
+
+// Exact determinant of an integer matrix by multi-modular elimination. The
+// determinant is taken modulo enough primes just below 2^63 for their
+// product to exceed twice the Hadamard bound |det| <= prod ||row_i||, each
+// prime on its own (in parallel over the thread pool), and the residues are
+// put back together by Garner's mixed-radix CRT into a BigInt. Nothing here
+// can overflow, whatever the size of the entries or of the result.
+
+namespace matrix {
+namespace details {
+namespace exact {
+    // Arithmetic modulo an odd p < 2^63. General products use Montgomery
+    // reduction; the elimination loop multiplies a whole row by one factor
+    // and uses Shoup's precomputed quotient instead, a Barrett reduction
+    // that needs a single high multiply per element.
+    class Modulus {
+    public:
+        explicit Modulus(uint64_t p) : p_(p) {
+            // Newton iteration doubles the correct low bits of p^-1 mod 2^64.
+            uint64_t inverse = p;
+            for (int i = 0; i < 5; ++i)
+                inverse *= 2 - p * inverse;
+
+            neg_inverse_ = uint64_t{0} - inverse;
+            uint64_t r = (uint64_t{0} - p) % p; // 2^64 mod p
+            r2_ = static_cast<uint64_t>(static_cast<unsigned __int128>(r) * r % p);
+        }
+
+        uint64_t Get() const { return p_; }
+
+        uint64_t Add(uint64_t a, uint64_t b) const {
+            uint64_t sum = a + b;
+            return (sum >= p_) ? sum - p_ : sum;
+        }
+
+        uint64_t Sub(uint64_t a, uint64_t b) const { return (a >= b) ? a - b : a + p_ - b; }
+
+        // a * b mod p for a, b < p: two reductions, the second one undoing
+        // the 2^-64 factor of the first.
+        uint64_t Mul(uint64_t a, uint64_t b) const {
+            return Reduce(static_cast<unsigned __int128>(Reduce(static_cast<unsigned __int128>(a) * b)) * r2_);
+        }
+
+        uint64_t Pow(uint64_t base, uint64_t exponent) const {
+            uint64_t result = 1;
+            for (; exponent != 0; exponent >>= 1) {
+                if (exponent & 1)
+                    result = Mul(result, base);
+                base = Mul(base, base);
+            }
+
+            return result;
+        }
+
+        // p is prime, so a^-1 = a^(p - 2).
+        uint64_t Inverse(uint64_t a) const { return Pow(a, p_ - 2); }
+
+        template <typename T> uint64_t FromInteger(T value) const {
+            if constexpr (std::is_signed_v<T>) {
+                int64_t remainder = static_cast<int64_t>(value) % static_cast<int64_t>(p_);
+                return static_cast<uint64_t>((remainder < 0) ? remainder + static_cast<int64_t>(p_) : remainder);
+            } else {
+                return static_cast<uint64_t>(value) % p_;
+            }
+        }
+
+        // Shoup's quotient floor(factor * 2^64 / p) for MulShoup.
+        uint64_t ShoupQuotient(uint64_t factor) const {
+            return static_cast<uint64_t>((static_cast<unsigned __int128>(factor) << 64) / p_);
+        }
+
+        // factor * x mod p, given the quotient of factor.
+        uint64_t MulShoup(uint64_t factor, uint64_t quotient, uint64_t x) const {
+            uint64_t estimate = static_cast<uint64_t>((static_cast<unsigned __int128>(quotient) * x) >> 64);
+            uint64_t result = factor * x - estimate * p_; // in [0, 2p)
+            return (result >= p_) ? result - p_ : result;
+        }
+    private:
+        // t * 2^-64 mod p for t < p * 2^64.
+        uint64_t Reduce(unsigned __int128 t) const {
+            uint64_t m = static_cast<uint64_t>(t) * neg_inverse_;
+            uint64_t result = static_cast<uint64_t>((t + static_cast<unsigned __int128>(m) * p_) >> 64);
+            return (result >= p_) ? result - p_ : result;
+        }
+
+        uint64_t p_ = 0;
+        uint64_t neg_inverse_ = 0;
+        uint64_t r2_ = 0;
+    }; // class Modulus
+
+    template <typename T> bool FitsIn(int64_t value) {
+        if constexpr (std::is_signed_v<T>)
+            return value >= std::numeric_limits<T>::min() && value <= std::numeric_limits<T>::max();
+        else
+            return value >= 0 && static_cast<uint64_t>(value) <= std::numeric_limits<T>::max();
+    }
+
+    // Deterministic Miller-Rabin: these bases decide every 64-bit number.
+    inline bool IsPrime(uint64_t n) {
+        constexpr uint64_t kBases[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+
+        if (n < 2)
+            return false;
+
+        for (uint64_t base : kBases)
+            if (n % base == 0)
+                return n == base;
+
+        Modulus modulus{n};
+        uint64_t d = n - 1;
+        int shift = __builtin_ctzll(d);
+        d >>= shift;
+
+        for (uint64_t base : kBases) {
+            uint64_t x = modulus.Pow(base, d);
+            if (x == 1 || x == n - 1)
+                continue;
+
+            bool is_witness = true;
+            for (int i = 1; i < shift && is_witness; ++i) {
+                x = modulus.Mul(x, x);
+                is_witness = (x != n - 1);
+            }
+
+            if (is_witness)
+                return false;
+        }
+
+        return true;
+    }
+
+    // The count largest primes below 2^63, found once and shared.
+    inline std::vector<uint64_t> GetPrimes(size_t count) {
+        static std::mutex mutex;
+        static std::vector<uint64_t> primes;
+
+        std::lock_guard<std::mutex> lock{mutex};
+        uint64_t candidate = primes.empty() ? (uint64_t{1} << 63) - 1 : primes.back() - 2;
+        for (; primes.size() < count; candidate -= 2)
+            if (IsPrime(candidate))
+                primes.push_back(candidate);
+
+        return std::vector<uint64_t>(primes.begin(), primes.begin() + count);
+    }
+
+    // log2 of the Hadamard bound, the smaller of the row and the column
+    // forms, with a bit of slack for the rounding of the logarithms.
+    // Negative infinity when a row or column is zero.
+    template <typename T> double HadamardBits(const T *data, size_t size, size_t row_stride) {
+        std::vector<long double> column_norms(size, 0);
+        double row_bits = 0;
+
+        for (size_t i = 0; i < size; ++i) {
+            long double row_norm = 0;
+            for (size_t j = 0; j < size; ++j) {
+                long double value = static_cast<long double>(data[i * row_stride + j]);
+                row_norm += value * value;
+                column_norms[j] += value * value;
+            }
+
+            row_bits += 0.5 * std::log2(static_cast<double>(row_norm));
+        }
+
+        double column_bits = 0;
+        for (long double norm : column_norms)
+            column_bits += 0.5 * std::log2(static_cast<double>(norm));
+
+        return std::min(row_bits, column_bits) + 1e-9 * static_cast<double>(size) + 1;
+    }
+
+    // Determinant mod p by Gaussian elimination; work holds size * size
+    // elements and is overwritten.
+    template <typename T>
+    uint64_t ModularDeterminant(const T *data, size_t size, size_t row_stride, Modulus modulus,
+                                uint64_t *work) {
+        // modulus is taken by value: a local copy cannot alias the stores
+        // into work, so p stays in a register through the inner loop.
+        for (size_t i = 0; i < size; ++i)
+            for (size_t j = 0; j < size; ++j)
+                work[i * size + j] = modulus.FromInteger(data[i * row_stride + j]);
+
+        uint64_t det = 1;
+        for (size_t i = 0; i < size; ++i) {
+            size_t pivot = i;
+            while (pivot < size && work[pivot * size + i] == 0)
+                ++pivot;
+
+            if (pivot == size)
+                return 0;
+
+            uint64_t *pivot_row = work + i * size;
+            if (pivot != i) {
+                std::swap_ranges(pivot_row + i, pivot_row + size, work + pivot * size + i);
+                det = modulus.Sub(0, det);
+            }
+
+            det = modulus.Mul(det, pivot_row[i]);
+            uint64_t pivot_inverse = modulus.Inverse(pivot_row[i]);
+
+            for (size_t k = i + 1; k < size; ++k) {
+                uint64_t *row = work + k * size;
+                if (row[i] == 0)
+                    continue;
+
+                // row -= factor * pivot_row, as row + (p - factor) * pivot_row.
+                uint64_t factor = modulus.Sub(0, modulus.Mul(row[i], pivot_inverse));
+                uint64_t quotient = modulus.ShoupQuotient(factor);
+                for (size_t j = i + 1; j < size; ++j)
+                    row[j] = modulus.Add(row[j], modulus.MulShoup(factor, quotient, pivot_row[j]));
+            }
+        }
+
+        return det;
+    }
+
+    // Garner: residues[i] = x mod primes[i] gives the mixed-radix digits of
+    // x, x = d0 + d1 p0 + d2 p0 p1 + ..., which are summed into a BigInt
+    // and moved to the symmetric range (-M / 2, M / 2].
+    inline BigInt ReconstructCrt(const std::vector<uint64_t> &primes, const std::vector<uint64_t> &residues) {
+        std::vector<uint64_t> digits(primes.size());
+
+        for (size_t i = 0; i < primes.size(); ++i) {
+            Modulus modulus{primes[i]};
+            uint64_t prefix = 0; // d0 + d1 p0 + ... + d(i-1) p0..p(i-2) mod p_i
+            uint64_t radix = 1;  // p0 p1 .. p(j-1) mod p_i
+            for (size_t j = 0; j < i; ++j) {
+                prefix = modulus.Add(prefix, modulus.Mul(modulus.FromInteger(digits[j]), radix));
+                radix = modulus.Mul(radix, modulus.FromInteger(primes[j]));
+            }
+
+            digits[i] = modulus.Mul(modulus.Sub(residues[i], prefix), modulus.Inverse(radix));
+        }
+
+        BigInt value;
+        BigInt product = BigInt::FromUnsigned(1);
+        for (size_t i = primes.size(); i-- > 0;) {
+            value.MultiplyAdd(primes[i], digits[i]);
+            product.MultiplyAdd(primes[i], 0);
+        }
+
+        BigInt twice = value;
+        twice.MultiplyAdd(2, 0);
+        if (BigInt::CompareMagnitudes(twice, product) > 0)
+            value -= product;
+
+        return value;
+    }
+
+    template <typename T> BigInt Determinant(const T *data, size_t size, size_t row_stride) {
+        static_assert(std::is_integral_v<T> && sizeof(T) <= sizeof(uint64_t), "Exact determinant needs integers");
+
+        double bits = HadamardBits(data, size, row_stride);
+        if (std::isinf(bits)) // a zero row or column
+            return BigInt{};
+
+        // The product of the primes has to exceed 2 * bound for the sign.
+        constexpr double kPrimeBits = 62.99;
+        size_t prime_count = std::max<size_t>(static_cast<size_t>(std::ceil((bits + 1) / kPrimeBits)), 1);
+        std::vector<uint64_t> primes = GetPrimes(prime_count);
+        std::vector<uint64_t> residues(prime_count);
+
+        GetThreadPool().ParallelFor(0, prime_count, 1, [&](size_t begin, size_t end) {
+            AlignedBuffer<uint64_t> work(size * size, GetScratchResource());
+            for (size_t i = begin; i < end; ++i)
+                residues[i] = ModularDeterminant(data, size, row_stride, Modulus{primes[i]}, work.data());
+        });
+
+        return ReconstructCrt(primes, residues);
+    }
+} // namespace exact
+} // namespace details
+} // namespace matrix
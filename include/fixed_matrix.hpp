@@ -0,0 +1,313 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "matrix.hpp"
+
+// Matrix with its shape in the type, stored inline: no heap, no runtime
+// size checks, and every operation is constexpr. Loops run over constant
+// bounds and are unrolled; determinants up to 4 x 4 are closed forms.
+// Meant for the many small matrices (transforms, Jacobians) where the
+// bookkeeping of Matrix<T> costs more than the arithmetic.
+
+namespace matrix {
+template <typename T, size_t R, size_t C = R> class FixedMatrix {
+public:
+    using value_type = T;
+
+    constexpr FixedMatrix() : data_{} {}
+
+    template <typename InputIterator>
+    constexpr FixedMatrix(InputIterator begin, InputIterator end) {
+        size_t i = 0;
+        for (InputIterator it = begin; it != end; ++it, ++i) {
+            if (i >= R * C)
+                throw std::range_error("Matrix size and number of elements "
+                                       "between iterators dont match");
+
+            data_[i] = *it;
+        }
+
+        if (i != R * C)
+            throw std::logic_error("Number of elements between iterators more "
+                                   "than matrix size");
+    }
+
+    explicit FixedMatrix(const Matrix<T> &other) {
+        if (other.GetRowCount() != R || other.GetColumnCount() != C)
+            throw std::logic_error("Matrixs sizes do not match");
+
+        std::copy(other.GetData(), other.GetData() + R * C, data_.begin());
+    }
+
+    Matrix<T> ToMatrix() const { return Matrix<T>(R, C, data_.begin(), data_.end()); }
+
+    static constexpr FixedMatrix Identity() requires (R == C) {
+        FixedMatrix identity;
+        for (size_t i = 0; i < R; ++i)
+            identity.data_[i * C + i] = T{1};
+
+        return identity;
+    }
+
+    constexpr std::span<T, C> operator[](size_t num_row) {
+        if (num_row >= R)
+            throw std::range_error("Row index is more count of exist rows");
+
+        return std::span<T, C>(data_.data() + num_row * C, C);
+    }
+
+    constexpr std::span<const T, C> operator[](size_t num_row) const {
+        if (num_row >= R)
+            throw std::range_error("Row index is more count of exist rows");
+
+        return std::span<const T, C>(data_.data() + num_row * C, C);
+    }
+
+    constexpr bool operator==(const FixedMatrix &other) const = default;
+
+    constexpr size_t GetRowCount() const { return R; }
+
+    constexpr size_t GetColumnCount() const { return C; }
+
+    constexpr T *GetData() { return data_.data(); }
+    constexpr const T *GetData() const { return data_.data(); }
+
+    constexpr FixedMatrix<T, C, R> Transpose() const {
+        FixedMatrix<T, C, R> transpose;
+        T *dst = transpose.GetData();
+
+#if defined(__GNUC__)
+#pragma GCC unroll 16
+#endif
+        for (size_t i = 0; i < R; ++i)
+            for (size_t j = 0; j < C; ++j)
+                dst[j * R + i] = data_[i * C + j];
+
+        return transpose;
+    }
+
+    constexpr FixedMatrix &operator+=(const FixedMatrix &other) {
+#if defined(__GNUC__)
+#pragma GCC unroll 64
+#endif
+        for (size_t i = 0; i < R * C; ++i)
+            data_[i] += other.data_[i];
+
+        return *this;
+    }
+
+    constexpr FixedMatrix &operator-=(const FixedMatrix &other) {
+#if defined(__GNUC__)
+#pragma GCC unroll 64
+#endif
+        for (size_t i = 0; i < R * C; ++i)
+            data_[i] -= other.data_[i];
+
+        return *this;
+    }
+
+    constexpr FixedMatrix &operator*=(const T &val) {
+#if defined(__GNUC__)
+#pragma GCC unroll 64
+#endif
+        for (size_t i = 0; i < R * C; ++i)
+            data_[i] *= val;
+
+        return *this;
+    }
+
+    constexpr FixedMatrix &operator*=(const FixedMatrix<T, C, C> &other) {
+        *this = *this * other;
+        return *this;
+    }
+
+    constexpr T GetDeterminant() const {
+        static_assert(std::is_fundamental<T>::value, "Element type is not fundamental");
+        static_assert(R == C, "Matrix rows and columns counts is not equal");
+        static_assert(R > 0, "Matrix is empty");
+
+        const std::array<T, R * C> &a = data_;
+
+        if constexpr (R == 1) {
+            return a[0];
+        } else if constexpr (std::is_integral_v<T>) {
+            return GetIntDeterminant();
+        } else if constexpr (R == 2) {
+            return a[0] * a[3] - a[1] * a[2];
+        } else if constexpr (R == 3) {
+            return a[0] * (a[4] * a[8] - a[5] * a[7]) -
+                   a[1] * (a[3] * a[8] - a[5] * a[6]) +
+                   a[2] * (a[3] * a[7] - a[4] * a[6]);
+        } else if constexpr (R == 4) {
+            // Laplace expansion over the 2 x 2 minors of the top and bottom row pairs.
+            T s0 = a[0] * a[5] - a[4] * a[1];
+            T s1 = a[0] * a[6] - a[4] * a[2];
+            T s2 = a[0] * a[7] - a[4] * a[3];
+            T s3 = a[1] * a[6] - a[5] * a[2];
+            T s4 = a[1] * a[7] - a[5] * a[3];
+            T s5 = a[2] * a[7] - a[6] * a[3];
+
+            T c5 = a[10] * a[15] - a[14] * a[11];
+            T c4 = a[9] * a[15] - a[13] * a[11];
+            T c3 = a[9] * a[14] - a[13] * a[10];
+            T c2 = a[8] * a[15] - a[12] * a[11];
+            T c1 = a[8] * a[14] - a[12] * a[10];
+            T c0 = a[8] * a[13] - a[12] * a[9];
+
+            return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+        } else {
+            return GetFloatDeterminant();
+        }
+    }
+
+    void print() const {
+        std::cout << "Matrix:" << std::endl;
+
+        for (size_t i = 0; i < R; ++i) {
+            for (size_t j = 0; j < C; ++j)
+                std::cout << data_[i * C + j] << " ";
+
+            std::cout << std::endl;
+        }
+    }
+private:
+    // Partial pivoting on a copy; the pivot search uses exact comparisons,
+    // since the epsilon helpers of real_nums are not constexpr.
+    constexpr T GetFloatDeterminant() const {
+        std::array<T, R * C> a = data_;
+        T det = 1;
+
+        for (size_t i = 0; i < R; ++i) {
+            size_t pivot = i;
+            for (size_t k = i + 1; k < R; ++k)
+                if (Abs(a[k * C + i]) > Abs(a[pivot * C + i]))
+                    pivot = k;
+
+            if (a[pivot * C + i] == 0)
+                return 0;
+
+            if (pivot != i) {
+                for (size_t j = 0; j < C; ++j)
+                    std::swap(a[i * C + j], a[pivot * C + j]);
+                det = -det;
+            }
+
+            det *= a[i * C + i];
+            for (size_t k = i + 1; k < R; ++k) {
+                T coef = a[k * C + i] / a[i * C + i];
+                for (size_t j = i + 1; j < C; ++j)
+                    a[k * C + j] -= coef * a[i * C + j];
+            }
+        }
+
+        return det;
+    }
+
+    // Bareiss fraction-free elimination: every division is exact. Products
+    // and differences are checked, and once one overflows T the matrix goes
+    // to Matrix<T>, which finishes on its exact path and throws
+    // std::range_error only when the determinant itself does not fit.
+    constexpr T GetIntDeterminant() const {
+        std::array<T, R * C> a = data_;
+        T sign = 1;
+        T coef = 1;
+
+        for (size_t i = 0; i + 1 < R; ++i) {
+            if (a[i * C + i] == 0) {
+                size_t pivot = i + 1;
+                while (pivot < R && a[pivot * C + i] == 0)
+                    ++pivot;
+
+                if (pivot == R)
+                    return 0;
+
+                for (size_t j = 0; j < C; ++j)
+                    std::swap(a[i * C + j], a[pivot * C + j]);
+                sign = -sign;
+            }
+
+            for (size_t k = i + 1; k < R; ++k) {
+                for (size_t j = i + 1; j < C; ++j) {
+                    T lhs{};
+                    T rhs{};
+                    T difference{};
+                    if (__builtin_mul_overflow(a[k * C + j], a[i * C + i], &lhs) ||
+                        __builtin_mul_overflow(a[i * C + j], a[k * C + i], &rhs) ||
+                        __builtin_sub_overflow(lhs, rhs, &difference))
+                        return ToMatrix().GetDeterminant();
+
+                    a[k * C + j] = difference / coef;
+                }
+                a[k * C + i] = 0;
+            }
+
+            coef = a[i * C + i];
+        }
+
+        T det{};
+        if (__builtin_mul_overflow(sign, a[R * C - 1], &det))
+            return ToMatrix().GetDeterminant();
+
+        return det;
+    }
+
+    static constexpr T Abs(const T &val) { return (val < 0) ? -val : val; }
+
+    // Zeroed by the default constructor only; the other constructors
+    // overwrite every element anyway.
+    std::array<T, R * C> data_;
+}; // class FixedMatrix
+
+template <typename T, size_t R, size_t C>
+constexpr FixedMatrix<T, R, C> operator+(FixedMatrix<T, R, C> lhs, const FixedMatrix<T, R, C> &rhs) {
+    return lhs += rhs;
+}
+
+template <typename T, size_t R, size_t C>
+constexpr FixedMatrix<T, R, C> operator-(FixedMatrix<T, R, C> lhs, const FixedMatrix<T, R, C> &rhs) {
+    return lhs -= rhs;
+}
+
+template <typename T, size_t R, size_t C>
+constexpr FixedMatrix<T, R, C> operator*(FixedMatrix<T, R, C> lhs, const T &rhs) {
+    return lhs *= rhs;
+}
+
+template <typename T, size_t R, size_t C>
+constexpr FixedMatrix<T, R, C> operator*(const T &lhs, FixedMatrix<T, R, C> rhs) {
+    return rhs *= lhs;
+}
+
+// Row of the result accumulated as sums of scaled rows of rhs, so each
+// element is summed over k in order, as in the naive product.
+template <typename T, size_t R, size_t K, size_t C>
+constexpr FixedMatrix<T, R, C> operator*(const FixedMatrix<T, R, K> &lhs, const FixedMatrix<T, K, C> &rhs) {
+    FixedMatrix<T, R, C> result;
+    const T *a = lhs.GetData();
+    const T *b = rhs.GetData();
+    T *c = result.GetData();
+
+#if defined(__GNUC__)
+#pragma GCC unroll 16
+#endif
+    for (size_t i = 0; i < R; ++i)
+#if defined(__GNUC__)
+#pragma GCC unroll 16
+#endif
+        for (size_t k = 0; k < K; ++k)
+#if defined(__GNUC__)
+#pragma GCC unroll 16
+#endif
+            for (size_t j = 0; j < C; ++j)
+                c[i * C + j] += a[i * K + k] * b[k * C + j];
+
+    return result;
+}
+} // namespace matrix
@@ -0,0 +1,328 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory_resource>
+#include <type_traits>
+#include <vector>
+
+#include "allocator.hpp"
+#include "instrumentation.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
+
+namespace matrix {
+
+enum class MultiplyMode {
+    Fast,          // blocked over the inner dimension, partial sums reassociated
+    Deterministic, // every element summed in the naive k = 0..K-1 order
+    Strassen       // Fast, plus Strassen-Winograd recursion for large products
+};
+
+namespace details {
+    inline std::atomic<MultiplyMode> multiply_mode{MultiplyMode::Fast};
+} // namespace details
+
+inline void SetMultiplyMode(MultiplyMode mode) { details::multiply_mode.store(mode); }
+
+inline MultiplyMode GetMultiplyMode() { return details::multiply_mode.load(); }
+
+namespace details {
+namespace gemm {
+    constexpr size_t kL1CacheSize = 32 * 1024;
+    constexpr size_t kL2CacheSize = 256 * 1024;
+    constexpr size_t kL3CacheSize = 8 * 1024 * 1024;
+
+    constexpr size_t RoundDown(size_t value, size_t step) {
+        return std::max(step, value / step * step);
+    }
+
+    // Tile sizes of the packed GEMM. An MR x NR block of C lives in registers,
+    // an MR x KC sliver of A and a KC x NR sliver of B stay in L1, the packed
+    // MC x KC block of A stays in L2 and the KC x NC panel of B stays in L3.
+    template <typename T> struct Blocking {
+        static constexpr size_t kMr = 8;
+        static constexpr size_t kNr = std::max<size_t>(32 / sizeof(T), 4);
+        static constexpr size_t kKc = std::clamp<size_t>(
+            kL1CacheSize / 2 / ((kMr + kNr) * sizeof(T)), 16, 512);
+        static constexpr size_t kMc = RoundDown(kL2CacheSize / 2 / (kKc * sizeof(T)), kMr);
+        static constexpr size_t kNc = RoundDown(kL3CacheSize / 2 / (kKc * sizeof(T)), kNr);
+    }; // struct Blocking
+
+    // Copies an mc x kc block of A into MR-row slivers, column after column,
+    // padding the last sliver with zeros and applying the alpha scale.
+    template <typename T>
+    void PackA(size_t mc, size_t kc, T alpha, const T *a, size_t rs_a, size_t cs_a, T *buf) {
+        constexpr size_t kMr = Blocking<T>::kMr;
+
+        for (size_t ir = 0; ir < mc; ir += kMr) {
+            size_t mr = std::min(kMr, mc - ir);
+            const T *sliver = a + ir * rs_a;
+
+            for (size_t p = 0; p < kc; ++p) {
+                for (size_t i = 0; i < mr; ++i)
+                    *buf++ = (alpha == T{1}) ? sliver[i * rs_a + p * cs_a]
+                                             : alpha * sliver[i * rs_a + p * cs_a];
+                for (size_t i = mr; i < kMr; ++i)
+                    *buf++ = T{};
+            }
+        }
+    }
+
+    // Copies a kc x nc panel of B into NR-column slivers, row after row.
+    template <typename T>
+    void PackB(size_t kc, size_t nc, const T *b, size_t rs_b, size_t cs_b, T *buf) {
+        constexpr size_t kNr = Blocking<T>::kNr;
+
+        for (size_t jr = 0; jr < nc; jr += kNr) {
+            size_t nr = std::min(kNr, nc - jr);
+            const T *sliver = b + jr * cs_b;
+
+            for (size_t p = 0; p < kc; ++p) {
+                for (size_t j = 0; j < nr; ++j)
+                    *buf++ = sliver[p * rs_b + j * cs_b];
+                for (size_t j = nr; j < kNr; ++j)
+                    *buf++ = T{};
+            }
+        }
+    }
+
+    // C[0:m, 0:n] (+)= Ap * Bp for one packed sliver pair. The accumulators are
+    // a fixed MR x NR array, so the inner loop is unrolled and kept in registers.
+    template <typename T>
+    void MicroKernel(size_t kc, const T *a, const T *b, T *c, size_t rs_c, size_t cs_c,
+                     size_t m, size_t n, bool accumulate) {
+        constexpr size_t kMr = Blocking<T>::kMr;
+        constexpr size_t kNr = Blocking<T>::kNr;
+
+        T acc[kMr][kNr] = {};
+
+        for (size_t p = 0; p < kc; ++p, a += kMr, b += kNr)
+            for (size_t i = 0; i < kMr; ++i) {
+                T a_elem = a[i];
+                for (size_t j = 0; j < kNr; ++j)
+                    acc[i][j] += a_elem * b[j];
+            }
+
+        for (size_t i = 0; i < m; ++i)
+            for (size_t j = 0; j < n; ++j) {
+                T &elem = c[i * rs_c + j * cs_c];
+                elem = accumulate ? elem + acc[i][j] : acc[i][j];
+            }
+    }
+
+    // Same contract as MicroKernel, with each accumulator row held in one
+    // 256-bit vector. Compiled per instruction set by the wrappers below.
+    template <typename T>
+    MATRIX_SIMD_INLINE void VectorMicroKernelImpl(size_t kc, const T *a, const T *b, T *c,
+                                                  size_t rs_c, size_t cs_c, size_t m, size_t n,
+                                                  bool accumulate) {
+        constexpr size_t kMr = Blocking<T>::kMr;
+        constexpr size_t kNr = Blocking<T>::kNr;
+        constexpr size_t kBytes = kNr * sizeof(T);
+
+        using Vec = typename simd::VecType<T, kBytes>::type;
+        Vec acc[kMr] = {};
+
+        for (size_t p = 0; p < kc; ++p, a += kMr, b += kNr) {
+            Vec b_row;
+            simd::Load(b_row, b);
+#if defined(__GNUC__)
+#pragma GCC unroll 16
+#endif
+            for (size_t i = 0; i < kMr; ++i)
+                acc[i] += a[i] * b_row;
+        }
+
+        if (m == kMr && n == kNr && cs_c == 1) {
+            for (size_t i = 0; i < kMr; ++i) {
+                if (accumulate) {
+                    Vec c_row;
+                    simd::Load(c_row, c + i * rs_c);
+                    acc[i] += c_row;
+                }
+                simd::Store(c + i * rs_c, acc[i]);
+            }
+            return;
+        }
+
+        for (size_t i = 0; i < m; ++i)
+            for (size_t j = 0; j < n; ++j) {
+                T &elem = c[i * rs_c + j * cs_c];
+                elem = accumulate ? elem + acc[i][j] : acc[i][j];
+            }
+    }
+
+    template <typename T>
+    using MicroKernelFn = void (*)(size_t, const T *, const T *, T *, size_t, size_t,
+                                   size_t, size_t, bool);
+
+#define MATRIX_GEMM_DEFINE_KERNEL(suffix, target)                                         \
+    template <typename T>                                                                 \
+    target void MicroKernel##suffix(size_t kc, const T *a, const T *b,  \
+                                                     T *c, size_t rs_c, size_t cs_c,      \
+                                                     size_t m, size_t n, bool accumulate) { \
+        VectorMicroKernelImpl(kc, a, b, c, rs_c, cs_c, m, n, accumulate);                 \
+    }
+
+#if defined(MATRIX_SIMD_X86)
+    MATRIX_GEMM_DEFINE_KERNEL(Avx512Fma, MATRIX_SIMD_TARGET_FUSED("avx512f,fma"))
+    MATRIX_GEMM_DEFINE_KERNEL(Avx512, MATRIX_SIMD_TARGET("avx512f"))
+    MATRIX_GEMM_DEFINE_KERNEL(Avx2Fma, MATRIX_SIMD_TARGET_FUSED("avx2,fma"))
+    MATRIX_GEMM_DEFINE_KERNEL(Avx2, MATRIX_SIMD_TARGET("avx2"))
+    MATRIX_GEMM_DEFINE_KERNEL(Sse2, MATRIX_SIMD_TARGET("sse2"))
+#endif
+
+#undef MATRIX_GEMM_DEFINE_KERNEL
+
+    // Fused multiply-add changes rounding, so it is only allowed when the
+    // caller does not ask for results matching the naive order.
+    template <typename T> MicroKernelFn<T> SelectMicroKernel(bool allow_fma) {
+        if constexpr (simd::kIsVectorizable<T>) {
+#if defined(MATRIX_SIMD_X86)
+            switch (simd::GetIsa()) {
+            case simd::Isa::Avx512:
+                return allow_fma ? &MicroKernelAvx512Fma<T> : &MicroKernelAvx512<T>;
+            case simd::Isa::Avx2:
+                return allow_fma ? &MicroKernelAvx2Fma<T> : &MicroKernelAvx2<T>;
+            case simd::Isa::Sse2:
+                return &MicroKernelSse2<T>;
+            case simd::Isa::Scalar:
+                break;
+            }
+#endif
+        }
+
+        return &MicroKernel<T>;
+    }
+
+    // Packing buffer taken from a per-thread free list for the duration of a
+    // call. Leasing instead of sharing one buffer keeps nested and stolen
+    // GEMM calls on the same thread from overwriting each other's panels.
+    template <typename T> class PackBuffer {
+    public:
+        explicit PackBuffer(size_t size) {
+            std::vector<AlignedBuffer<T>> &pool = Pool();
+            if (!pool.empty()) {
+                buf_ = std::move(pool.back());
+                pool.pop_back();
+            }
+
+            // Panels are written before they are read, so a larger buffer
+            // is not initialized. The pool outlives any scratch resource of
+            // the thread, so it allocates from the heap directly.
+            if (buf_.size() < size)
+                buf_ = AlignedBuffer<T>(size, std::pmr::new_delete_resource());
+        }
+
+        PackBuffer(const PackBuffer &other) = delete;
+        PackBuffer &operator=(const PackBuffer &other) = delete;
+
+        ~PackBuffer() { Pool().push_back(std::move(buf_)); }
+
+        T *data() { return buf_.data(); }
+
+    private:
+        static std::vector<AlignedBuffer<T>> &Pool() {
+            thread_local std::vector<AlignedBuffer<T>> pool;
+            return pool;
+        }
+
+        AlignedBuffer<T> buf_;
+    }; // class PackBuffer
+
+    // Below this many multiply-adds a product is not worth splitting.
+    constexpr size_t kParallelThreshold = 64 * 64 * 64;
+} // namespace gemm
+
+    // C = alpha * A * B, or C += alpha * A * B when accumulate is set.
+    // Every operand is addressed through a row and a column stride, so
+    // transposed and strided operands need no copy before the call.
+    // Only the packing buffers are allocated, and those are reused across
+    // calls. Large products are split over row blocks of C on the pool.
+    template <typename T>
+    void Gemm(size_t m, size_t n, size_t k, T alpha,
+              const T *a, size_t rs_a, size_t cs_a,
+              const T *b, size_t rs_b, size_t cs_b,
+              bool accumulate, T *c, size_t rs_c, size_t cs_c) {
+        static_assert(std::is_arithmetic_v<T>, "Packed GEMM needs an arithmetic element type");
+        using Block = gemm::Blocking<T>;
+
+        if (m == 0 || n == 0)
+            return;
+
+        MATRIX_COUNT(Flops, 2 * m * n * k);
+        if (k == 0) {
+            if (!accumulate)
+                for (size_t i = 0; i < m; ++i)
+                    for (size_t j = 0; j < n; ++j)
+                        c[i * rs_c + j * cs_c] = T{};
+            return;
+        }
+
+        // In deterministic mode the inner dimension is not split, so each
+        // element is one running sum in k order, exactly like the naive loop.
+        bool deterministic = GetMultiplyMode() == MultiplyMode::Deterministic;
+        gemm::MicroKernelFn<T> kernel = gemm::SelectMicroKernel<T>(!deterministic);
+
+        size_t kc_max = Block::kKc;
+        size_t mc_max = Block::kMc;
+        size_t nc_max = Block::kNc;
+        if (deterministic && k > Block::kKc) {
+            kc_max = k;
+            mc_max = gemm::RoundDown(Block::kMc * Block::kKc / k, Block::kMr);
+            nc_max = gemm::RoundDown(Block::kNc * Block::kKc / k, Block::kNr);
+        }
+
+        // Row blocks of C are the unit of parallel work; shrink them when
+        // there are fewer blocks than threads.
+        ThreadPool &pool = GetThreadPool();
+        size_t thread_count = pool.GetThreadCount();
+        bool parallel = thread_count > 1 && m * n * k >= gemm::kParallelThreshold;
+        if (parallel) {
+            size_t rows_per_thread = (m + thread_count - 1) / thread_count;
+            size_t mc_split = (rows_per_thread + Block::kMr - 1) / Block::kMr * Block::kMr;
+            mc_max = std::min(mc_max, mc_split);
+        }
+
+        size_t kc_used = std::min(kc_max, k);
+        size_t mc_used = std::min(mc_max, m + Block::kMr - 1) / Block::kMr * Block::kMr;
+        size_t nc_used = std::min(nc_max, n + Block::kNr - 1) / Block::kNr * Block::kNr;
+        gemm::PackBuffer<T> b_buf{nc_used * kc_used};
+
+        for (size_t jc = 0; jc < n; jc += nc_max) {
+            size_t nc = std::min(nc_max, n - jc);
+
+            for (size_t pc = 0; pc < k; pc += kc_max) {
+                size_t kc = std::min(kc_max, k - pc);
+                bool accumulate_c = accumulate || pc > 0;
+                gemm::PackB(kc, nc, b + pc * rs_b + jc * cs_b, rs_b, cs_b, b_buf.data());
+
+                auto row_blocks = [&](size_t block_begin, size_t block_end) {
+                    gemm::PackBuffer<T> a_buf{mc_used * kc_used};
+
+                    for (size_t block = block_begin; block < block_end; ++block) {
+                        size_t ic = block * mc_max;
+                        size_t mc = std::min(mc_max, m - ic);
+                        gemm::PackA(mc, kc, alpha, a + ic * rs_a + pc * cs_a, rs_a, cs_a, a_buf.data());
+
+                        for (size_t jr = 0; jr < nc; jr += Block::kNr)
+                            for (size_t ir = 0; ir < mc; ir += Block::kMr)
+                                kernel(kc, a_buf.data() + ir * kc, b_buf.data() + jr * kc,
+                                       c + (ic + ir) * rs_c + (jc + jr) * cs_c, rs_c, cs_c,
+                                       std::min(Block::kMr, mc - ir),
+                                       std::min(Block::kNr, nc - jr), accumulate_c);
+                    }
+                };
+
+                size_t block_count = (m + mc_max - 1) / mc_max;
+                if (parallel)
+                    pool.ParallelFor(0, block_count, 1, row_blocks);
+                else
+                    row_blocks(0, block_count);
+            }
+        }
+    }
+} // namespace details
+} // namespace matrix
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Whitespace-separated numbers from a file descriptor, parsed with
+// std::from_chars. A regular file is mapped whole and parsed in place;
+// anything else (a pipe, a terminal) is read through a buffer that is
+// refilled as tokens are consumed. Neither path goes through iostreams or
+// the locale.
+
+namespace matrix {
+class InputReader {
+public:
+    static constexpr size_t kBufferSize = size_t{1} << 16;
+
+    explicit InputReader(int fd, size_t buffer_size = kBufferSize) : fd_(fd) {
+        struct stat info;
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+            size_t size = static_cast<size_t>(info.st_size);
+            void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (map != MAP_FAILED) {
+                madvise(map, size, MADV_SEQUENTIAL);
+                map_ = map;
+                map_size_ = size;
+                pos_ = static_cast<const char *>(map);
+                end_ = pos_ + size;
+                is_eof_ = true;
+                return;
+            }
+        }
+
+        buffer_.resize(std::max<size_t>(buffer_size, 1));
+        pos_ = end_ = buffer_.data();
+    }
+
+    InputReader(const InputReader &other) = delete;
+    InputReader &operator=(const InputReader &other) = delete;
+
+    ~InputReader() {
+        if (map_ != nullptr)
+            munmap(map_, map_size_);
+    }
+
+    bool IsMapped() const { return map_ != nullptr; }
+
+    // True when only whitespace is left.
+    bool AtEnd() { return !SkipSpace(); }
+
+    // Next token as a number. False at the end of the input and when the
+    // token is not a number of type T as a whole; the reader is not usable
+    // after a failure.
+    template <typename T> requires std::is_arithmetic_v<T>
+    bool Read(T &value) {
+        if (!SkipSpace())
+            return false;
+
+        const char *token_end = FindTokenEnd();
+        const char *begin = pos_;
+        if constexpr (std::is_floating_point_v<T>) {
+            // from_chars does not take the explicit plus sign that operator>> does.
+            if (*begin == '+' && token_end - begin > 1)
+                ++begin;
+        }
+
+        auto [ptr, ec] = std::from_chars(begin, token_end, value);
+        pos_ = token_end;
+        return ec == std::errc{} && ptr == token_end;
+    }
+private:
+    static bool IsSpace(char c) { return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f'; }
+
+    bool SkipSpace() {
+        for (;;) {
+            while (pos_ != end_ && IsSpace(*pos_))
+                ++pos_;
+
+            if (pos_ != end_)
+                return true;
+
+            if (!Refill())
+                return false;
+        }
+    }
+
+    // End of the token at pos_. A token cut by the end of the buffer is
+    // moved to the front and the rest read after it, growing the buffer for
+    // tokens longer than the buffer itself.
+    const char *FindTokenEnd() {
+        size_t scanned = 0;
+        for (;;) {
+            const char *it = pos_ + scanned;
+            while (it != end_ && !IsSpace(*it))
+                ++it;
+
+            if (it != end_ || is_eof_)
+                return it;
+
+            scanned = static_cast<size_t>(it - pos_);
+            if (pos_ == buffer_.data() && end_ == buffer_.data() + buffer_.size())
+                Grow();
+
+            Refill();
+        }
+    }
+
+    bool Refill() {
+        if (is_eof_)
+            return false;
+
+        size_t kept = static_cast<size_t>(end_ - pos_);
+        std::copy(pos_, end_, buffer_.data());
+        pos_ = buffer_.data();
+        end_ = pos_ + kept;
+
+        for (;;) {
+            ssize_t count = read(fd_, buffer_.data() + kept, buffer_.size() - kept);
+            if (count < 0 && errno == EINTR)
+                continue;
+
+            if (count <= 0) {
+                is_eof_ = true;
+                return false;
+            }
+
+            end_ += count;
+            return true;
+        }
+    }
+
+    void Grow() {
+        size_t kept = static_cast<size_t>(end_ - pos_);
+        size_t offset = static_cast<size_t>(pos_ - buffer_.data());
+        buffer_.resize(2 * buffer_.size());
+        pos_ = buffer_.data() + offset;
+        end_ = pos_ + kept;
+    }
+
+    int fd_ = -1;
+    void *map_ = nullptr;
+    size_t map_size_ = 0;
+    std::vector<char> buffer_;
+    const char *pos_ = nullptr;
+    const char *end_ = nullptr;
+    bool is_eof_ = false;
+}; // class InputReader
+} // namespace matrix
@@ -0,0 +1,346 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#if defined(MATRIX_INSTRUMENTATION) && defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Operation counters and region timers for the hot paths, compiled in only
+// with MATRIX_INSTRUMENTATION defined (the WITH_INSTRUMENTATION build
+// option). Without it MATRIX_COUNT and MATRIX_TIMED_SCOPE expand to
+// nothing, their arguments are not evaluated, and GetSnapshot returns
+// zeros. With it every thread counts into its own block, which only that
+// thread writes, so counting is a relaxed load and store without a locked
+// instruction or shared cache line; GetSnapshot sums the blocks of all
+// threads that ever counted. Region times are inclusive: pivoting inside
+// an elimination counts towards both.
+//
+// On Linux, EnableHardwareCounters has each thread open a perf_event group
+// of cycles, instructions and cache misses on its first timed region, read
+// at region entry and exit. The group counts user space only, so it opens
+// with perf_event_paranoid up to 2; where it cannot be opened the hardware
+// columns stay zero, which HardwareCountersAvailable tells in advance.
+
+#if defined(MATRIX_INSTRUMENTATION)
+#define MATRIX_INSTRUMENTATION_CONCAT_IMPL(lhs, rhs) lhs##rhs
+#define MATRIX_INSTRUMENTATION_CONCAT(lhs, rhs) MATRIX_INSTRUMENTATION_CONCAT_IMPL(lhs, rhs)
+#define MATRIX_COUNT(counter, amount)                                                                            \
+    ::matrix::details::instrumentation::Count(::matrix::instrumentation::Counter::counter,                     \
+                                              static_cast<uint64_t>(amount))
+#define MATRIX_TIMED_SCOPE(region)                                                                               \
+    ::matrix::instrumentation::ScopedTimer MATRIX_INSTRUMENTATION_CONCAT(matrix_timed_scope_, __LINE__) {      \
+        ::matrix::instrumentation::Region::region                                                                \
+    }
+#else
+#define MATRIX_COUNT(counter, amount) static_cast<void>(0)
+#define MATRIX_TIMED_SCOPE(region) static_cast<void>(0)
+#endif
+
+namespace matrix {
+namespace instrumentation {
+    constexpr bool kEnabled =
+#if defined(MATRIX_INSTRUMENTATION)
+        true;
+#else
+        false;
+#endif
+
+    enum class Counter : size_t {
+        Allocations,    // MatrixBuf storage allocations
+        AllocatedBytes, // bytes those allocations asked for
+        RowSwaps,       // pivoting row exchanges, permuted or physical
+        Flops,          // multiply-adds of products and float eliminations, times two
+        BytesCopied,    // bytes copied by matrix and row copies
+    };
+    constexpr size_t kCounterCount = 5;
+
+    enum class Region : size_t { Transpose, Multiply, Elimination, Pivoting };
+    constexpr size_t kRegionCount = 4;
+
+    struct RegionStats {
+        uint64_t calls = 0;
+        uint64_t nanoseconds = 0;
+        uint64_t cycles = 0;
+        uint64_t instructions = 0;
+        uint64_t cache_misses = 0;
+
+        double GetInstructionsPerCycle() const {
+            return (cycles == 0) ? 0.0 : static_cast<double>(instructions) / static_cast<double>(cycles);
+        }
+    }; // struct RegionStats
+
+    struct Snapshot {
+        std::array<uint64_t, kCounterCount> counters{};
+        std::array<RegionStats, kRegionCount> regions{};
+
+        uint64_t Get(Counter counter) const { return counters[static_cast<size_t>(counter)]; }
+        const RegionStats &Get(Region region) const { return regions[static_cast<size_t>(region)]; }
+    }; // struct Snapshot
+
+    inline const char *GetName(Counter counter) {
+        static constexpr const char *kNames[] = {"allocations", "allocated_bytes", "row_swaps", "flops",
+                                                 "bytes_copied"};
+        return kNames[static_cast<size_t>(counter)];
+    }
+
+    inline const char *GetName(Region region) {
+        static constexpr const char *kNames[] = {"transpose", "multiply", "elimination", "pivoting"};
+        return kNames[static_cast<size_t>(region)];
+    }
+} // namespace instrumentation
+
+namespace details {
+namespace instrumentation {
+    using matrix::instrumentation::kCounterCount;
+    using matrix::instrumentation::kRegionCount;
+
+    // Cycles, instructions and cache misses since the group was opened.
+    struct HardwareReading {
+        uint64_t cycles = 0;
+        uint64_t instructions = 0;
+        uint64_t cache_misses = 0;
+    }; // struct HardwareReading
+
+    // A perf_event group of the calling thread, counting user space only.
+    class HardwareCounters {
+    public:
+        HardwareCounters() {
+#if defined(MATRIX_INSTRUMENTATION) && defined(__linux__)
+            constexpr uint64_t kEvents[] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                            PERF_COUNT_HW_CACHE_MISSES};
+            for (size_t i = 0; i < 3; ++i) {
+                perf_event_attr attr{};
+                attr.size = sizeof(attr);
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = kEvents[i];
+                attr.read_format = PERF_FORMAT_GROUP;
+                attr.disabled = (i == 0);
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+
+                int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, fds_[0], 0));
+                if (fd < 0) {
+                    Close();
+                    return;
+                }
+                fds_[i] = fd;
+            }
+
+            ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+        }
+
+        HardwareCounters(const HardwareCounters &) = delete;
+        HardwareCounters &operator=(const HardwareCounters &) = delete;
+
+        ~HardwareCounters() { Close(); }
+
+        bool IsOpen() const { return fds_[0] >= 0; }
+
+        HardwareReading Read() const {
+            HardwareReading reading;
+#if defined(MATRIX_INSTRUMENTATION) && defined(__linux__)
+            uint64_t values[4] = {};
+            if (IsOpen() && read(fds_[0], values, sizeof(values)) == static_cast<ssize_t>(sizeof(values)))
+                reading = {values[1], values[2], values[3]};
+#endif
+            return reading;
+        }
+    private:
+        void Close() {
+#if defined(MATRIX_INSTRUMENTATION) && defined(__linux__)
+            for (int &fd : fds_) {
+                if (fd >= 0)
+                    close(fd);
+                fd = -1;
+            }
+#endif
+        }
+
+        int fds_[3] = {-1, -1, -1};
+    }; // class HardwareCounters
+
+    // The counts of one thread. Only the owner adds to them; GetSnapshot
+    // and Reset reach them from other threads, hence the atomics.
+    struct ThreadCounters {
+        std::array<std::atomic<uint64_t>, kCounterCount> counters{};
+        std::array<std::array<std::atomic<uint64_t>, 5>, kRegionCount> regions{};
+    }; // struct ThreadCounters
+
+    inline void Add(std::atomic<uint64_t> &value, uint64_t amount) {
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    // Every thread's block, kept after the thread exits so that its counts
+    // stay in the totals.
+    class Registry {
+    public:
+        static Registry &Get() {
+            static Registry registry;
+            return registry;
+        }
+
+        std::shared_ptr<ThreadCounters> Register() {
+            auto counters = std::make_shared<ThreadCounters>();
+            std::lock_guard lock(mutex_);
+            threads_.push_back(counters);
+            return counters;
+        }
+
+        matrix::instrumentation::Snapshot Sum() const {
+            matrix::instrumentation::Snapshot snapshot;
+            std::lock_guard lock(mutex_);
+            for (const auto &thread : threads_) {
+                for (size_t i = 0; i < kCounterCount; ++i)
+                    snapshot.counters[i] += thread->counters[i].load(std::memory_order_relaxed);
+
+                for (size_t i = 0; i < kRegionCount; ++i) {
+                    auto &stats = snapshot.regions[i];
+                    const auto &values = thread->regions[i];
+                    stats.calls += values[0].load(std::memory_order_relaxed);
+                    stats.nanoseconds += values[1].load(std::memory_order_relaxed);
+                    stats.cycles += values[2].load(std::memory_order_relaxed);
+                    stats.instructions += values[3].load(std::memory_order_relaxed);
+                    stats.cache_misses += values[4].load(std::memory_order_relaxed);
+                }
+            }
+
+            return snapshot;
+        }
+
+        // Counts a thread adds while this runs may be lost.
+        void Reset() {
+            std::lock_guard lock(mutex_);
+            for (const auto &thread : threads_) {
+                for (auto &value : thread->counters)
+                    value.store(0, std::memory_order_relaxed);
+                for (auto &values : thread->regions)
+                    for (auto &value : values)
+                        value.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        std::atomic<bool> use_hardware{false};
+    private:
+        Registry() = default;
+
+        mutable std::mutex mutex_;
+        std::vector<std::shared_ptr<ThreadCounters>> threads_;
+    }; // class Registry
+
+    inline ThreadCounters &Local() {
+        thread_local std::shared_ptr<ThreadCounters> local = Registry::Get().Register();
+        return *local;
+    }
+
+    inline void Count(matrix::instrumentation::Counter counter, uint64_t amount) {
+        Add(Local().counters[static_cast<size_t>(counter)], amount);
+    }
+
+    // The thread's hardware counters, opened on first use once enabled and
+    // closed with the thread; nullptr while disabled or when they cannot be
+    // opened.
+    inline HardwareCounters *LocalHardware() {
+        if (!Registry::Get().use_hardware.load(std::memory_order_relaxed))
+            return nullptr;
+
+        thread_local HardwareCounters hardware;
+        return hardware.IsOpen() ? &hardware : nullptr;
+    }
+} // namespace instrumentation
+} // namespace details
+
+namespace instrumentation {
+    // Times the enclosing scope into the calling thread's region counts,
+    // with the hardware counters when they are enabled.
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(Region region)
+            : local_(details::instrumentation::Local()), region_(static_cast<size_t>(region)),
+              hardware_(details::instrumentation::LocalHardware()) {
+            if (hardware_)
+                start_reading_ = hardware_->Read();
+            start_ = std::chrono::steady_clock::now();
+        }
+
+        ScopedTimer(const ScopedTimer &) = delete;
+        ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+        ~ScopedTimer() {
+            auto elapsed = std::chrono::steady_clock::now() - start_;
+            auto &values = local_.regions[region_];
+            details::instrumentation::Add(values[0], 1);
+            details::instrumentation::Add(
+                values[1], static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+
+            if (hardware_) {
+                details::instrumentation::HardwareReading reading = hardware_->Read();
+                details::instrumentation::Add(values[2], reading.cycles - start_reading_.cycles);
+                details::instrumentation::Add(values[3], reading.instructions - start_reading_.instructions);
+                details::instrumentation::Add(values[4], reading.cache_misses - start_reading_.cache_misses);
+            }
+        }
+    private:
+        details::instrumentation::ThreadCounters &local_;
+        size_t region_;
+        details::instrumentation::HardwareCounters *hardware_;
+        details::instrumentation::HardwareReading start_reading_;
+        std::chrono::steady_clock::time_point start_;
+    }; // class ScopedTimer
+
+    // Totals over all threads since the start or the last Reset.
+    inline Snapshot GetSnapshot() {
+        if constexpr (kEnabled)
+            return details::instrumentation::Registry::Get().Sum();
+        else
+            return Snapshot{};
+    }
+
+    inline void Reset() {
+        if constexpr (kEnabled)
+            details::instrumentation::Registry::Get().Reset();
+    }
+
+    // Timed regions that start afterwards also read the hardware counters.
+    inline void EnableHardwareCounters(bool enable = true) {
+        if constexpr (kEnabled)
+            details::instrumentation::Registry::Get().use_hardware.store(enable, std::memory_order_relaxed);
+    }
+
+    // Whether the calling thread can open the perf_event group; always
+    // false without instrumentation or outside Linux.
+    inline bool HardwareCountersAvailable() { return details::instrumentation::HardwareCounters().IsOpen(); }
+
+    // {"enabled": ..., "counters": {name: count}, "regions": {name: {calls,
+    // seconds, cycles, instructions, ipc, cache_misses}}}
+    inline void WriteJson(std::ostream &out, const Snapshot &snapshot = GetSnapshot()) {
+        out << "{\"enabled\": " << (kEnabled ? "true" : "false") << ", \"counters\": {";
+        for (size_t i = 0; i < kCounterCount; ++i)
+            out << (i ? ", " : "") << '"' << GetName(static_cast<Counter>(i)) << "\": " << snapshot.counters[i];
+
+        out << "}, \"regions\": {";
+        for (size_t i = 0; i < kRegionCount; ++i) {
+            const RegionStats &stats = snapshot.regions[i];
+            out << (i ? ", " : "") << '"' << GetName(static_cast<Region>(i)) << "\": {\"calls\": " << stats.calls
+                << ", \"seconds\": " << static_cast<double>(stats.nanoseconds) * 1e-9
+                << ", \"cycles\": " << stats.cycles << ", \"instructions\": " << stats.instructions
+                << ", \"ipc\": " << stats.GetInstructionsPerCycle() << ", \"cache_misses\": " << stats.cache_misses
+                << "}";
+        }
+
+        out << "}}";
+    }
+} // namespace instrumentation
+} // namespace matrix
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "gemm.hpp"
+#include "instrumentation.hpp"
+#include "matrix.hpp"
+#include "simd.hpp"
+
+namespace matrix {
+
+// LU decomposition with partial pivoting, P * A = L * U. The factors are
+// computed once, stored packed in one matrix (unit L below the diagonal,
+// U on and above it) and reused by every query.
+template <typename T> class LU {
+    static_assert(std::is_floating_point_v<T>, "LU needs a floating point element type");
+
+public:
+    explicit LU(const Matrix<T> &matrix) : lu_(matrix) { Factor(); }
+
+    explicit LU(Matrix<T> &&matrix) : lu_(std::move(matrix)) { Factor(); }
+
+    size_t GetSize() const { return lu_.GetRowCount(); }
+
+    // True when some pivot is exactly zero; solves then throw.
+    bool IsSingular() const { return singular_; }
+
+    // Row i of P * A is row GetPermutation()[i] of A.
+    const std::vector<size_t> &GetPermutation() const { return permutation_; }
+
+    const Matrix<T> &GetPacked() const { return lu_; }
+
+    Matrix<T> GetL() const {
+        size_t size = GetSize();
+        std::vector<T> nums(size * size, T{});
+
+        for (size_t i = 0; i < size; ++i) {
+            std::copy(lu_.GetData() + i * size, lu_.GetData() + i * size + i, nums.begin() + i * size);
+            nums[i * size + i] = T{1};
+        }
+
+        return Matrix<T>{size, nums.begin(), nums.end()};
+    }
+
+    Matrix<T> GetU() const {
+        size_t size = GetSize();
+        std::vector<T> nums(size * size, T{});
+
+        for (size_t i = 0; i < size; ++i)
+            std::copy(lu_.GetData() + i * size + i, lu_.GetData() + (i + 1) * size,
+                      nums.begin() + i * size + i);
+
+        return Matrix<T>{size, nums.begin(), nums.end()};
+    }
+
+    T Determinant() const { return DeterminantProduct().Get(); }
+
+    // log |det|, finite wherever det is non-zero, however far out of the
+    // range of T the determinant itself is; negative infinity if singular.
+    T LogAbsDeterminant() const { return DeterminantProduct().GetLogAbs(); }
+
+    // -1, 0 or 1.
+    int DeterminantSign() const { return DeterminantProduct().GetSign(); }
+
+    std::vector<T> Solve(const std::vector<T> &b) const {
+        if (b.size() != GetSize())
+            throw std::logic_error("Right-hand side size does not match the matrix");
+
+        Matrix<T> rhs{GetSize(), 1, b.begin(), b.end()};
+        Matrix<T> x = Solve(rhs);
+
+        return std::vector<T>(x.GetData(), x.GetData() + GetSize());
+    }
+
+    // Solves A * X = B for every column of B at once.
+    Matrix<T> Solve(const Matrix<T> &b) const {
+        size_t size = GetSize();
+        if (b.GetRowCount() != size)
+            throw std::logic_error("Right-hand side rows count does not match the matrix");
+
+        if (singular_)
+            throw std::logic_error("Matrix is singular");
+
+        size_t rhs_count = b.GetColumnCount();
+        std::vector<T> nums(size * rhs_count);
+        for (size_t i = 0; i < size; ++i)
+            std::copy(b.GetData() + permutation_[i] * rhs_count,
+                      b.GetData() + (permutation_[i] + 1) * rhs_count,
+                      nums.begin() + i * rhs_count);
+
+        Matrix<T> x{size, rhs_count, nums.begin(), nums.end()};
+        SolveInPlace(x.GetData(), rhs_count);
+        return x;
+    }
+
+    // Solves A^T * x = b: U^T and L^T in turn, then the permutation undone.
+    std::vector<T> SolveTransposed(const std::vector<T> &b) const {
+        size_t size = GetSize();
+        if (b.size() != size)
+            throw std::logic_error("Right-hand side size does not match the matrix");
+
+        if (singular_)
+            throw std::logic_error("Matrix is singular");
+
+        const T *lu = lu_.GetData();
+        std::vector<T> y = b;
+        for (size_t i = 0; i < size; ++i) {
+            y[i] /= lu[i * size + i];
+            details::simd::SubScaled(y.data() + i + 1, y[i], lu + i * size + i + 1, size - i - 1);
+        }
+
+        for (size_t i = size; i-- > 0;)
+            details::simd::SubScaled(y.data(), y[i], lu + i * size, i);
+
+        std::vector<T> x(size);
+        for (size_t i = 0; i < size; ++i)
+            x[permutation_[i]] = y[i];
+
+        return x;
+    }
+
+    // Estimate of ||A^-1||_1 from the factors by Hager's method as refined
+    // by Higham: a few solves with A and A^T climb to the column of A^-1
+    // of largest norm. Usually exact or within a small factor, and never
+    // an overestimate. Infinity if singular.
+    T InverseNormEstimate() const {
+        if (singular_)
+            return std::numeric_limits<T>::infinity();
+
+        constexpr size_t kMaxIterations = 5;
+        size_t size = GetSize();
+        std::vector<T> x(size, T{1} / static_cast<T>(size));
+        T estimate = 0;
+        size_t previous_index = size;
+
+        for (size_t iteration = 0; iteration < kMaxIterations; ++iteration) {
+            x = Solve(x);
+            T norm = 0;
+            for (T value : x)
+                norm += std::fabs(value);
+
+            if (iteration > 0 && norm <= estimate)
+                break;
+            estimate = norm;
+
+            std::vector<T> signs(size);
+            for (size_t i = 0; i < size; ++i)
+                signs[i] = (x[i] >= 0) ? T{1} : T{-1};
+
+            std::vector<T> z = SolveTransposed(signs);
+            size_t index = 0;
+            for (size_t i = 1; i < size; ++i)
+                if (std::fabs(z[i]) > std::fabs(z[index]))
+                    index = i;
+
+            if (index == previous_index)
+                break;
+            previous_index = index;
+
+            std::fill(x.begin(), x.end(), T{});
+            x[index] = T{1};
+        }
+
+        // Higham's alternating vector catches the matrices the climb
+        // above is fooled by.
+        std::vector<T> alternating(size);
+        for (size_t i = 0; i < size; ++i)
+            alternating[i] = static_cast<T>((i % 2 == 0) ? 1 : -1) *
+                             (T{1} + static_cast<T>(i) / static_cast<T>(std::max<size_t>(size - 1, 1)));
+
+        T alternating_norm = 0;
+        for (T value : Solve(alternating))
+            alternating_norm += std::fabs(value);
+
+        return std::max(estimate, 2 * alternating_norm / (3 * static_cast<T>(size)));
+    }
+
+    Matrix<T> Inverse() const {
+        size_t size = GetSize();
+        std::vector<T> nums(size * size, T{});
+        for (size_t i = 0; i < size; ++i)
+            nums[i * size + i] = T{1};
+
+        return Solve(Matrix<T>{size, nums.begin(), nums.end()});
+    }
+
+private:
+    static constexpr size_t kBlockSize = 64;
+
+    details::ScaledProduct<T> DeterminantProduct() const {
+        details::ScaledProduct<T> det{singular_ ? T{} : static_cast<T>(sign_)};
+        size_t size = GetSize();
+        for (size_t i = 0; i < size && !singular_; ++i)
+            det.Multiply(lu_.GetData()[i * size + i]);
+
+        return det;
+    }
+
+    // Forward and back substitution on already permuted right-hand sides,
+    // one row of X at a time so every update is a contiguous row operation.
+    void SolveInPlace(T *x, size_t rhs_count) const {
+        size_t size = GetSize();
+        const T *lu = lu_.GetData();
+
+        // A single right-hand side is a dot product per row instead.
+        if (rhs_count == 1) {
+            for (size_t i = 0; i < size; ++i)
+                x[i] -= details::simd::Dot(lu + i * size, x, i);
+
+            for (size_t i = size; i-- > 0;)
+                x[i] = (x[i] - details::simd::Dot(lu + i * size + i + 1, x + i + 1, size - i - 1)) /
+                       lu[i * size + i];
+            return;
+        }
+
+        for (size_t i = 0; i < size; ++i)
+            for (size_t r = 0; r < i; ++r)
+                details::simd::SubScaled(x + i * rhs_count, lu[i * size + r], x + r * rhs_count, rhs_count);
+
+        for (size_t i = size; i-- > 0;) {
+            for (size_t r = i + 1; r < size; ++r)
+                details::simd::SubScaled(x + i * rhs_count, lu[i * size + r], x + r * rhs_count, rhs_count);
+
+            details::simd::Scale(x + i * rhs_count, T{1} / lu[i * size + i], rhs_count);
+        }
+    }
+
+    // Right-looking blocked factorization: an unblocked panel of kBlockSize
+    // columns, a triangular solve for the block row of U and one GEMM for
+    // the trailing submatrix.
+    void Factor() {
+        MATRIX_TIMED_SCOPE(Elimination);
+        if (lu_.GetRowCount() != lu_.GetColumnCount())
+            throw std::logic_error("Matrix rows and columns counts is not equal");
+
+        if (lu_.GetRowCount() == 0)
+            throw std::logic_error("Matrix is empty");
+
+        size_t size = GetSize();
+        T *a = lu_.GetData();
+        permutation_.resize(size);
+        std::iota(permutation_.begin(), permutation_.end(), 0);
+
+        for (size_t k0 = 0; k0 < size; k0 += kBlockSize) {
+            size_t kb = std::min(kBlockSize, size - k0);
+            size_t k1 = k0 + kb;
+
+            FactorPanel(k0, k1);
+
+            MATRIX_COUNT(Flops, kb * (kb - 1) * (size - k1));
+            for (size_t i = k0 + 1; i < k1; ++i)
+                for (size_t r = k0; r < i; ++r)
+                    details::simd::SubScaled(a + i * size + k1, a[i * size + r], a + r * size + k1, size - k1);
+
+            details::Gemm(size - k1, size - k1, kb, T{-1},
+                          a + k1 * size + k0, size, 1,
+                          a + k0 * size + k1, size, 1,
+                          true, a + k1 * size + k1, size, 1);
+        }
+    }
+
+    void FactorPanel(size_t k0, size_t k1) {
+        size_t size = GetSize();
+        T *a = lu_.GetData();
+
+        for (size_t j = k0; j < k1; ++j) {
+            size_t pivot = j;
+            for (size_t i = j + 1; i < size; ++i)
+                if (std::fabs(a[i * size + j]) > std::fabs(a[pivot * size + j]))
+                    pivot = i;
+
+            if (pivot != j) {
+                MATRIX_COUNT(RowSwaps, 1);
+                std::swap_ranges(a + j * size, a + (j + 1) * size, a + pivot * size);
+                std::swap(permutation_[j], permutation_[pivot]);
+                sign_ = -sign_;
+            }
+
+            T diag = a[j * size + j];
+            if (diag == T{}) {
+                singular_ = true;
+                continue;
+            }
+
+            MATRIX_COUNT(Flops, 2 * (size - j - 1) * (k1 - j - 1));
+            for (size_t i = j + 1; i < size; ++i) {
+                T *row = a + i * size;
+                row[j] /= diag;
+                details::simd::SubScaled(row + j + 1, row[j], a + j * size + j + 1, k1 - j - 1);
+            }
+        }
+    }
+
+    Matrix<T> lu_;
+    std::vector<size_t> permutation_;
+    int sign_ = 1;
+    bool singular_ = false;
+}; // class LU
+} // namespace matrix
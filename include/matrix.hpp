@@ -1,14 +1,33 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <iostream>
 #include <iterator>
+#include <limits>
+#include <memory_resource>
 #include <cassert>
 #include <new>
+#include <numbers>
 #include <numeric>
+#include <optional>
 #include <type_traits>
-
+#include <vector>
+
+#include "allocator.hpp"
+#include "big_int.hpp"
+#include "exact_det.hpp"
+#include "gemm.hpp"
+#include "instrumentation.hpp"
+#include "matrix_expr.hpp"
+#include "matrix_view.hpp"
 #include "real_nums.hpp"
+#include "simd.hpp"
+#include "strassen.hpp"
+#include "structure.hpp"
+#include "thread_pool.hpp"
+#include "transpose.hpp"
 
 namespace matrix {
 namespace details {
@@ -25,6 +44,7 @@ namespace details {
             if (size_ != other.size_)
                 throw std::logic_error("Rows sizes do not match");
 
+            MATRIX_COUNT(BytesCopied, size_ * sizeof(T));
             std::copy(other.data_, other.data_ + size_, data_);
 
             return *this;
@@ -34,16 +54,14 @@ namespace details {
         const T &operator[](int num_elem) const { return data_[num_elem]; }
 
         ProxyRow &operator*=(const T &val) {
-            for (size_t i = 0; i < size_; ++i)
-                data_[i] *= val;
-
+            simd::Scale(data_, val, size_);
             return *this;
         }
 
         inline size_t GetSize() const { return size_; }
 
         inline T GetSum() const {
-            return std::accumulate(data_, data_ + size_, 0);
+            return std::accumulate(data_, data_ + size_, T{});
         }
 
         void print() const {
@@ -58,13 +76,94 @@ namespace details {
         size_t size_ = 0;
     }; // class ProxyRow
     
+    // Rows of a row-major buffer seen through a permutation. Pivoting swaps
+    // two indices instead of two rows; the data is put in the permuted order
+    // only when CopyTo is asked for it.
+    template <typename T> class PermutedRows {
+    public:
+        PermutedRows(T *data, size_t row_count, size_t column_count)
+            : PermutedRows(data, row_count, column_count, column_count) {}
+
+        PermutedRows(T *data, size_t row_count, size_t column_count, size_t row_stride)
+            : data_(data), column_count_(column_count), row_stride_(row_stride), order_(row_count) {
+            std::iota(order_.begin(), order_.end(), 0);
+        }
+
+        T *GetRow(size_t num_row) const { return data_ + order_[num_row] * row_stride_; }
+
+        ProxyRow<T> operator[](size_t num_row) const { return ProxyRow<T>(column_count_, GetRow(num_row)); }
+
+        void Swap(size_t lhs, size_t rhs) {
+            MATRIX_COUNT(RowSwaps, 1);
+            std::swap(order_[lhs], order_[rhs]);
+        }
+
+        size_t GetRowCount() const { return order_.size(); }
+
+        size_t GetColumnCount() const { return column_count_; }
+
+        // Row i of the view is row GetOrder()[i] of the underlying buffer.
+        const std::vector<size_t> &GetOrder() const { return order_; }
+
+        void CopyTo(T *dst) const {
+            for (size_t i = 0; i < order_.size(); ++i)
+                std::copy(GetRow(i), GetRow(i) + column_count_, dst + i * column_count_);
+        }
+    private:
+        T *data_ = nullptr;
+        size_t column_count_ = 0;
+        size_t row_stride_ = 0;
+        std::vector<size_t> order_;
+    }; // class PermutedRows
+
+    // Product of many factors kept as mantissa * 2^exponent, renormalized
+    // by frexp after every factor, so it neither overflows nor underflows
+    // on the way however long the product is. The log of its magnitude is
+    // available even when the value itself is out of the range of T.
+    template <typename T> class ScaledProduct {
+    public:
+        explicit ScaledProduct(T value = T{1}) { Multiply(value); }
+
+        void Multiply(T factor) {
+            int exponent = 0;
+            mantissa_ = std::frexp(mantissa_ * factor, &exponent);
+            exponent_ += exponent;
+        }
+
+        // -1, 0 or 1.
+        int GetSign() const { return (mantissa_ > 0) - (mantissa_ < 0); }
+
+        // The product itself; an infinity or zero when it is out of range.
+        T Get() const {
+            constexpr long kLimit = std::numeric_limits<int>::max();
+            return std::ldexp(mantissa_, static_cast<int>(std::clamp(exponent_, -kLimit, kLimit)));
+        }
+
+        // log |product|, negative infinity for a zero product.
+        T GetLogAbs() const {
+            return std::log(std::fabs(mantissa_)) + static_cast<T>(exponent_) * std::numbers::ln2_v<T>;
+        }
+    private:
+        T mantissa_ = T{1};
+        long exponent_ = 0;
+    }; // class ScaledProduct
+
+    // Storage is taken from a memory resource, the process-wide default
+    // unless the owner passes another one, and all but small buffers start
+    // on a cache line. The resource travels with the storage when a buffer
+    // is moved.
     template <typename T> class MatrixBuf {
     protected:
-        MatrixBuf(size_t size = 0)
-            : size_(size),
-            data_((size == 0)
+        MatrixBuf(size_t size = 0, std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+            : data_((size == 0)
                         ? nullptr
-                        : static_cast<T *>(::operator new(size * sizeof(T), std::align_val_t(alignof(T))))) {}
+                        : static_cast<T *>(resource->allocate(size * sizeof(T), StorageAlignment<T>(size)))),
+              size_(size), resource_(resource) {
+            if (size != 0) {
+                MATRIX_COUNT(Allocations, 1);
+                MATRIX_COUNT(AllocatedBytes, size * sizeof(T));
+            }
+        }
 
         MatrixBuf(const MatrixBuf<T> &other) = delete;
         MatrixBuf<T> &operator=(const MatrixBuf<T> &other) = delete;
@@ -73,23 +172,27 @@ namespace details {
             std::swap(data_, other.data_);
             std::swap(size_, other.size_);
             std::swap(used_, other.used_);
+            std::swap(resource_, other.resource_);
         }
 
         MatrixBuf<T> &operator=(MatrixBuf<T> &&other) noexcept {
             std::swap(data_, other.data_);
             std::swap(size_, other.size_);
             std::swap(used_, other.used_);
+            std::swap(resource_, other.resource_);
             return *this;
         }
 
         ~MatrixBuf() {
             std::destroy(data_, data_ + used_);
-            ::operator delete(data_, std::align_val_t(alignof(T)));
+            if (data_ != nullptr)
+                resource_->deallocate(data_, size_ * sizeof(T), StorageAlignment<T>(size_));
         }
     protected:
         T *data_ = nullptr;
         size_t size_ = 0;
         size_t used_ = 0;
+        std::pmr::memory_resource *resource_ = std::pmr::get_default_resource();
     }; // class MatrixBuf
 }; // namespace details
 
@@ -99,8 +202,13 @@ template <typename T> class Matrix : private MatrixBuf<T> {
     using MatrixBuf<T>::used_;
     using MatrixBuf<T>::size_;
     using MatrixBuf<T>::data_;
+    using MatrixBuf<T>::resource_;
+
+    template <typename U> friend class Matrix;
 
 public:
+    using value_type = T;
+
     Matrix(size_t size = 0)
         : MatrixBuf<T>(size * size), row_count_(size), column_count_(size) {}
 
@@ -110,26 +218,32 @@ public:
         Construct(begin, end);
     }
 
-    Matrix(size_t row_count, size_t column_count)
-        : MatrixBuf<T>(row_count * column_count), row_count_(row_count),
+    // The constructors taking a memory resource allocate the storage from
+    // it, e.g. GetScratchResource() for matrices that die on this thread.
+    Matrix(size_t row_count, size_t column_count,
+           std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : MatrixBuf<T>(row_count * column_count, resource), row_count_(row_count),
           column_count_(column_count) {}
 
     template <typename InputIterator>
     Matrix(size_t row_count, size_t column_count, InputIterator begin,
-           InputIterator end)
-        : MatrixBuf<T>(row_count * column_count), row_count_(row_count),
+           InputIterator end, std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : MatrixBuf<T>(row_count * column_count, resource), row_count_(row_count),
           column_count_(column_count) {
         Construct(begin, end);
     }
 
-    Matrix(const Matrix &other)
-        : MatrixBuf<T>(other.size_), row_count_(other.row_count_),
+    // A copy allocates from the default resource unless told otherwise, so
+    // copying a scratch matrix yields one that may outlive the thread.
+    Matrix(const Matrix &other, std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : MatrixBuf<T>(other.size_, resource), row_count_(other.row_count_),
           column_count_(other.column_count_) {
+        MATRIX_COUNT(BytesCopied, other.size_ * sizeof(T));
         Construct(other.data_, other.data_ + other.size_);
     }
 
     Matrix &operator=(const Matrix &other) {
-        Matrix tmp{other};
+        Matrix tmp{other, resource_};
         std::swap(*this, tmp);
         return *this;
     }
@@ -137,6 +251,33 @@ public:
     Matrix(Matrix<T> &&other) = default;
     Matrix<T> &operator=(Matrix<T> &&other) = default;
 
+    // Evaluates a lazy expression such as A + B - 2 * C in a single loop,
+    // or A * B + C as one accumulating GEMM.
+    template <typename Expr> requires details::IsMatrixExpr<Expr>
+    Matrix(const Expr &expr, std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : MatrixBuf<T>(expr.GetRowCount() * expr.GetColumnCount(), resource),
+          row_count_(expr.GetRowCount()), column_count_(expr.GetColumnCount()) {
+        if constexpr (std::is_arithmetic_v<T> && details::HasDirectEval<Expr>) {
+            expr.AssignTo(data_, column_count_, 1);
+            used_ = size_;
+        } else {
+            for (size_t i = 0; i < row_count_; ++i)
+                for (size_t j = 0; j < column_count_; ++j, ++used_)
+                    std::construct_at(data_ + used_, expr.Eval(i, j));
+        }
+    }
+
+    template <typename Expr> requires details::IsMatrixExpr<Expr>
+    Matrix &operator=(const Expr &expr) {
+        if (row_count_ != expr.GetRowCount() || column_count_ != expr.GetColumnCount() ||
+            !details::AssignExpr(Target(), expr)) {
+            Matrix tmp{expr, resource_};
+            std::swap(*this, tmp);
+        }
+
+        return *this;
+    }
+
     ProxyRow<T> operator[](int num_row) const {
         if (num_row >= row_count_)
             throw std::range_error("Row index is more count of exist rows");
@@ -158,23 +299,102 @@ public:
 
     size_t GetColumnCount() const { return column_count_; }
 
+    // Row-major storage, row i starts at GetData() + i * GetColumnCount().
+    T *GetData() { return data_; }
+    const T *GetData() const { return data_; }
+
+    std::pmr::memory_resource *GetResource() const { return resource_; }
+
+    // The whole matrix as a view; blocks, rows, columns and the transpose
+    // are taken from it without copying.
+    MatrixView<T> View() { return MatrixView<T>(data_, row_count_, column_count_, column_count_); }
+    ConstMatrixView<T> View() const { return ConstMatrixView<T>(data_, row_count_, column_count_, column_count_); }
+
     Matrix<T> Transpose() const {
+        MATRIX_TIMED_SCOPE(Transpose);
         Matrix<T> transpose(column_count_, row_count_);
 
-        for (size_t i = 0; i < row_count_; ++i)
-            for (size_t j = 0; j < column_count_; ++j, ++(transpose.used_))
-                transpose[j][i] = (*this)[i][j];
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            details::TransposeInto(data_, column_count_, transpose.data_, row_count_,
+                                   row_count_, column_count_);
+            transpose.used_ = size_;
+        } else {
+            for (size_t i = 0; i < column_count_; ++i)
+                for (size_t j = 0; j < row_count_; ++j, ++(transpose.used_))
+                    std::construct_at(transpose.data_ + transpose.used_, data_[j * column_count_ + i]);
+        }
 
         return transpose;
     }
 
+    // Writes the transpose into out, reusing its storage when it holds as
+    // many elements; out may be this matrix.
+    void Transpose(Matrix<T> &out) const {
+        if (&out == this) {
+            out.TransposeInPlace();
+            return;
+        }
+
+        if (out.size_ != size_) {
+            out = Transpose();
+            return;
+        }
+
+        MATRIX_TIMED_SCOPE(Transpose);
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            details::TransposeInto(data_, column_count_, out.data_, row_count_, row_count_, column_count_);
+            out.used_ = size_;
+        } else {
+            // out's elements may not be constructed yet; replace them all.
+            std::destroy(out.data_, out.data_ + out.used_);
+            out.used_ = 0;
+            for (size_t i = 0; i < column_count_; ++i)
+                for (size_t j = 0; j < row_count_; ++j, ++(out.used_))
+                    std::construct_at(out.data_ + out.used_, data_[j * column_count_ + i]);
+        }
+
+        out.row_count_ = column_count_;
+        out.column_count_ = row_count_;
+    }
+
+    // out = lhs * rhs, written into the storage out already has when its
+    // shape is that of the product. out may be lhs or rhs, which costs a
+    // temporary as operator*= does.
+    friend void Multiply(const Matrix<T> &lhs, const Matrix<T> &rhs, Matrix<T> &out) {
+        if (lhs.column_count_ != rhs.row_count_)
+            throw std::logic_error("Matrixes sizes do not valid for multiply");
+
+        if (&out == &lhs || &out == &rhs || out.row_count_ != lhs.row_count_ ||
+            out.column_count_ != rhs.column_count_) {
+            Matrix<T> result{lhs.row_count_, rhs.column_count_, out.resource_};
+            result.AssignProduct(lhs, rhs);
+            out = std::move(result);
+            return;
+        }
+
+        if constexpr (!std::is_arithmetic_v<T>) {
+            std::destroy(out.data_, out.data_ + out.used_);
+            out.used_ = 0;
+        }
+
+        out.AssignProduct(lhs, rhs);
+    }
+
+    // Transposes without a second buffer: tiled swaps across the diagonal
+    // for a square matrix, cycle following for a rectangular one.
+    Matrix<T> &TransposeInPlace() {
+        MATRIX_TIMED_SCOPE(Transpose);
+        details::TransposeInPlace(data_, row_count_, column_count_);
+        std::swap(row_count_, column_count_);
+        return *this;
+    }
+
     Matrix<T> &operator+=(const Matrix<T> &other) {
         if (row_count_ != other.row_count_ ||
             column_count_ != other.column_count_)
             throw std::logic_error("Matrixs sizes do not match");
 
-        for (size_t i = 0; i < size_; ++i)
-            data_[i] += other.data_[i];
+        simd::Add(data_, other.data_, size_);
 
         return *this;
     }
@@ -184,49 +404,49 @@ public:
             column_count_ != other.column_count_)
             throw std::logic_error("Matrixs sizes do not match");
 
-        for (size_t i = 0; i < size_; ++i)
-            data_[i] -= other.data_[i];
+        simd::Sub(data_, other.data_, size_);
 
         return *this;
     }
 
-    Matrix<T> &operator*=(const T &val) {
-        for (size_t i = 0; i < size_; ++i)
-            data_[i] *= val;
+    template <typename Expr> requires details::IsMatrixExpr<Expr>
+    Matrix<T> &operator+=(const Expr &expr) {
+        if (row_count_ != expr.GetRowCount() || column_count_ != expr.GetColumnCount())
+            throw std::logic_error("Matrixs sizes do not match");
+
+        details::AccumulateExpr(Target(), expr, false);
 
         return *this;
     }
 
-    Matrix<T> &operator*=(const Matrix<T> &other) {
-        if (column_count_ != other.row_count_)
-            throw std::logic_error("Matrixes sizes do not valid for multiply");
+    template <typename Expr> requires details::IsMatrixExpr<Expr>
+    Matrix<T> &operator-=(const Expr &expr) {
+        if (row_count_ != expr.GetRowCount() || column_count_ != expr.GetColumnCount())
+            throw std::logic_error("Matrixs sizes do not match");
 
-        Matrix<T> transpose = other.Transpose();
-        Matrix<T> result{row_count_, other.column_count_};
+        details::AccumulateExpr(Target(), expr, true);
 
-        Matrix<T> tmp_matrix{1, column_count_};
-        ProxyRow<T> tmp_row = tmp_matrix[0];
+        return *this;
+    }
 
-        for (size_t i = 0; i < result.row_count_; ++i) {
-            ProxyRow<T> tmp1((*this)[i]);
+    Matrix<T> &operator*=(const T &val) {
+        simd::Scale(data_, val, size_);
 
-            for (size_t j = 0; j < result.column_count_; ++j) {
-                ProxyRow<T> tmp2(transpose[j]);
-                tmp_row = tmp2;
+        return *this;
+    }
 
-                for (size_t k = 0; k < column_count_; ++k) {
-                    tmp_row[k] *= tmp1[k];
-                }
+    Matrix<T> &operator*=(const Matrix<T> &other) {
+        if (column_count_ != other.row_count_)
+            throw std::logic_error("Matrixes sizes do not valid for multiply");
 
-                result[i][j] = tmp_row.GetSum();
-            }
-        }
+        Matrix<T> result{row_count_, other.column_count_, resource_};
+        result.AssignProduct(*this, other);
 
-        *this = result;
+        *this = std::move(result);
         return *this;
     }
 
-    T GetDeterminant() const {
+    T GetDeterminant() const & {
         static_assert(std::is_fundamental<T>::value, "Element type is not fundamental");
 
         if (row_count_ != column_count_)
@@ -236,35 +456,56 @@ public:
         if (row_count_ == 0)
             throw std::logic_error("Matrix is empty");
 
-        if (std::is_integral_v<T>) {
+        if constexpr (std::is_integral_v<T>) {
             return GetIntDeterminant();
+        } else {
+            if (std::optional<T> det = GetStructuredDeterminant(data_, row_count_, column_count_))
+                return *det;
+
+            Matrix<T> matrix = PaddedScratchCopy();
+            return GetFloatDeterminant(matrix.data_, row_count_, matrix.column_count_);
         }
+    }
 
-        T det = 1.0;
-        Matrix<T> matrix{*this};
+    // For a matrix that is not needed afterwards, std::move(m).GetDeterminant()
+    // eliminates in its storage instead of a scratch copy and leaves the
+    // elements unspecified. Integer matrices still work on a copy, which
+    // the overflow fallbacks restart from.
+    T GetDeterminant() && {
+        static_assert(std::is_fundamental<T>::value, "Element type is not fundamental");
 
-        Matrix<T> tmp_matrix{1, row_count_};
-        ProxyRow<T> tmp_row = tmp_matrix[0];
+        if (row_count_ != column_count_)
+            throw std::logic_error(
+                "Matrix rows and columns counts is not equal");
 
-        for (size_t i = 0; i < row_count_ - 1; ++i) {
-            det *= matrix.SwapRows(column_count_, i, row_count_);
-            if (det == 0)
-                return 0;
+        if (row_count_ == 0)
+            throw std::logic_error("Matrix is empty");
 
-            for (size_t j = i + 1; j < column_count_; ++j) {
-                tmp_row = matrix[i];
-                tmp_row *= matrix[j][i] / matrix[i][i];
+        if constexpr (std::is_integral_v<T>) {
+            return GetIntDeterminant();
+        } else {
+            if (std::optional<T> det = GetStructuredDeterminant(data_, row_count_, column_count_))
+                return *det;
 
-                for (size_t k = 0; k < column_count_; ++k) {
-                    matrix[j][k] -= tmp_row[k];
-                }
-            }
+            return GetFloatDeterminant(data_, row_count_, column_count_);
         }
+    }
 
-        for (size_t i = 0; i < row_count_; ++i)
-            det *= matrix[i][i];
+    // Exact determinant of an integer matrix of any size and entries:
+    // fraction-free elimination in machine integers while no step
+    // overflows, the multi-modular engine of exact_det.hpp otherwise.
+    BigInt GetExactDeterminant() const requires std::is_integral_v<T> {
+        if (row_count_ != column_count_)
+            throw std::logic_error(
+                "Matrix rows and columns counts is not equal");
+
+        if (row_count_ == 0)
+            throw std::logic_error("Matrix is empty");
 
-        return det;
+        if (std::optional<int64_t> det = GetCheckedIntDeterminant())
+            return BigInt(*det);
+
+        return details::exact::Determinant(data_, row_count_, column_count_);
     }
 
     void print() const {
@@ -277,37 +518,24 @@ public:
             std::cout << std::endl;
         }
     }
+private:
+    details::StridedTarget<T> Target() { return {data_, row_count_, column_count_, column_count_, 1}; }
 
-    friend Matrix<T> operator+(const Matrix<T> &lhs, const Matrix<T> &rhs) {
-        Matrix<T> temp = lhs;
-        temp += rhs;
-        return temp;
-    }
-
-    friend Matrix<T> operator-(const Matrix<T> &lhs, const Matrix<T> &rhs) {
-        Matrix<T> temp = lhs;
-        temp -= rhs;
-        return temp;
-    }
+    // Working copy for the elimination loops, from the thread's scratch pool,
+    // with each row padded to start on a cache line. The padding columns
+    // are zero and never read.
+    template <typename U = T> Matrix<U> PaddedScratchCopy() const {
+        size_t stride = details::PaddedStride<U>(column_count_);
+        Matrix<U> copy(row_count_, stride, GetScratchResource());
 
-    friend Matrix<T> operator*(const Matrix<T> &lhs, const Matrix<T> &rhs) {
-        Matrix<T> temp = lhs;
-        temp *= rhs;
-        return temp;
-    }
+        for (size_t i = 0; i < row_count_; ++i)
+            for (size_t j = 0; j < stride; ++j, ++copy.used_)
+                std::construct_at(copy.data_ + copy.used_,
+                                  (j < column_count_) ? static_cast<U>(data_[i * column_count_ + j]) : U{});
 
-    friend Matrix<T> operator*(const Matrix<T> &lhs, const T &rhs) {
-        Matrix<T> temp = lhs;
-        temp *= rhs;
-        return temp;
+        return copy;
     }
 
-    friend Matrix<T> operator*(const T &lhs, const Matrix<T> &rhs) {
-        Matrix<T> temp = rhs;
-        temp *= lhs;
-        return temp;
-    }
-private:
     template <typename InputIterator>
     void Construct(InputIterator begin, InputIterator end) {
         size_t i = 0;
@@ -324,71 +552,267 @@ private:
                                    "than MatrixBuf size");
     }
 
-    int SwapRows(size_t column_count, size_t from, size_t to) {
-        T max_elem = (*this)[from][from];
+    // *this = lhs * rhs for storage of the product's shape that is neither
+    // operand. Arithmetic elements are overwritten, others constructed.
+    void AssignProduct(const Matrix<T> &lhs, const Matrix<T> &rhs) {
+        MATRIX_TIMED_SCOPE(Multiply);
+        if constexpr (std::is_arithmetic_v<T>) {
+            details::Multiply(row_count_, column_count_, lhs.column_count_, T{1},
+                              lhs.data_, lhs.column_count_, size_t{1},
+                              rhs.data_, rhs.column_count_, size_t{1},
+                              false, data_, column_count_, size_t{1});
+            used_ = size_;
+        } else {
+            MultiplyGeneric(lhs, rhs);
+        }
+    }
+
+    // Element types without a packed kernel are summed in the naive order,
+    // constructing each result element in place.
+    void MultiplyGeneric(const Matrix<T> &lhs, const Matrix<T> &rhs) {
+        size_t inner = lhs.column_count_;
+
+        for (size_t i = 0; i < row_count_; ++i)
+            for (size_t j = 0; j < column_count_; ++j, ++used_) {
+                if (inner == 0) {
+                    std::construct_at(data_ + i * column_count_ + j);
+                    continue;
+                }
+
+                T sum = lhs.data_[i * inner] * rhs.data_[j];
+                for (size_t k = 1; k < inner; ++k)
+                    sum += lhs.data_[i * inner + k] * rhs.data_[k * column_count_ + j];
+
+                std::construct_at(data_ + i * column_count_ + j, std::move(sum));
+            }
+    }
+
+    // Moves the largest candidate into the pivot position: the sign of the
+    // swap, or 0 when no candidate exceeds tolerance in magnitude.
+    static int SwapRows(PermutedRows<T> &rows, size_t from, T tolerance) {
+        MATRIX_TIMED_SCOPE(Pivoting);
+        T max_elem = rows.GetRow(from)[from];
         size_t num_row = from;
-        for (size_t i = from + 1; i < to; ++i) {
-            if (real_nums::is_more_zero(fabs((*this)[i][from]) -
-                                        fabs(max_elem))) {
-                max_elem = (*this)[i][from];
+        for (size_t i = from + 1; i < rows.GetRowCount(); ++i) {
+            if (std::fabs(rows.GetRow(i)[from]) - std::fabs(max_elem) > tolerance) {
+                max_elem = rows.GetRow(i)[from];
                 num_row = i;
             }
         }
 
-        if (real_nums::is_zero((max_elem)))
+        if (std::fabs(max_elem) <= tolerance)
             return 0;
 
         if (num_row == from)
             return 1;
 
-        Matrix<T> tmp_matrix{1, column_count};
-        tmp_matrix[0] = (*this)[from];
-        (*this)[from] = (*this)[num_row];
-        (*this)[num_row] = tmp_matrix[0];
-
+        rows.Swap(from, num_row);
         return -1;
     }
 
+    // structure::PivotTolerance of every column, zero for a zero column.
+    static AlignedBuffer<T> GetPivotTolerances(const T *data, size_t size, size_t stride) {
+        AlignedBuffer<T> tolerances(size, GetScratchResource());
+        T *scales = tolerances.data();
+        std::fill(scales, scales + size, T{});
+        for (size_t i = 0; i < size; ++i)
+            for (size_t j = 0; j < size; ++j)
+                scales[j] = std::max<T>(scales[j], std::fabs(data[i * stride + j]));
+
+        for (size_t j = 0; j < size; ++j)
+            scales[j] = details::structure::PivotTolerance(scales[j], size);
+
+        return tolerances;
+    }
+
+    // Triangular matrices are the product of their diagonal, narrow bands
+    // go through band LU and symmetric matrices try LDL^T, all without
+    // touching the matrix; nullopt for the general elimination.
+    static std::optional<T> GetStructuredDeterminant(const T *data, size_t size, size_t stride) {
+        namespace structure = details::structure;
+
+        size_t limit = structure::BandLimit(size);
+        MatrixStructure kind = structure::Detect(data, size, stride, limit);
+        bool is_band = kind.lower_bandwidth + kind.upper_bandwidth <= limit;
+        auto element = [data, stride](size_t i, size_t j) { return data[i * stride + j]; };
+        ScaledProduct<T> det;
+
+        if (kind.IsTriangular()) {
+            for (size_t i = 0; i < size; ++i)
+                det.Multiply(element(i, i));
+            return det.Get();
+        }
+
+        if (!is_band && !kind.is_symmetric)
+            return std::nullopt;
+
+        AlignedBuffer<T> tolerances = GetPivotTolerances(data, size, stride);
+        if (is_band) {
+            bool is_regular = structure::BandDeterminant(size, kind.lower_bandwidth, kind.upper_bandwidth,
+                                                         element, tolerances.data(), det);
+            return is_regular ? det.Get() : T{};
+        }
+
+        if (structure::LdltDeterminant(size, element, tolerances.data(), det))
+            return det.Get();
+
+        return std::nullopt;
+    }
+
+    // Gaussian elimination with partial pivoting of the size x size matrix
+    // with rows stride elements apart at data, overwritten. The pivots are
+    // multiplied as a ScaledProduct, so a determinant that fits T comes out
+    // even when a running product of the pivots would not.
+    static T GetFloatDeterminant(T *data, size_t size, size_t stride) {
+        AlignedBuffer<T> tolerances = GetPivotTolerances(data, size, stride);
+
+        MATRIX_TIMED_SCOPE(Elimination);
+        int sign = 1;
+        PermutedRows<T> rows{data, size, size, stride};
+
+        for (size_t i = 0; i < size - 1; ++i) {
+            sign *= SwapRows(rows, i, tolerances.data()[i]);
+            if (sign == 0)
+                return 0;
+
+            MATRIX_COUNT(Flops, 2 * (size - i - 1) * (size - i));
+            const T *pivot_row = rows.GetRow(i);
+            ForEachTrailingRow(i + 1, size, size - i, [&](size_t begin, size_t end) {
+                for (size_t j = begin; j < end; ++j) {
+                    T *row = rows.GetRow(j);
+                    simd::SubScaled(row + i, row[i] / pivot_row[i], pivot_row + i, size - i);
+                }
+            });
+        }
+
+        if (std::fabs(rows.GetRow(size - 1)[size - 1]) <= tolerances.data()[size - 1])
+            return 0;
+
+        ScaledProduct<T> det{static_cast<T>(sign)};
+        for (size_t i = 0; i < size; ++i)
+            det.Multiply(rows.GetRow(i)[i]);
+
+        return det.Get();
+    }
+
+    // The determinant in T itself; std::range_error when it does not fit.
     T GetIntDeterminant() const {
-        T mult = 1.0;
-        T coef = 1;
-        Matrix<T> matrix{*this};
+        std::optional<int64_t> det = GetCheckedIntDeterminant();
+        if (!det)
+            return details::exact::Determinant(data_, row_count_, column_count_).template To<T>();
+
+        if (!details::exact::FitsIn<T>(*det))
+            throw std::range_error("Determinant does not fit the element type");
+
+        return static_cast<T>(*det);
+    }
+
+    // Bareiss fraction-free elimination, first in the signed type of the
+    // elements' width and then in int64_t. Every intermediate value is a
+    // minor of the matrix, so the arithmetic is exact as long as no
+    // product or difference overflows; nullopt when one does in int64_t.
+    std::optional<int64_t> GetCheckedIntDeterminant() const {
+        using Narrow = std::make_signed_t<decltype(T{} + 0)>;
+
+        if constexpr (std::is_unsigned_v<T> && sizeof(T) >= sizeof(int64_t)) {
+            for (size_t i = 0; i < size_; ++i)
+                if (data_[i] > static_cast<T>(std::numeric_limits<int64_t>::max()))
+                    return std::nullopt;
+        }
+
+        // Triangular: the product of the diagonal, unless that overflows.
+        auto [lower, upper] = details::structure::Bandwidths(data_, row_count_, column_count_, size_t{0});
+        if (lower == 0 || upper == 0) {
+            int64_t det = 1;
+            for (size_t i = 0; i < row_count_; ++i)
+                if (__builtin_mul_overflow(det, static_cast<int64_t>(data_[i * column_count_ + i]), &det))
+                    return std::nullopt;
 
-        Matrix<T> tmp_matrix{1, row_count_};
-        ProxyRow<T> tmp_row = tmp_matrix[0];
+            return det;
+        }
+
+        if constexpr (std::is_signed_v<T> && sizeof(Narrow) < sizeof(int64_t)) {
+            if (std::optional<Narrow> det = GetBareissDeterminant<Narrow>())
+                return *det;
+        }
+
+        return GetBareissDeterminant<int64_t>();
+    }
+
+    template <typename U> std::optional<U> GetBareissDeterminant() const {
+        MATRIX_TIMED_SCOPE(Elimination);
+        U mult = 1;
+        U coef = 1;
+        Matrix<U> matrix = PaddedScratchCopy<U>();
+        PermutedRows<U> rows{matrix.data_, row_count_, column_count_, matrix.column_count_};
 
         for (size_t i = 0; i < row_count_ - 1; ++i) {
-            mult *= matrix.SwapIntRows(column_count_, i, row_count_);
+            mult *= SwapIntRows(rows, i);
             if (mult == 0)
                 return 0;
 
-            T val1 = matrix[i][i];
+            const U *pivot_row = rows.GetRow(i);
+            U val1 = pivot_row[i];
+            std::atomic<bool> is_overflow{false};
+
+            ForEachTrailingRow(i + 1, row_count_, column_count_ - i, [&](size_t begin, size_t end) {
+                for (size_t j = begin; j < end; ++j) {
+                    U *row = rows.GetRow(j);
+                    U val2 = row[i];
+                    row[i] = 0;
+
+                    for (size_t k = i + 1; k < column_count_; ++k) {
+                        U lhs, rhs;
+                        if (__builtin_mul_overflow(row[k], val1, &lhs) ||
+                            __builtin_mul_overflow(pivot_row[k], val2, &rhs) ||
+                            __builtin_sub_overflow(lhs, rhs, &lhs) ||
+                            (coef == -1 && lhs == std::numeric_limits<U>::min())) {
+                            is_overflow.store(true, std::memory_order_relaxed);
+                            return;
+                        }
+
+                        row[k] = lhs / coef;
+                    }
+                }
+            });
 
-            for (size_t j = i + 1; j < column_count_; ++j) {
-                T val2 = matrix[j][i];
-                matrix[j][i] = 0;
-
-                for (size_t k = i + 1; k < column_count_; ++k)
-                    matrix[j][k] =
-                        (matrix[j][k] * val1 - matrix[i][k] * val2) / coef;
-            }
+            if (is_overflow.load(std::memory_order_relaxed))
+                return std::nullopt;
 
             coef = val1;
         }
 
-        return mult * matrix[row_count_ - 1][column_count_ - 1];
+        U last = rows.GetRow(row_count_ - 1)[column_count_ - 1];
+        if (mult < 0 && last == std::numeric_limits<U>::min())
+            return std::nullopt;
+
+        return mult * last;
+    }
+
+    // Rows of one elimination step are independent, so large steps are
+    // split over the thread pool; small trailing blocks stay on this thread.
+    template <typename Body>
+    static void ForEachTrailingRow(size_t begin, size_t end, size_t row_length, Body &&body) {
+        constexpr size_t kParallelThreshold = 128 * 128;
+        constexpr size_t kGrainElements = 4096;
+
+        if ((end - begin) * row_length < kParallelThreshold) {
+            body(begin, end);
+            return;
+        }
+
+        size_t grain = std::max<size_t>(kGrainElements / std::max<size_t>(row_length, 1), 1);
+        details::GetThreadPool().ParallelFor(begin, end, grain, body);
     }
 
-    int SwapIntRows(size_t column_count, size_t from, size_t to) {
-        if ((*this)[from][from] != 0)
+    template <typename U> static int SwapIntRows(PermutedRows<U> &rows, size_t from) {
+        MATRIX_TIMED_SCOPE(Pivoting);
+        if (rows.GetRow(from)[from] != 0)
             return 1;
 
-        for (size_t i = from + 1; i < to; ++i) {
-            if ((*this)[i][from] != 0) {
-                Matrix<T> tmp_matrix{1, column_count};
-                tmp_matrix[0] = (*this)[from];
-                (*this)[from] = (*this)[i];
-                (*this)[i] = tmp_matrix[0];
+        for (size_t i = from + 1; i < rows.GetRowCount(); ++i) {
+            if (rows.GetRow(i)[from] != 0) {
+                rows.Swap(from, i);
                 return -1;
             }
         }
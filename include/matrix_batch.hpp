@@ -0,0 +1,439 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory_resource>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "allocator.hpp"
+#include "matrix.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
+
+// Many matrices of one shape, stored interleaved: element (i, j) of every
+// matrix sits in one contiguous plane, matrix index fastest. A vector
+// register then holds the same element of consecutive matrices, and the
+// batched kernels run the scalar algorithm once per register, every lane
+// working on its own matrix. Pivot choices differ between lanes, so row
+// swaps and singular pivots are handled with per-lane selects instead of
+// branches.
+
+namespace matrix {
+namespace details {
+namespace batch {
+    // Planes are padded to a cache line, a whole number of vectors of any
+    // width; the padding lanes hold zero matrices and are computed along.
+    template <typename T> size_t PlaneStride(size_t count) {
+        constexpr size_t kLine = kStorageAlignment / sizeof(T);
+        return (count + kLine - 1) / kLine * kLine;
+    }
+
+    // Below this many multiply-adds a call stays on the calling thread.
+    constexpr size_t kParallelWork = 1 << 16;
+
+    // Partial pivoting with division for floating point, Bareiss
+    // fraction-free elimination for integers, as in FixedMatrix. Lanes
+    // [lane_begin, lane_end) of the planes in data, a multiple of the
+    // vector width; work holds size * size vectors.
+    template <size_t Bytes, typename T>
+    MATRIX_SIMD_INLINE void DeterminantImpl(const T *data, size_t size, size_t stride, size_t lane_begin,
+                                            size_t lane_end, T *dets, T *work) {
+        using Vec = typename simd::VecType<T, Bytes>::type;
+        using Mask = decltype(Vec{} < Vec{});
+        using Index = std::remove_reference_t<decltype(Mask{}[0])>;
+        constexpr size_t kWidth = Bytes / sizeof(T);
+
+        // Element (i, j) of the working copy; vectors themselves are only
+        // ever touched in this function, which is compiled for the target.
+        auto at = [&](size_t i, size_t j) { return work + (i * size + j) * kWidth; };
+
+        for (size_t lane = lane_begin; lane < lane_end; lane += kWidth) {
+            for (size_t e = 0; e < size * size; ++e)
+                std::memcpy(work + e * kWidth, data + e * stride + lane, Bytes);
+
+            Vec det = Vec{} + T{1};
+            Vec coef = Vec{} + T{1};
+            Mask singular = Mask{};
+
+            for (size_t i = 0; i < size; ++i) {
+                // Row of the pivot in each lane: the largest magnitude for
+                // floating point, the first non-zero for integers.
+                Mask pivot = Mask{} + static_cast<Index>(i);
+                Vec best;
+                simd::Load(best, at(i, i));
+                if constexpr (std::is_floating_point_v<T>) {
+                    best = (best < 0) ? -best : best;
+                    for (size_t k = i + 1; k < size; ++k) {
+                        Vec value;
+                        simd::Load(value, at(k, i));
+                        value = (value < 0) ? -value : value;
+                        Mask is_larger = value > best;
+                        best = is_larger ? value : best;
+                        pivot = is_larger ? Mask{} + static_cast<Index>(k) : pivot;
+                    }
+                } else {
+                    Mask found = best != 0;
+                    for (size_t k = i + 1; k < size; ++k) {
+                        Vec value;
+                        simd::Load(value, at(k, i));
+                        Mask take = ~found & (value != 0);
+                        pivot = take ? Mask{} + static_cast<Index>(k) : pivot;
+                        found |= take;
+                    }
+                }
+
+                for (size_t k = i + 1; k < size; ++k) {
+                    Mask is_pivot = pivot == static_cast<Index>(k);
+                    for (size_t j = i; j < size; ++j) {
+                        Vec upper, lower;
+                        simd::Load(upper, at(i, j));
+                        simd::Load(lower, at(k, j));
+                        simd::Store(at(i, j), is_pivot ? lower : upper);
+                        simd::Store(at(k, j), is_pivot ? upper : lower);
+                    }
+                }
+
+                det = (pivot != static_cast<Index>(i)) ? -det : det;
+                Vec diagonal;
+                simd::Load(diagonal, at(i, i));
+                Mask is_zero = diagonal == 0;
+                singular |= is_zero;
+
+                if constexpr (std::is_floating_point_v<T>) {
+                    // A zero pivot leaves a zero determinant; dividing by
+                    // one instead keeps the rest of that lane finite.
+                    det *= diagonal;
+                    Vec inverse = T{1} / (is_zero ? Vec{} + T{1} : diagonal);
+                    for (size_t k = i + 1; k < size; ++k) {
+                        Vec factor;
+                        simd::Load(factor, at(k, i));
+                        factor *= inverse;
+                        for (size_t j = i + 1; j < size; ++j) {
+                            Vec upper, lower;
+                            simd::Load(upper, at(i, j));
+                            simd::Load(lower, at(k, j));
+                            simd::Store(at(k, j), lower - factor * upper);
+                        }
+                    }
+                } else if (i + 1 < size) {
+                    // Every division is exact; a lane that has gone
+                    // singular divides by one so it cannot trap.
+                    Vec divisor = (coef == 0) ? Vec{} + T{1} : coef;
+                    for (size_t k = i + 1; k < size; ++k) {
+                        Vec factor;
+                        simd::Load(factor, at(k, i));
+                        for (size_t j = i + 1; j < size; ++j) {
+                            Vec upper, lower;
+                            simd::Load(upper, at(i, j));
+                            simd::Load(lower, at(k, j));
+                            simd::Store(at(k, j), (lower * diagonal - upper * factor) / divisor);
+                        }
+                    }
+                    coef = diagonal;
+                } else {
+                    det *= diagonal;
+                }
+            }
+
+            det = singular ? Vec{} : det;
+            simd::Store(dets + lane, det);
+        }
+    }
+
+    // C = A * B for the lanes [lane_begin, lane_end).
+    template <size_t Bytes, typename T>
+    MATRIX_SIMD_INLINE void MultiplyImpl(const T *a, const T *b, T *c, size_t rows, size_t inner, size_t columns,
+                                         size_t stride, size_t lane_begin, size_t lane_end) {
+        using Vec = typename simd::VecType<T, Bytes>::type;
+        constexpr size_t kWidth = Bytes / sizeof(T);
+
+        for (size_t lane = lane_begin; lane < lane_end; lane += kWidth)
+            for (size_t i = 0; i < rows; ++i)
+                for (size_t j = 0; j < columns; ++j) {
+                    Vec acc = {};
+                    for (size_t k = 0; k < inner; ++k) {
+                        Vec lhs, rhs;
+                        simd::Load(lhs, a + (i * inner + k) * stride + lane);
+                        simd::Load(rhs, b + (k * columns + j) * stride + lane);
+                        acc += lhs * rhs;
+                    }
+                    simd::Store(c + (i * columns + j) * stride + lane, acc);
+                }
+    }
+
+#define MATRIX_BATCH_DEFINE_ISA(suffix, isa, bytes)                                                          \
+    template <typename T>                                                                                    \
+    MATRIX_SIMD_TARGET(isa) void Determinant##suffix(const T *data, size_t size, size_t stride,              \
+                                                     size_t lane_begin, size_t lane_end, T *dets, T *work) { \
+        DeterminantImpl<bytes>(data, size, stride, lane_begin, lane_end, dets, work);                        \
+    }                                                                                                        \
+    template <typename T>                                                                                    \
+    MATRIX_SIMD_TARGET(isa) void Multiply##suffix(const T *a, const T *b, T *c, size_t rows, size_t inner,   \
+                                                  size_t columns, size_t stride, size_t lane_begin,          \
+                                                  size_t lane_end) {                                         \
+        MultiplyImpl<bytes>(a, b, c, rows, inner, columns, stride, lane_begin, lane_end);                    \
+    }
+
+#if defined(MATRIX_SIMD_X86)
+    MATRIX_BATCH_DEFINE_ISA(Avx512, "avx512f", 64)
+    MATRIX_BATCH_DEFINE_ISA(Avx2, "avx2", 32)
+#endif
+
+#undef MATRIX_BATCH_DEFINE_ISA
+
+    // Without a wider instruction set the 16-byte kernels are compiled for
+    // the base target, which is SSE2 on x86-64.
+    template <typename T>
+    void Determinant(const T *data, size_t size, size_t stride, size_t lane_begin, size_t lane_end, T *dets) {
+        constexpr size_t kMaxWidth = 64 / sizeof(T);
+        AlignedBuffer<T> work(size * size * kMaxWidth, GetScratchResource());
+
+#if defined(MATRIX_SIMD_X86)
+        switch (simd::GetIsa()) {
+        case simd::Isa::Avx512:
+            return DeterminantAvx512(data, size, stride, lane_begin, lane_end, dets, work.data());
+        case simd::Isa::Avx2:
+            return DeterminantAvx2(data, size, stride, lane_begin, lane_end, dets, work.data());
+        case simd::Isa::Sse2:
+        case simd::Isa::Scalar:
+            break;
+        }
+#endif
+        DeterminantImpl<16>(data, size, stride, lane_begin, lane_end, dets, work.data());
+    }
+
+    template <typename T>
+    void Multiply(const T *a, const T *b, T *c, size_t rows, size_t inner, size_t columns, size_t stride,
+                  size_t lane_begin, size_t lane_end) {
+#if defined(MATRIX_SIMD_X86)
+        switch (simd::GetIsa()) {
+        case simd::Isa::Avx512:
+            return MultiplyAvx512(a, b, c, rows, inner, columns, stride, lane_begin, lane_end);
+        case simd::Isa::Avx2:
+            return MultiplyAvx2(a, b, c, rows, inner, columns, stride, lane_begin, lane_end);
+        case simd::Isa::Sse2:
+        case simd::Isa::Scalar:
+            break;
+        }
+#endif
+        MultiplyImpl<16>(a, b, c, rows, inner, columns, stride, lane_begin, lane_end);
+    }
+
+    // Runs body(lane_begin, lane_end) over cache-line blocks of lanes,
+    // split over the pool once the batch holds kParallelWork of work.
+    template <typename T, typename Body> void ForEachLaneRange(size_t stride, size_t work_per_lane, Body &&body) {
+        constexpr size_t kLine = kStorageAlignment / sizeof(T);
+        size_t block_count = stride / kLine;
+        size_t grain = std::max<size_t>(kParallelWork / std::max<size_t>(work_per_lane * kLine, 1), 1);
+
+        GetThreadPool().ParallelFor(0, block_count, grain, [&](size_t begin, size_t end) {
+            body(begin * kLine, end * kLine);
+        });
+    }
+
+    // Matrices among the first count whose Bareiss elimination may
+    // overflow T. Every intermediate is a minor times a minor, or the
+    // difference of two such products, and Hadamard's bound B, the product
+    // of the row norms, caps every minor; 2 B^2 within T rules overflow
+    // out. The bound is taken with a factor of two to spare for rounding.
+    template <typename T> std::vector<size_t> OverflowingLanes(const T *data, size_t size, size_t stride, size_t count) {
+        const double limit = std::sqrt(static_cast<double>(std::numeric_limits<T>::max()) / 4);
+        std::vector<double> bound(count, 1.0), row_norm(count);
+        for (size_t i = 0; i < size; ++i) {
+            std::fill(row_norm.begin(), row_norm.end(), 0.0);
+            for (size_t j = 0; j < size; ++j) {
+                const T *plane = data + (i * size + j) * stride;
+                for (size_t k = 0; k < count; ++k)
+                    row_norm[k] += static_cast<double>(plane[k]) * static_cast<double>(plane[k]);
+            }
+            for (size_t k = 0; k < count; ++k)
+                bound[k] *= std::max(std::sqrt(row_norm[k]), 1.0);
+        }
+
+        std::vector<size_t> lanes;
+        for (size_t k = 0; k < count; ++k)
+            if (!(bound[k] <= limit))
+                lanes.push_back(k);
+
+        return lanes;
+    }
+} // namespace batch
+} // namespace details
+
+template <typename T> class MatrixBatch {
+public:
+    static_assert(details::simd::kIsVectorizable<T>, "Batched kernels need a SIMD element type");
+
+    // count zero matrices of row_count x column_count.
+    MatrixBatch(size_t count, size_t row_count, size_t column_count,
+                std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : count_(count), row_count_(row_count), column_count_(column_count),
+          stride_(details::batch::PlaneStride<T>(count)), data_(row_count * column_count * stride_, resource) {
+        std::fill_n(data_.data(), data_.size(), T{});
+    }
+
+    MatrixBatch(const MatrixBatch &other) : MatrixBatch(other, std::pmr::get_default_resource()) {}
+
+    MatrixBatch(const MatrixBatch &other, std::pmr::memory_resource *resource)
+        : count_(other.count_), row_count_(other.row_count_), column_count_(other.column_count_),
+          stride_(other.stride_), data_(other.data_.size(), resource) {
+        std::copy_n(other.data_.data(), data_.size(), data_.data());
+    }
+
+    MatrixBatch &operator=(const MatrixBatch &other) {
+        if (this != &other)
+            *this = MatrixBatch(other);
+
+        return *this;
+    }
+
+    MatrixBatch(MatrixBatch &&other) noexcept = default;
+    MatrixBatch &operator=(MatrixBatch &&other) noexcept = default;
+
+    size_t GetCount() const { return count_; }
+    size_t GetRowCount() const { return row_count_; }
+    size_t GetColumnCount() const { return column_count_; }
+    std::pmr::memory_resource *GetResource() const { return data_.resource(); }
+
+    // Distance between the planes of two elements, a multiple of the vector
+    // width: element (i, j) of matrix k is GetData()[(i * columns + j) *
+    // stride + k].
+    size_t GetStride() const { return stride_; }
+
+    T *GetData() { return data_.data(); }
+    const T *GetData() const { return data_.data(); }
+
+    T &operator()(size_t index, size_t row, size_t column) { return data_.data()[Offset(index, row, column)]; }
+
+    const T &operator()(size_t index, size_t row, size_t column) const {
+        return data_.data()[Offset(index, row, column)];
+    }
+
+    void Set(size_t index, const Matrix<T> &matrix) {
+        if (matrix.GetRowCount() != row_count_ || matrix.GetColumnCount() != column_count_)
+            throw std::logic_error("Matrixs sizes do not match");
+
+        const T *values = matrix.GetData();
+        for (size_t e = 0; e < row_count_ * column_count_; ++e)
+            data_.data()[e * stride_ + Offset(index, 0, 0)] = values[e];
+    }
+
+    Matrix<T> ToMatrix(size_t index) const {
+        Matrix<T> matrix{row_count_, column_count_};
+        T *values = matrix.GetData();
+        for (size_t e = 0; e < row_count_ * column_count_; ++e)
+            values[e] = data_.data()[e * stride_ + Offset(index, 0, 0)];
+
+        return matrix;
+    }
+
+    // The determinant of every matrix, in order.
+    std::vector<T> Determinant() const {
+        if (row_count_ != column_count_)
+            throw std::logic_error(
+                "Matrix rows and columns counts is not equal");
+
+        if (row_count_ == 0)
+            throw std::logic_error("Matrix is empty");
+
+        size_t size = row_count_;
+        const T *data = data_.data();
+
+        // Integer lanes that could overflow the vector Bareiss are zeroed in
+        // a copy, so the kernel stays defined, and are redone one by one by
+        // Matrix<T>, which is exact and throws std::range_error only when
+        // the determinant itself does not fit.
+        std::vector<size_t> overflowing;
+        details::AlignedBuffer<T> guarded;
+        if constexpr (std::is_integral_v<T>) {
+            overflowing = details::batch::OverflowingLanes(data, size, stride_, count_);
+            if (!overflowing.empty()) {
+                guarded = details::AlignedBuffer<T>(data_.size(), GetScratchResource());
+                std::copy_n(data, data_.size(), guarded.data());
+                for (size_t e = 0; e < size * size; ++e)
+                    for (size_t index : overflowing)
+                        guarded.data()[e * stride_ + index] = T{};
+                data = guarded.data();
+            }
+        }
+
+        details::AlignedBuffer<T> dets(stride_, GetScratchResource());
+        details::batch::ForEachLaneRange<T>(stride_, size * size * size, [&](size_t begin, size_t end) {
+            details::batch::Determinant(data, size, stride_, begin, end, dets.data());
+        });
+
+        for (size_t index : overflowing)
+            dets.data()[index] = ToMatrix(index).GetDeterminant();
+
+        return std::vector<T>(dets.data(), dets.data() + count_);
+    }
+
+    // The products of the matrices of this batch with those of other, pair
+    // by pair.
+    MatrixBatch Multiply(const MatrixBatch &other) const {
+        if (count_ != other.count_)
+            throw std::logic_error("Batch sizes do not match");
+
+        if (column_count_ != other.row_count_)
+            throw std::logic_error("Matrixes sizes do not valid for multiply");
+
+        MatrixBatch result{count_, row_count_, other.column_count_, GetResource(), Uninitialized{}};
+        details::batch::ForEachLaneRange<T>(stride_, row_count_ * column_count_ * other.column_count_,
+                                            [&](size_t begin, size_t end) {
+            details::batch::Multiply(data_.data(), other.data_.data(), result.data_.data(), row_count_,
+                                     column_count_, other.column_count_, stride_, begin, end);
+        });
+
+        return result;
+    }
+
+    // Every matrix transposed: a permutation of whole planes.
+    MatrixBatch Transpose() const {
+        MatrixBatch result{count_, column_count_, row_count_, GetResource(), Uninitialized{}};
+        for (size_t i = 0; i < row_count_; ++i)
+            for (size_t j = 0; j < column_count_; ++j)
+                std::copy_n(data_.data() + (i * column_count_ + j) * stride_, stride_,
+                            result.data_.data() + (j * row_count_ + i) * stride_);
+
+        return result;
+    }
+
+    void print() const {
+        for (size_t k = 0; k < count_; ++k)
+            ToMatrix(k).print();
+    }
+private:
+    struct Uninitialized {};
+
+    MatrixBatch(size_t count, size_t row_count, size_t column_count, std::pmr::memory_resource *resource,
+                Uninitialized)
+        : count_(count), row_count_(row_count), column_count_(column_count),
+          stride_(details::batch::PlaneStride<T>(count)), data_(row_count * column_count * stride_, resource) {}
+
+    size_t Offset(size_t index, size_t row, size_t column) const {
+        if (index >= count_)
+            throw std::range_error("Matrix index is more count of exist matrices");
+
+        if (row >= row_count_)
+            throw std::range_error("Row index is more count of exist rows");
+
+        if (column >= column_count_)
+            throw std::range_error("Column index is more count of exist columns");
+
+        return (row * column_count_ + column) * stride_ + index;
+    }
+
+    size_t count_ = 0;
+    size_t row_count_ = 0;
+    size_t column_count_ = 0;
+    size_t stride_ = 0;
+    details::AlignedBuffer<T> data_;
+}; // class MatrixBatch
+} // namespace matrix
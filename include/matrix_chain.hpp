@@ -0,0 +1,233 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "allocator.hpp"
+#include "gemm.hpp"
+#include "matrix.hpp"
+#include "strassen.hpp"
+#include "thread_pool.hpp"
+
+// Products of several matrices in the cheapest order. The order depends
+// only on the shapes: with A_i of d_i x d_(i+1), the classical dynamic
+// program over every split of every sub-chain finds the parenthesization
+// with the fewest multiply-adds in O(k^3) for k matrices. Left to right
+// can be arbitrarily worse; for a column vector at the end of the chain
+// it multiplies n x n matrices where right to left multiplies vectors.
+// Intermediate products live in buffers recycled between the steps of the
+// evaluation, and the two halves of a split run side by side when both
+// are products too small for the GEMM to spread over the pool by itself.
+
+namespace matrix {
+class ChainPlan {
+public:
+    // dimensions[i] x dimensions[i + 1] is the shape of the i-th matrix.
+    explicit ChainPlan(std::vector<size_t> dimensions) : dimensions_(std::move(dimensions)) {
+        if (dimensions_.size() < 2)
+            throw std::logic_error("Matrix chain is empty");
+
+        size_t count = GetCount();
+        cost_.assign(count * count, 0);
+        split_.assign(count * count, 0);
+
+        for (size_t length = 2; length <= count; ++length)
+            for (size_t first = 0; first + length <= count; ++first) {
+                size_t last = first + length - 1;
+                size_t best = std::numeric_limits<size_t>::max();
+
+                for (size_t split = first; split < last; ++split) {
+                    size_t cost = cost_[first * count + split] + cost_[(split + 1) * count + last] +
+                                  dimensions_[first] * dimensions_[split + 1] * dimensions_[last + 1];
+                    if (cost < best) {
+                        best = cost;
+                        split_[first * count + last] = split;
+                    }
+                }
+
+                cost_[first * count + last] = best;
+            }
+    }
+
+    size_t GetCount() const { return dimensions_.size() - 1; }
+
+    const std::vector<size_t> &GetDimensions() const { return dimensions_; }
+
+    // Multiply-adds of the product of matrices first .. last in the
+    // planned order.
+    size_t GetCost(size_t first, size_t last) const { return cost_[first * GetCount() + last]; }
+    size_t GetCost() const { return GetCost(0, GetCount() - 1); }
+
+    // The last product of matrices first .. last multiplies first .. split
+    // by split + 1 .. last.
+    size_t GetSplit(size_t first, size_t last) const { return split_[first * GetCount() + last]; }
+
+    // The order as text, such as "(A0 (A1 A2))".
+    std::string ToString() const { return ToString(0, GetCount() - 1); }
+private:
+    std::string ToString(size_t first, size_t last) const {
+        if (first == last)
+            return "A" + std::to_string(first);
+
+        size_t split = GetSplit(first, last);
+        return "(" + ToString(first, split) + " " + ToString(split + 1, last) + ")";
+    }
+
+    std::vector<size_t> dimensions_;
+    std::vector<size_t> cost_;
+    std::vector<size_t> split_;
+}; // class ChainPlan
+
+namespace details {
+namespace chain {
+    // Freed intermediate buffers, handed out again to the next request
+    // they are large enough for. Shared by both halves of a parallel
+    // split, hence the lock, and by threads, hence the default resource
+    // rather than the thread-local scratch pool.
+    template <typename T> class BufferPool {
+    public:
+        AlignedBuffer<T> Acquire(size_t size) {
+            std::lock_guard lock(mutex_);
+            auto best = free_.end();
+            for (auto it = free_.begin(); it != free_.end(); ++it)
+                if (it->size() >= size && (best == free_.end() || it->size() < best->size()))
+                    best = it;
+
+            if (best == free_.end())
+                return AlignedBuffer<T>(size);
+
+            AlignedBuffer<T> buffer = std::move(*best);
+            free_.erase(best);
+            return buffer;
+        }
+
+        void Release(AlignedBuffer<T> &&buffer) {
+            std::lock_guard lock(mutex_);
+            free_.push_back(std::move(buffer));
+        }
+    private:
+        std::mutex mutex_;
+        std::vector<AlignedBuffer<T>> free_;
+    }; // class BufferPool
+
+    // A factor of a product: an operand or an intermediate, which owns its
+    // buffer until the product that consumes it is done.
+    template <typename T> struct Factor {
+        const T *data = nullptr;
+        size_t row_stride = 0;
+        size_t column_stride = 1;
+        AlignedBuffer<T> storage;
+    }; // struct Factor
+
+    template <typename T> class Evaluator {
+    public:
+        Evaluator(const ChainPlan &plan, const std::vector<ConstMatrixView<T>> &operands)
+            : plan_(plan), operands_(operands) {}
+
+        // The product of matrices first .. last into out, rows out_stride
+        // apart.
+        void EvaluateInto(size_t first, size_t last, T *out, size_t out_stride) {
+            size_t split = plan_.GetSplit(first, last);
+            Factor<T> lhs;
+            Factor<T> rhs;
+
+            if (IsParallel(first, split, last)) {
+                GetThreadPool().ParallelFor(0, 2, 1, [&](size_t begin, size_t end) {
+                    for (size_t side = begin; side < end; ++side)
+                        (side == 0) ? Evaluate(first, split, lhs) : Evaluate(split + 1, last, rhs);
+                });
+            } else {
+                Evaluate(first, split, lhs);
+                Evaluate(split + 1, last, rhs);
+            }
+
+            const std::vector<size_t> &dims = plan_.GetDimensions();
+            details::Multiply(dims[first], dims[last + 1], dims[split + 1], T{1}, lhs.data, lhs.row_stride,
+                              lhs.column_stride, rhs.data, rhs.row_stride, rhs.column_stride, false, out,
+                              out_stride, size_t{1});
+
+            if (lhs.storage.data() != nullptr)
+                buffers_.Release(std::move(lhs.storage));
+            if (rhs.storage.data() != nullptr)
+                buffers_.Release(std::move(rhs.storage));
+        }
+    private:
+        void Evaluate(size_t first, size_t last, Factor<T> &factor) {
+            if (first == last) {
+                const ConstMatrixView<T> &view = operands_[first];
+                factor.data = view.GetData();
+                factor.row_stride = view.GetRowStride();
+                factor.column_stride = view.GetColumnStride();
+                return;
+            }
+
+            const std::vector<size_t> &dims = plan_.GetDimensions();
+            size_t columns = dims[last + 1];
+            AlignedBuffer<T> storage = buffers_.Acquire(dims[first] * columns);
+            EvaluateInto(first, last, storage.data(), columns);
+
+            factor.data = storage.data();
+            factor.row_stride = columns;
+            factor.storage = std::move(storage);
+        }
+
+        // Both halves are products, each with too little work for the GEMM
+        // to give every thread kParallelThreshold multiply-adds.
+        bool IsParallel(size_t first, size_t split, size_t last) const {
+            size_t thread_count = GetThreadPool().GetThreadCount();
+            size_t limit = gemm::kParallelThreshold * thread_count;
+            return thread_count > 1 && first != split && split + 1 != last && plan_.GetCost(first, split) < limit &&
+                   plan_.GetCost(split + 1, last) < limit;
+        }
+
+        const ChainPlan &plan_;
+        const std::vector<ConstMatrixView<T>> &operands_;
+        BufferPool<T> buffers_;
+    }; // class Evaluator
+} // namespace chain
+} // namespace details
+
+// The order ChainPlan would choose for these operands.
+template <typename T> ChainPlan PlanChain(const std::vector<ConstMatrixView<T>> &operands) {
+    if (operands.empty())
+        throw std::logic_error("Matrix chain is empty");
+
+    std::vector<size_t> dimensions{operands.front().GetRowCount()};
+    for (const ConstMatrixView<T> &operand : operands) {
+        if (operand.GetRowCount() != dimensions.back())
+            throw std::logic_error("Matrixes sizes do not valid for multiply");
+
+        dimensions.push_back(operand.GetColumnCount());
+    }
+
+    return ChainPlan(std::move(dimensions));
+}
+
+// operands[0] * operands[1] * ... in the order with the fewest
+// multiply-adds.
+template <typename T> Matrix<T> MultiplyChain(const std::vector<ConstMatrixView<T>> &operands) {
+    static_assert(std::is_arithmetic_v<T>, "MultiplyChain needs an arithmetic element type");
+
+    ChainPlan plan = PlanChain(operands);
+    size_t row_count = plan.GetDimensions().front();
+    size_t column_count = plan.GetDimensions().back();
+    if (plan.GetCount() == 1)
+        return Matrix<T>(operands.front());
+
+    Matrix<T> result(row_count, column_count);
+    details::chain::Evaluator<T>(plan, operands).EvaluateInto(0, plan.GetCount() - 1, result.GetData(),
+                                                              column_count);
+    return result;
+}
+
+template <typename T, typename... Rest> requires (std::is_same_v<Rest, Matrix<T>> && ...)
+Matrix<T> MultiplyChain(const Matrix<T> &first, const Rest &...rest) {
+    return MultiplyChain(std::vector<ConstMatrixView<T>>{first.View(), rest.View()...});
+}
+} // namespace matrix
@@ -0,0 +1,468 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "allocator.hpp"
+#include "gemm.hpp"
+#include "instrumentation.hpp"
+#include "simd.hpp"
+#include "strassen.hpp"
+
+// Lazy arithmetic on matrices. Operators build small expression objects
+// that keep references to the matrix operands, or own them when they are
+// temporaries; the work happens when an expression is assigned to or used
+// to construct a Matrix, in one loop over the result with no intermediate
+// matrices. Included by matrix.hpp.
+
+namespace matrix {
+template <typename T> class Matrix;
+
+namespace details {
+    struct MatrixExprTag {};
+
+    template <typename E> concept IsMatrixExpr = std::is_base_of_v<MatrixExprTag, E>;
+
+    template <typename M> struct IsMatrixType : std::false_type {};
+    template <typename T> struct IsMatrixType<Matrix<T>> : std::true_type {};
+
+    template <typename X> concept IsMatrixOperand = IsMatrixExpr<X> || IsMatrixType<X>::value;
+
+    // Operands whose element (i, j) sits at GetData() + i * GetRowStride() +
+    // j * GetColumnStride(); the GEMM reads them in place.
+    template <typename E> concept IsStridedExpr = requires(const E &expr) {
+        expr.GetData();
+        expr.GetRowStride();
+        expr.GetColumnStride();
+    };
+
+    // One past the last element of a row_count x column_count block.
+    template <typename T>
+    T *StridedEnd(T *data, size_t row_count, size_t column_count, size_t row_stride, size_t column_stride) {
+        if (row_count == 0 || column_count == 0)
+            return data;
+
+        return data + (row_count - 1) * row_stride + (column_count - 1) * column_stride + 1;
+    }
+
+    // Strided memory an expression is written to. Nodes answer two alias
+    // questions about it: Aliases, whether they read any of it at all (a
+    // GEMM must not), and Conflicts, whether an element-wise loop over it
+    // could read an element it already overwrote. A leaf with exactly the
+    // destination's layout only ever reads the element being written.
+    template <typename T> struct StridedTarget {
+        T *data = nullptr;
+        size_t row_count = 0;
+        size_t column_count = 0;
+        size_t row_stride = 0;
+        size_t column_stride = 1;
+
+        const T *End() const { return StridedEnd(data, row_count, column_count, row_stride, column_stride); }
+
+        bool Overlaps(const T *begin, const T *end) const {
+            std::less<const T *> less;
+            return less(begin, End()) && less(data, end);
+        }
+
+        bool Conflicts(const T *leaf_data, size_t leaf_row_stride, size_t leaf_column_stride,
+                       const T *leaf_end) const {
+            if (leaf_data == data && (row_count <= 1 || leaf_row_stride == row_stride) &&
+                (column_count <= 1 || leaf_column_stride == column_stride))
+                return false;
+
+            return Overlaps(leaf_data, leaf_end);
+        }
+    }; // struct StridedTarget
+
+    // Common base of the expression nodes: shape queries and row access, so
+    // an unevaluated expression can be read like a Matrix.
+    template <typename Derived> class MatrixExpr : public MatrixExprTag {
+    public:
+        class Row {
+        public:
+            Row(const Derived &expr, size_t num_row) : expr_(expr), num_row_(num_row) {}
+
+            decltype(auto) operator[](size_t num_elem) const { return expr_.Eval(num_row_, num_elem); }
+        private:
+            const Derived &expr_;
+            size_t num_row_ = 0;
+        }; // class Row
+
+        Row operator[](size_t num_row) const {
+            if (num_row >= Self().GetRowCount())
+                throw std::range_error("Row index is more count of exist rows");
+
+            return Row(Self(), num_row);
+        }
+
+    private:
+        const Derived &Self() const { return static_cast<const Derived &>(*this); }
+    }; // class MatrixExpr
+
+    template <typename T> class MatrixLeaf : public MatrixExpr<MatrixLeaf<T>> {
+    public:
+        using value_type = T;
+
+        explicit MatrixLeaf(const Matrix<T> &matrix) : matrix_(&matrix) {}
+
+        // A temporary operand moves into the leaf, so an expression kept in
+        // a variable does not outlive it; copies of the node share it.
+        explicit MatrixLeaf(Matrix<T> &&matrix)
+            : owned_(std::make_shared<const Matrix<T>>(std::move(matrix))), matrix_(owned_.get()) {}
+
+        size_t GetRowCount() const { return matrix_->GetRowCount(); }
+        size_t GetColumnCount() const { return matrix_->GetColumnCount(); }
+
+        const T &Eval(size_t row, size_t col) const { return GetData()[row * GetRowStride() + col]; }
+
+        const T *GetData() const { return matrix_->GetData(); }
+        size_t GetRowStride() const { return matrix_->GetColumnCount(); }
+        size_t GetColumnStride() const { return 1; }
+
+        bool Aliases(const StridedTarget<T> &dst) const {
+            return dst.Overlaps(GetData(), GetData() + GetRowCount() * GetColumnCount());
+        }
+
+        bool Conflicts(const StridedTarget<T> &dst) const {
+            return dst.Conflicts(GetData(), GetRowStride(), 1, GetData() + GetRowCount() * GetColumnCount());
+        }
+
+        const Matrix<T> &GetMatrix() const { return *matrix_; }
+    private:
+        std::shared_ptr<const Matrix<T>> owned_;
+        const Matrix<T> *matrix_ = nullptr;
+    }; // class MatrixLeaf
+
+    template <typename T> MatrixLeaf<T> AsExpr(const Matrix<T> &matrix) { return MatrixLeaf<T>(matrix); }
+
+    template <typename T> MatrixLeaf<T> AsExpr(Matrix<T> &&matrix) { return MatrixLeaf<T>(std::move(matrix)); }
+
+    template <IsMatrixExpr E> const E &AsExpr(const E &expr) { return expr; }
+
+    template <typename X> using ExprOf = std::decay_t<decltype(AsExpr(std::declval<const X &>()))>;
+
+    // Operand of a non element-wise node as strided memory: matrices and
+    // views are read in place, anything else is evaluated into a copy.
+    template <typename E, bool = IsStridedExpr<E>> class Materialized {
+        using T = typename E::value_type;
+    public:
+        explicit Materialized(const E &expr)
+            : data_(expr.GetData()), row_stride_(expr.GetRowStride()), column_stride_(expr.GetColumnStride()) {}
+
+        const T *GetData() const { return data_; }
+        size_t GetRowStride() const { return row_stride_; }
+        size_t GetColumnStride() const { return column_stride_; }
+    private:
+        const T *data_;
+        size_t row_stride_;
+        size_t column_stride_;
+    }; // class Materialized
+
+    template <typename E> class Materialized<E, false> {
+        using T = typename E::value_type;
+    public:
+        explicit Materialized(const E &expr) : owned_(expr, GetScratchResource()) {}
+
+        const T *GetData() const { return owned_.GetData(); }
+        size_t GetRowStride() const { return owned_.GetColumnCount(); }
+        size_t GetColumnStride() const { return 1; }
+    private:
+        Matrix<T> owned_;
+    }; // class Materialized
+
+    struct PlusOp {
+        template <typename A, typename B> static auto Apply(const A &lhs, const B &rhs) { return lhs + rhs; }
+    };
+
+    struct MinusOp {
+        template <typename A, typename B> static auto Apply(const A &lhs, const B &rhs) { return lhs - rhs; }
+    };
+
+    template <typename L, typename R, typename Op>
+    class BinaryExpr : public MatrixExpr<BinaryExpr<L, R, Op>> {
+    public:
+        using value_type = typename L::value_type;
+
+        BinaryExpr(L lhs, R rhs) : lhs_(std::move(lhs)), rhs_(std::move(rhs)) {
+            if (lhs_.GetRowCount() != rhs_.GetRowCount() ||
+                lhs_.GetColumnCount() != rhs_.GetColumnCount())
+                throw std::logic_error("Matrixs sizes do not match");
+        }
+
+        size_t GetRowCount() const { return lhs_.GetRowCount(); }
+        size_t GetColumnCount() const { return lhs_.GetColumnCount(); }
+
+        auto Eval(size_t row, size_t col) const { return Op::Apply(lhs_.Eval(row, col), rhs_.Eval(row, col)); }
+
+        bool Aliases(const StridedTarget<value_type> &dst) const { return lhs_.Aliases(dst) || rhs_.Aliases(dst); }
+
+        bool Conflicts(const StridedTarget<value_type> &dst) const {
+            return lhs_.Conflicts(dst) || rhs_.Conflicts(dst);
+        }
+    private:
+        L lhs_;
+        R rhs_;
+    }; // class BinaryExpr
+
+    template <typename E> class ScaleExpr : public MatrixExpr<ScaleExpr<E>> {
+    public:
+        using value_type = typename E::value_type;
+
+        ScaleExpr(E expr, const value_type &scalar) : expr_(std::move(expr)), scalar_(scalar) {}
+
+        size_t GetRowCount() const { return expr_.GetRowCount(); }
+        size_t GetColumnCount() const { return expr_.GetColumnCount(); }
+
+        auto Eval(size_t row, size_t col) const { return expr_.Eval(row, col) * scalar_; }
+
+        bool Aliases(const StridedTarget<value_type> &dst) const { return expr_.Aliases(dst); }
+
+        bool Conflicts(const StridedTarget<value_type> &dst) const { return expr_.Conflicts(dst); }
+    private:
+        E expr_;
+        value_type scalar_;
+    }; // class ScaleExpr
+
+    // Matrix product. Assigned directly, it runs one GEMM into the
+    // destination; read element by element (inside a larger expression or
+    // through operator[]) it is evaluated once into a cached matrix.
+    template <typename L, typename R> class ProductExpr : public MatrixExpr<ProductExpr<L, R>> {
+    public:
+        using value_type = typename L::value_type;
+
+        ProductExpr(L lhs, R rhs) : lhs_(std::move(lhs)), rhs_(std::move(rhs)) {
+            if (lhs_.GetColumnCount() != rhs_.GetRowCount())
+                throw std::logic_error("Matrixes sizes do not valid for multiply");
+        }
+
+        size_t GetRowCount() const { return lhs_.GetRowCount(); }
+        size_t GetColumnCount() const { return rhs_.GetColumnCount(); }
+
+        const value_type &Eval(size_t row, size_t col) const {
+            return Cache().GetData()[row * GetColumnCount() + col];
+        }
+
+        bool Aliases(const StridedTarget<value_type> &dst) const { return lhs_.Aliases(dst) || rhs_.Aliases(dst); }
+
+        // Read through the cache, which is filled before the first write.
+        bool Conflicts(const StridedTarget<value_type> &) const { return false; }
+
+        // dst = alpha * L * R, or dst += alpha * L * R, with element (i, j)
+        // at dst[i * rs_dst + j * cs_dst]; dst must not alias an operand.
+        void MultiplyInto(value_type *dst, size_t rs_dst, size_t cs_dst,
+                          bool accumulate, value_type alpha) const {
+            MATRIX_TIMED_SCOPE(Multiply);
+            Materialized<L> lhs{lhs_};
+            Materialized<R> rhs{rhs_};
+
+            Multiply(GetRowCount(), GetColumnCount(), lhs_.GetColumnCount(), alpha,
+                     lhs.GetData(), lhs.GetRowStride(), lhs.GetColumnStride(),
+                     rhs.GetData(), rhs.GetRowStride(), rhs.GetColumnStride(),
+                     accumulate, dst, rs_dst, cs_dst);
+        }
+
+        void AssignTo(value_type *dst, size_t rs_dst, size_t cs_dst) const {
+            MultiplyInto(dst, rs_dst, cs_dst, false, value_type{1});
+        }
+
+        const L &GetLhs() const { return lhs_; }
+        const R &GetRhs() const { return rhs_; }
+    private:
+        const Matrix<value_type> &Cache() const {
+            if (!cache_) {
+                if constexpr (std::is_arithmetic_v<value_type>) {
+                    cache_ = std::make_shared<Matrix<value_type>>(*this);
+                } else {
+                    auto product = std::make_shared<Matrix<value_type>>(lhs_);
+                    *product *= Matrix<value_type>(rhs_);
+                    cache_ = std::move(product);
+                }
+            }
+
+            return *cache_;
+        }
+
+        L lhs_;
+        R rhs_;
+        mutable std::shared_ptr<const Matrix<value_type>> cache_;
+    }; // class ProductExpr
+
+    template <typename E> struct IsProductExprType : std::false_type {};
+    template <typename L, typename R> struct IsProductExprType<ProductExpr<L, R>> : std::true_type {};
+
+    template <typename E> concept IsProductExpr = IsProductExprType<E>::value;
+
+    // E + L * R or E - L * R: the addend is written into the destination in
+    // one pass and the product is accumulated on top of it by the GEMM.
+    template <typename P, typename E> class GemmAccumulateExpr : public MatrixExpr<GemmAccumulateExpr<P, E>> {
+    public:
+        using value_type = typename P::value_type;
+
+        GemmAccumulateExpr(P product, E addend, bool subtract)
+            : product_(std::move(product)), addend_(std::move(addend)), subtract_(subtract) {
+            if (product_.GetRowCount() != addend_.GetRowCount() ||
+                product_.GetColumnCount() != addend_.GetColumnCount())
+                throw std::logic_error("Matrixs sizes do not match");
+        }
+
+        size_t GetRowCount() const { return addend_.GetRowCount(); }
+        size_t GetColumnCount() const { return addend_.GetColumnCount(); }
+
+        auto Eval(size_t row, size_t col) const {
+            return subtract_ ? MinusOp::Apply(addend_.Eval(row, col), product_.Eval(row, col))
+                             : PlusOp::Apply(addend_.Eval(row, col), product_.Eval(row, col));
+        }
+
+        bool Aliases(const StridedTarget<value_type> &dst) const {
+            return product_.Aliases(dst) || addend_.Aliases(dst);
+        }
+
+        bool Conflicts(const StridedTarget<value_type> &dst) const { return addend_.Conflicts(dst); }
+
+        void AssignTo(value_type *dst, size_t rs_dst, size_t cs_dst) const {
+            for (size_t i = 0; i < GetRowCount(); ++i)
+                for (size_t j = 0; j < GetColumnCount(); ++j)
+                    dst[i * rs_dst + j * cs_dst] = addend_.Eval(i, j);
+
+            product_.MultiplyInto(dst, rs_dst, cs_dst, true, static_cast<value_type>(subtract_ ? -1 : 1));
+        }
+    private:
+        P product_;
+        E addend_;
+        bool subtract_ = false;
+    }; // class GemmAccumulateExpr
+
+    // Nodes that write the whole result at once instead of per element.
+    template <typename E>
+    concept HasDirectEval = requires(const E &expr, typename E::value_type *dst) { expr.AssignTo(dst, 0, 1); };
+
+    // dst = expr for a destination that already holds constructed elements
+    // of the right shape. Returns false, without writing anything, when
+    // expr reads dst in a way that needs a copy first.
+    template <typename T, typename Expr>
+    bool AssignExpr(const StridedTarget<T> &dst, const Expr &expr) {
+        T *data = dst.data;
+
+        if constexpr (std::is_arithmetic_v<T> && HasDirectEval<Expr>) {
+            if (expr.Aliases(dst))
+                return false;
+
+            expr.AssignTo(data, dst.row_stride, dst.column_stride);
+        } else {
+            if (expr.Conflicts(dst))
+                return false;
+
+            for (size_t i = 0; i < dst.row_count; ++i)
+                for (size_t j = 0; j < dst.column_count; ++j)
+                    data[i * dst.row_stride + j * dst.column_stride] = expr.Eval(i, j);
+        }
+
+        return true;
+    }
+
+    // dst += expr or dst -= expr. A product that does not read dst is
+    // accumulated by the GEMM, anything else element by element.
+    template <typename T, typename Expr>
+    void AccumulateExpr(const StridedTarget<T> &dst, const Expr &expr, bool subtract) {
+        T *data = dst.data;
+
+        if constexpr (std::is_arithmetic_v<T> && IsProductExpr<Expr>) {
+            if (!expr.Aliases(dst)) {
+                expr.MultiplyInto(data, dst.row_stride, dst.column_stride, true, static_cast<T>(subtract ? -1 : 1));
+                return;
+            }
+        }
+
+        // A product reading dst is evaluated once into scratch rather than
+        // into the cache of the expression.
+        if ((std::is_arithmetic_v<T> && IsProductExpr<Expr>) || expr.Conflicts(dst)) {
+            Matrix<T> copy{expr, GetScratchResource()};
+            AccumulateExpr(dst, MatrixLeaf<T>(copy), subtract);
+            return;
+        }
+
+        if constexpr (IsStridedExpr<Expr>) {
+            if (dst.column_stride == 1 && expr.GetColumnStride() == 1) {
+                for (size_t i = 0; i < dst.row_count; ++i) {
+                    T *row = data + i * dst.row_stride;
+                    const T *src = expr.GetData() + i * expr.GetRowStride();
+
+                    if (subtract)
+                        simd::Sub(row, src, dst.column_count);
+                    else
+                        simd::Add(row, src, dst.column_count);
+                }
+                return;
+            }
+        }
+
+        for (size_t i = 0; i < dst.row_count; ++i)
+            for (size_t j = 0; j < dst.column_count; ++j) {
+                T &elem = data[i * dst.row_stride + j * dst.column_stride];
+                if (subtract)
+                    elem -= expr.Eval(i, j);
+                else
+                    elem += expr.Eval(i, j);
+            }
+    }
+
+    template <typename L, typename R>
+    concept IsSameValueOperands = IsMatrixOperand<std::remove_cvref_t<L>> && IsMatrixOperand<std::remove_cvref_t<R>> &&
+        std::is_same_v<typename std::remove_cvref_t<L>::value_type, typename std::remove_cvref_t<R>::value_type>;
+
+    template <typename X> using ValueOf = typename std::remove_cvref_t<X>::value_type;
+
+    // The operators take forwarding references so that a Matrix rvalue
+    // becomes an owning leaf instead of a dangling reference.
+    template <typename L, typename R> requires IsSameValueOperands<L, R>
+    auto operator+(L &&lhs, R &&rhs) {
+        using LE = std::remove_cvref_t<L>;
+        using RE = std::remove_cvref_t<R>;
+        if constexpr (std::is_arithmetic_v<ValueOf<L>> && IsProductExpr<LE>)
+            return GemmAccumulateExpr<LE, ExprOf<RE>>(std::forward<L>(lhs), AsExpr(std::forward<R>(rhs)), false);
+        else if constexpr (std::is_arithmetic_v<ValueOf<L>> && IsProductExpr<RE>)
+            return GemmAccumulateExpr<RE, ExprOf<LE>>(std::forward<R>(rhs), AsExpr(std::forward<L>(lhs)), false);
+        else
+            return BinaryExpr<ExprOf<LE>, ExprOf<RE>, PlusOp>(AsExpr(std::forward<L>(lhs)),
+                                                              AsExpr(std::forward<R>(rhs)));
+    }
+
+    template <typename L, typename R> requires IsSameValueOperands<L, R>
+    auto operator-(L &&lhs, R &&rhs) {
+        using LE = std::remove_cvref_t<L>;
+        using RE = std::remove_cvref_t<R>;
+        if constexpr (std::is_arithmetic_v<ValueOf<L>> && IsProductExpr<RE> && !IsProductExpr<LE>)
+            return GemmAccumulateExpr<RE, ExprOf<LE>>(std::forward<R>(rhs), AsExpr(std::forward<L>(lhs)), true);
+        else
+            return BinaryExpr<ExprOf<LE>, ExprOf<RE>, MinusOp>(AsExpr(std::forward<L>(lhs)),
+                                                               AsExpr(std::forward<R>(rhs)));
+    }
+
+    template <typename L, typename R> requires IsSameValueOperands<L, R>
+    auto operator*(L &&lhs, R &&rhs) {
+        using LE = std::remove_cvref_t<L>;
+        using RE = std::remove_cvref_t<R>;
+        return ProductExpr<ExprOf<LE>, ExprOf<RE>>(AsExpr(std::forward<L>(lhs)), AsExpr(std::forward<R>(rhs)));
+    }
+
+    template <typename L> requires IsMatrixOperand<std::remove_cvref_t<L>>
+    auto operator*(L &&lhs, const ValueOf<L> &rhs) {
+        return ScaleExpr<ExprOf<std::remove_cvref_t<L>>>(AsExpr(std::forward<L>(lhs)), rhs);
+    }
+
+    template <typename R> requires IsMatrixOperand<std::remove_cvref_t<R>>
+    auto operator*(const ValueOf<R> &lhs, R &&rhs) {
+        return ScaleExpr<ExprOf<std::remove_cvref_t<R>>>(AsExpr(std::forward<R>(rhs)), lhs);
+    }
+} // namespace details
+
+// Found by argument-dependent lookup for Matrix operands as well as for
+// the expression nodes declared in details.
+using details::operator+;
+using details::operator-;
+using details::operator*;
+} // namespace matrix
@@ -0,0 +1,383 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "matrix.hpp"
+
+// Binary matrix files: a 64-byte FileHeader followed, at payload_offset, by
+// row_count rows of row_stride elements each, row-major, in the byte order
+// of the machine that wrote them. Only the first column_count elements of
+// a row are data; the rest is zero padding. MappedMatrix maps a file and
+// exposes the payload as a view with no parse and no copy, so a read-only
+// mapping is shared through the page cache by every process that maps it.
+
+namespace matrix {
+enum class DType : uint8_t {
+    Int8 = 1, Int16, Int32, Int64,
+    UInt8, UInt16, UInt32, UInt64,
+    Float32, Float64
+};
+
+enum class MapMode {
+    ReadOnly,  // pages shared with other readers, writes are not allowed
+    ReadWrite  // writes through the view go to the file
+};
+
+constexpr uint16_t kFileVersion = 1;
+
+struct FileHeader {
+    char magic[4];           // "MTRX"
+    uint16_t version;        // kFileVersion
+    uint16_t byte_order;     // kByteOrderMark as stored by the writer
+    DType dtype;
+    uint8_t element_size;    // bytes
+    uint16_t reserved0;
+    uint32_t alignment;      // of the payload in the file, bytes
+    uint64_t row_count;
+    uint64_t column_count;
+    uint64_t row_stride;     // elements
+    uint64_t payload_offset; // bytes from the start of the file
+    uint8_t reserved[16];
+}; // struct FileHeader
+
+static_assert(sizeof(FileHeader) == 64 && std::is_trivially_copyable_v<FileHeader>);
+
+namespace details {
+namespace file {
+    constexpr char kMagic[4] = {'M', 'T', 'R', 'X'};
+    constexpr uint16_t kByteOrderMark = 0x0102;
+    constexpr uint16_t kSwappedByteOrderMark = 0x0201;
+
+    template <typename T> constexpr DType DTypeOf() {
+        static_assert(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>, "Element type has no file dtype");
+
+        if constexpr (std::is_floating_point_v<T>) {
+            static_assert(sizeof(T) == 4 || sizeof(T) == 8, "Floating point type has no file dtype");
+            return (sizeof(T) == 4) ? DType::Float32 : DType::Float64;
+        } else {
+            constexpr DType kSigned[] = {DType::Int8, DType::Int16, DType::Int32, DType::Int64};
+            constexpr DType kUnsigned[] = {DType::UInt8, DType::UInt16, DType::UInt32, DType::UInt64};
+            constexpr size_t index = std::countr_zero(sizeof(T));
+            return std::is_signed_v<T> ? kSigned[index] : kUnsigned[index];
+        }
+    }
+
+    template <typename T> T ByteSwap(T value) {
+        using Bits = std::conditional_t<sizeof(T) == 1, uint8_t,
+                     std::conditional_t<sizeof(T) == 2, uint16_t,
+                     std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>>;
+        Bits bits = std::bit_cast<Bits>(value);
+
+        if constexpr (sizeof(T) == 2)
+            bits = __builtin_bswap16(bits);
+        else if constexpr (sizeof(T) == 4)
+            bits = __builtin_bswap32(bits);
+        else if constexpr (sizeof(T) == 8)
+            bits = __builtin_bswap64(bits);
+
+        return std::bit_cast<T>(bits);
+    }
+
+    inline std::runtime_error FileError(const std::string &what, const std::string &path) {
+        return std::runtime_error(what + ": " + path);
+    }
+
+    inline void WriteAll(int fd, const void *data, size_t size, const std::string &path) {
+        const char *bytes = static_cast<const char *>(data);
+        while (size > 0) {
+            ssize_t count = write(fd, bytes, size);
+            if (count < 0 && errno == EINTR)
+                continue;
+
+            if (count <= 0)
+                throw FileError(std::string("Cannot write matrix file (") + std::strerror(errno) + ")", path);
+
+            bytes += count;
+            size -= static_cast<size_t>(count);
+        }
+    }
+
+    // Positioned transfers of exactly size bytes, for files accessed in
+    // blocks rather than streamed.
+    inline void WriteAllAt(int fd, const void *data, size_t size, size_t offset, const std::string &path) {
+        const char *bytes = static_cast<const char *>(data);
+        while (size > 0) {
+            ssize_t count = pwrite(fd, bytes, size, static_cast<off_t>(offset));
+            if (count < 0 && errno == EINTR)
+                continue;
+
+            if (count <= 0)
+                throw FileError(std::string("Cannot write matrix file (") + std::strerror(errno) + ")", path);
+
+            bytes += count;
+            size -= static_cast<size_t>(count);
+            offset += static_cast<size_t>(count);
+        }
+    }
+
+    inline void ReadAllAt(int fd, void *data, size_t size, size_t offset, const std::string &path) {
+        char *bytes = static_cast<char *>(data);
+        while (size > 0) {
+            ssize_t count = pread(fd, bytes, size, static_cast<off_t>(offset));
+            if (count < 0 && errno == EINTR)
+                continue;
+
+            if (count < 0)
+                throw FileError(std::string("Cannot read matrix file (") + std::strerror(errno) + ")", path);
+
+            if (count == 0)
+                throw FileError("Matrix file is truncated", path);
+
+            bytes += count;
+            size -= static_cast<size_t>(count);
+            offset += static_cast<size_t>(count);
+        }
+    }
+
+    // Closes the descriptor on every path out of a function.
+    class FileDescriptor {
+    public:
+        explicit FileDescriptor(int fd) : fd_(fd) {}
+        FileDescriptor(const FileDescriptor &other) = delete;
+        FileDescriptor &operator=(const FileDescriptor &other) = delete;
+        ~FileDescriptor() {
+            if (fd_ >= 0)
+                close(fd_);
+        }
+
+        int Get() const { return fd_; }
+    private:
+        int fd_;
+    }; // class FileDescriptor
+} // namespace file
+} // namespace details
+
+// Writes view to path. row_stride, in elements, is column_count when 0;
+// alignment is the alignment of the payload offset in the file, a power of
+// two no larger than a page, so that it holds for a mapping too.
+template <typename E>
+void WriteMatrixFile(const std::string &path, const MatrixView<E> &view, size_t row_stride = 0,
+                     size_t alignment = details::kStorageAlignment) {
+    using T = std::remove_const_t<E>;
+    namespace file = details::file;
+
+    if (row_stride == 0)
+        row_stride = view.GetColumnCount();
+
+    if (row_stride < view.GetColumnCount())
+        throw std::logic_error("Row stride is less than column count");
+
+    if (alignment < alignof(T) || !std::has_single_bit(alignment) ||
+        alignment > static_cast<size_t>(sysconf(_SC_PAGESIZE)))
+        throw std::logic_error("Payload alignment is not a power of two between element alignment and page size");
+
+    FileHeader header{};
+    std::memcpy(header.magic, file::kMagic, sizeof(header.magic));
+    header.version = kFileVersion;
+    header.byte_order = file::kByteOrderMark;
+    header.dtype = file::DTypeOf<T>();
+    header.element_size = sizeof(T);
+    header.alignment = static_cast<uint32_t>(alignment);
+    header.row_count = view.GetRowCount();
+    header.column_count = view.GetColumnCount();
+    header.row_stride = row_stride;
+    header.payload_offset = (sizeof(FileHeader) + alignment - 1) / alignment * alignment;
+
+    file::FileDescriptor fd{open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)};
+    if (fd.Get() < 0)
+        throw file::FileError(std::string("Cannot create matrix file (") + std::strerror(errno) + ")", path);
+
+    std::vector<char> padding(header.payload_offset - sizeof(FileHeader), 0);
+    file::WriteAll(fd.Get(), &header, sizeof(header), path);
+    file::WriteAll(fd.Get(), padding.data(), padding.size(), path);
+
+    if (view.IsContiguous() && row_stride == view.GetColumnCount()) {
+        file::WriteAll(fd.Get(), view.GetData(), view.GetRowCount() * row_stride * sizeof(T), path);
+        return;
+    }
+
+    // Row by row through a buffer that carries the zero padding of the row.
+    std::vector<T> row(row_stride, T{});
+    for (size_t i = 0; i < view.GetRowCount(); ++i) {
+        for (size_t j = 0; j < view.GetColumnCount(); ++j)
+            row[j] = view.Eval(i, j);
+
+        file::WriteAll(fd.Get(), row.data(), row_stride * sizeof(T), path);
+    }
+}
+
+template <typename T>
+void WriteMatrixFile(const std::string &path, const Matrix<T> &matrix, size_t row_stride = 0,
+                     size_t alignment = details::kStorageAlignment) {
+    WriteMatrixFile(path, matrix.View(), row_stride, alignment);
+}
+
+// File mapped into memory. The payload is used where it lies: View() costs
+// nothing however large the file, and pages are read on first touch. The
+// mapping lives as long as the object; views must not outlive it.
+template <typename T> class MappedMatrix {
+public:
+    explicit MappedMatrix(const std::string &path, MapMode mode = MapMode::ReadOnly) : mode_(mode) {
+        namespace file = details::file;
+
+        file::FileDescriptor fd{open(path.c_str(), (mode == MapMode::ReadOnly) ? O_RDONLY : O_RDWR)};
+        if (fd.Get() < 0)
+            throw file::FileError(std::string("Cannot open matrix file (") + std::strerror(errno) + ")", path);
+
+        struct stat info;
+        if (fstat(fd.Get(), &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(FileHeader))
+            throw file::FileError("Matrix file is truncated", path);
+
+        map_size_ = static_cast<size_t>(info.st_size);
+        int protection = (mode == MapMode::ReadOnly) ? PROT_READ : PROT_READ | PROT_WRITE;
+        void *map = mmap(nullptr, map_size_, protection, MAP_SHARED, fd.Get(), 0);
+        if (map == MAP_FAILED)
+            throw file::FileError(std::string("Cannot map matrix file (") + std::strerror(errno) + ")", path);
+
+        map_ = map;
+        try {
+            std::memcpy(&header_, map_, sizeof(header_));
+            CheckHeader(path);
+        } catch (...) {
+            munmap(map_, map_size_);
+            throw;
+        }
+
+        data_ = reinterpret_cast<T *>(static_cast<char *>(map_) + header_.payload_offset);
+    }
+
+    MappedMatrix(const MappedMatrix &other) = delete;
+    MappedMatrix &operator=(const MappedMatrix &other) = delete;
+
+    MappedMatrix(MappedMatrix &&other) noexcept { Swap(other); }
+
+    MappedMatrix &operator=(MappedMatrix &&other) noexcept {
+        Swap(other);
+        return *this;
+    }
+
+    ~MappedMatrix() {
+        if (map_ != nullptr)
+            munmap(map_, map_size_);
+    }
+
+    const FileHeader &GetHeader() const { return header_; }
+
+    size_t GetRowCount() const { return header_.row_count; }
+    size_t GetColumnCount() const { return header_.column_count; }
+
+    // Written on a machine of the other byte order: the elements can only
+    // be read through ToMatrix, which swaps them.
+    bool IsByteSwapped() const { return header_.byte_order == details::file::kSwappedByteOrderMark; }
+
+    ConstMatrixView<T> View() const {
+        CheckNative();
+        return ConstMatrixView<T>(data_, header_.row_count, header_.column_count, header_.row_stride);
+    }
+
+    // Writable view of a ReadWrite mapping. A separate name rather than a
+    // non-const View(), which would make every read-only use throw.
+    MatrixView<T> MutableView() {
+        CheckNative();
+        if (mode_ == MapMode::ReadOnly)
+            throw std::logic_error("Matrix file is mapped read-only");
+
+        return MatrixView<T>(data_, header_.row_count, header_.column_count, header_.row_stride);
+    }
+
+    // Copy into memory, in native byte order whatever the file has.
+    Matrix<T> ToMatrix(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) const {
+        Matrix<T> matrix(header_.row_count, header_.column_count, resource);
+        T *dst = matrix.GetData();
+
+        for (size_t i = 0; i < header_.row_count; ++i) {
+            const T *src = data_ + i * header_.row_stride;
+
+            if (IsByteSwapped())
+                std::transform(src, src + header_.column_count, dst, details::file::ByteSwap<T>);
+            else
+                std::copy(src, src + header_.column_count, dst);
+
+            dst += header_.column_count;
+        }
+
+        return matrix;
+    }
+private:
+    void CheckHeader(const std::string &path) {
+        namespace file = details::file;
+
+        if (std::memcmp(header_.magic, file::kMagic, sizeof(header_.magic)) != 0)
+            throw file::FileError("Not a matrix file", path);
+
+        uint16_t version = header_.version;
+        if (header_.byte_order == file::kSwappedByteOrderMark)
+            version = file::ByteSwap(version);
+        else if (header_.byte_order != file::kByteOrderMark)
+            throw file::FileError("Matrix file has an unknown byte order", path);
+
+        if (version != kFileVersion)
+            throw file::FileError("Matrix file version is not supported", path);
+
+        if (header_.byte_order == file::kSwappedByteOrderMark) {
+            header_.alignment = file::ByteSwap(header_.alignment);
+            header_.row_count = file::ByteSwap(header_.row_count);
+            header_.column_count = file::ByteSwap(header_.column_count);
+            header_.row_stride = file::ByteSwap(header_.row_stride);
+            header_.payload_offset = file::ByteSwap(header_.payload_offset);
+        }
+
+        if (header_.dtype != file::DTypeOf<T>() || header_.element_size != sizeof(T))
+            throw std::logic_error("Matrix file element type does not match");
+
+        if (header_.row_stride < header_.column_count || header_.payload_offset < sizeof(FileHeader) ||
+            header_.payload_offset % alignof(T) != 0)
+            throw file::FileError("Matrix file header is corrupted", path);
+
+        // row_count * row_stride * sizeof(T) must fit the file without wrapping.
+        size_t payload = map_size_ - std::min<size_t>(map_size_, header_.payload_offset);
+        size_t capacity = payload / sizeof(T);
+        if (header_.row_count != 0 && header_.row_stride != 0 && capacity / header_.row_stride < header_.row_count)
+            throw file::FileError("Matrix file is truncated", path);
+    }
+
+    void CheckNative() const {
+        if (IsByteSwapped())
+            throw std::logic_error("Matrix file has foreign byte order, use ToMatrix");
+    }
+
+    void Swap(MappedMatrix &other) noexcept {
+        std::swap(map_, other.map_);
+        std::swap(map_size_, other.map_size_);
+        std::swap(data_, other.data_);
+        std::swap(header_, other.header_);
+        std::swap(mode_, other.mode_);
+    }
+
+    void *map_ = nullptr;
+    size_t map_size_ = 0;
+    T *data_ = nullptr;
+    FileHeader header_{};
+    MapMode mode_ = MapMode::ReadOnly;
+}; // class MappedMatrix
+
+// Whole file into a Matrix; shorthand for MappedMatrix<T>(path).ToMatrix().
+template <typename T>
+Matrix<T> ReadMatrixFile(const std::string &path,
+                         std::pmr::memory_resource *resource = std::pmr::get_default_resource()) {
+    return MappedMatrix<T>(path).ToMatrix(resource);
+}
+} // namespace matrix
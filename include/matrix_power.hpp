@@ -0,0 +1,237 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "lu.hpp"
+#include "matrix.hpp"
+
+// Powers and the exponential of square matrices. Pow squares its way
+// through the bits of the exponent, 2 log2(k) products at most, and keeps
+// the power, the running result and one scratch matrix: every product
+// goes into the storage of the matrix it replaces, so no step allocates.
+// PowMod does the same with entries reduced modulo m after every product,
+// the form linear recurrences need. MatrixExp is the scaling and squaring
+// method of Higham (2005): a Pade approximant of degree 3 to 13, chosen by
+// the 1-norm, of A / 2^s, squared s times.
+
+namespace matrix {
+namespace details {
+namespace power {
+    template <typename T> void CheckSquare(const Matrix<T> &matrix) {
+        if (matrix.GetRowCount() != matrix.GetColumnCount())
+            throw std::logic_error("Matrix rows and columns counts is not equal");
+    }
+
+    template <typename T> Matrix<T> Identity(size_t size) {
+        std::vector<T> values(size * size, T{0});
+        for (size_t i = 0; i < size; ++i)
+            values[i * size + i] = T{1};
+
+        return Matrix<T>(size, size, values.begin(), values.end());
+    }
+
+    // base^exponent for exponent > 0, multiply(lhs, rhs, out) storing the
+    // product in out, which is neither operand.
+    template <typename T, typename Multiplier>
+    Matrix<T> Pow(Matrix<T> base, uint64_t exponent, Multiplier &&multiply) {
+        Matrix<T> scratch(base.GetRowCount(), base.GetColumnCount());
+        auto square = [&] {
+            multiply(base, base, scratch);
+            std::swap(base, scratch);
+        };
+
+        for (; (exponent & 1) == 0; exponent >>= 1)
+            square();
+
+        if (exponent == 1)
+            return base;
+
+        Matrix<T> result = base;
+        while ((exponent >>= 1) != 0) {
+            square();
+            if (exponent & 1) {
+                multiply(result, base, scratch);
+                std::swap(result, scratch);
+            }
+        }
+
+        return result;
+    }
+
+    // Maximum absolute column sum.
+    template <typename T> T NormOne(const Matrix<T> &matrix) {
+        size_t size = matrix.GetRowCount();
+        std::vector<T> sums(size, T{0});
+        for (size_t i = 0; i < size; ++i)
+            for (size_t j = 0; j < size; ++j)
+                sums[j] += std::fabs(matrix.GetData()[i * size + j]);
+
+        return size ? *std::max_element(sums.begin(), sums.end()) : T{0};
+    }
+
+    template <typename T> void AddDiagonal(Matrix<T> &matrix, T value) {
+        size_t size = matrix.GetRowCount();
+        for (size_t i = 0; i < size; ++i)
+            matrix.GetData()[i * size + i] += value;
+    }
+} // namespace power
+} // namespace details
+
+// a^exponent by repeated squaring; the identity for exponent 0. Integer
+// overflow behaves as it does for operator*.
+template <typename T> Matrix<T> Pow(const Matrix<T> &a, uint64_t exponent) {
+    details::power::CheckSquare(a);
+    if (exponent == 0)
+        return details::power::Identity<T>(a.GetRowCount());
+
+    return details::power::Pow(a, exponent, [](const Matrix<T> &lhs, const Matrix<T> &rhs, Matrix<T> &out) {
+        Multiply(lhs, rhs, out);
+    });
+}
+
+// a^exponent with every entry reduced to [0, modulus). While
+// n (modulus - 1)^2 fits in 64 bits the products run through the packed
+// kernel in uint64_t and are reduced afterwards; larger moduli reduce each
+// multiply-add in 128-bit arithmetic.
+template <typename T> Matrix<T> PowMod(const Matrix<T> &a, uint64_t exponent, T modulus) {
+    static_assert(std::is_integral_v<T>, "PowMod needs an integer element type");
+    details::power::CheckSquare(a);
+    if (modulus <= 0)
+        throw std::logic_error("Modulus is not positive");
+
+    size_t size = a.GetRowCount();
+    uint64_t m = static_cast<uint64_t>(modulus);
+    Matrix<uint64_t> base(size, size);
+    for (size_t i = 0; i < size * size; ++i) {
+        T value = a.GetData()[i] % modulus;
+        base.GetData()[i] = static_cast<uint64_t>((value < 0) ? value + modulus : value);
+    }
+
+    Matrix<uint64_t> power;
+    if (exponent == 0) {
+        power = details::power::Identity<uint64_t>(size);
+        for (size_t i = 0; i < size * size; ++i)
+            power.GetData()[i] %= m;
+    } else {
+        // (m - 1)^2 fits in 128 bits; multiplied by n it may not, so the
+        // bound divides instead.
+        unsigned __int128 square = static_cast<unsigned __int128>(m - 1) * (m - 1);
+        bool is_packed = square <= std::numeric_limits<uint64_t>::max() / std::max<size_t>(size, 1);
+
+        power = details::power::Pow(std::move(base), exponent, [&](const Matrix<uint64_t> &lhs,
+                                                                   const Matrix<uint64_t> &rhs,
+                                                                   Matrix<uint64_t> &out) {
+            if (is_packed) {
+                Multiply(lhs, rhs, out);
+                for (size_t i = 0; i < size * size; ++i)
+                    out.GetData()[i] %= m;
+                return;
+            }
+
+            for (size_t i = 0; i < size; ++i)
+                for (size_t j = 0; j < size; ++j) {
+                    uint64_t sum = 0;
+                    for (size_t k = 0; k < size; ++k)
+                        sum = static_cast<uint64_t>(
+                            (sum + static_cast<unsigned __int128>(lhs.GetData()[i * size + k]) *
+                                       rhs.GetData()[k * size + j]) % m);
+                    out.GetData()[i * size + j] = sum;
+                }
+        });
+    }
+
+    Matrix<T> result(size, size);
+    std::copy(power.GetData(), power.GetData() + size * size, result.GetData());
+    return result;
+}
+
+// e^a by scaling and squaring with a diagonal Pade approximant.
+template <typename T> Matrix<T> MatrixExp(const Matrix<T> &a) {
+    static_assert(std::is_floating_point_v<T>, "MatrixExp needs a floating point element type");
+    details::power::CheckSquare(a);
+
+    size_t size = a.GetRowCount();
+    if (size == 0)
+        return Matrix<T>(0);
+
+    // Largest 1-norm for which the degree m approximant is accurate to
+    // double precision, and the coefficients b_0 .. b_m of its numerator.
+    static constexpr double kTheta[] = {1.495585217958292e-2, 2.539398330063230e-1, 9.504178996162932e-1,
+                                        2.097847961257068e0, 5.371920351148152e0};
+    static const std::vector<double> kCoefficients[] = {
+        {120, 60, 12, 1},
+        {30240, 15120, 3360, 420, 30, 1},
+        {17297280, 8648640, 1995840, 277200, 25200, 1512, 56, 1},
+        {17643225600, 8821612800, 2075673600, 302702400, 30270240, 2162160, 110880, 3960, 90, 1},
+        {64764752532480000, 32382376266240000, 7771770303897600, 1187353796428800, 129060195264000,
+         10559470521600, 670442572800, 33522128640, 1323241920, 40840800, 960960, 16380, 182, 1},
+    };
+
+    T norm = details::power::NormOne(a);
+    size_t degree = 0;
+    while (degree < 4 && norm > static_cast<T>(kTheta[degree]))
+        ++degree;
+
+    int squarings = 0;
+    Matrix<T> scaled = a;
+    if (degree == 4 && norm > static_cast<T>(kTheta[4])) {
+        squarings = static_cast<int>(std::ceil(std::log2(norm / static_cast<T>(kTheta[4]))));
+        scaled *= std::ldexp(T{1}, -squarings);
+    }
+
+    auto b = [&](size_t j) { return static_cast<T>(kCoefficients[degree][j]); };
+    Matrix<T> a2 = scaled * scaled;
+    Matrix<T> u;
+    Matrix<T> v;
+
+    if (degree < 4) {
+        // U = A (b_1 I + b_3 A^2 + ...), V = b_0 I + b_2 A^2 + ..., with
+        // the even powers built one product at a time.
+        size_t order = 2 * degree + 3;
+        Matrix<T> even = a2;
+        Matrix<T> odd_sum = b(3) * a2;
+        v = b(2) * a2;
+        for (size_t j = 4; j <= order; j += 2) {
+            even = even * a2;
+            odd_sum += b(j + 1) * even;
+            v += b(j) * even;
+        }
+
+        details::power::AddDiagonal(odd_sum, b(1));
+        details::power::AddDiagonal(v, b(0));
+        u = scaled * odd_sum;
+    } else {
+        Matrix<T> a4 = a2 * a2;
+        Matrix<T> a6 = a4 * a2;
+
+        Matrix<T> high = b(13) * a6 + b(11) * a4 + b(9) * a2;
+        Matrix<T> odd_sum = a6 * high;
+        odd_sum += b(7) * a6 + b(5) * a4 + b(3) * a2;
+        details::power::AddDiagonal(odd_sum, b(1));
+        u = scaled * odd_sum;
+
+        high = b(12) * a6 + b(10) * a4 + b(8) * a2;
+        v = a6 * high;
+        v += b(6) * a6 + b(4) * a4 + b(2) * a2;
+        details::power::AddDiagonal(v, b(0));
+    }
+
+    // r = (V - U)^-1 (V + U), then r^(2^s).
+    Matrix<T> result = LU<T>(Matrix<T>(v - u)).Solve(Matrix<T>(v + u));
+    Matrix<T> scratch(size, size);
+    for (int i = 0; i < squarings; ++i) {
+        Multiply(result, result, scratch);
+        std::swap(result, scratch);
+    }
+
+    return result;
+}
+} // namespace matrix
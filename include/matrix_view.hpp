@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+
+#include "matrix_expr.hpp"
+#include "simd.hpp"
+
+// Non-owning strided window into matrix storage: element (i, j) is
+// GetData()[i * GetRowStride() + j * GetColumnStride()]. Blocks, single
+// rows and columns and the transpose are all views of the same memory and
+// cost O(1) to make. A view is an expression, so it mixes with matrices in
+// arithmetic and is read in place by the GEMM. Included by matrix.hpp.
+
+namespace matrix {
+template <typename E> class MatrixView : public details::MatrixExpr<MatrixView<E>> {
+public:
+    using value_type = std::remove_const_t<E>;
+
+    MatrixView() = default;
+
+    MatrixView(E *data, size_t row_count, size_t column_count, size_t row_stride, size_t column_stride = 1)
+        : data_(data), row_count_(row_count), column_count_(column_count),
+          row_stride_(row_stride), column_stride_(column_stride) {}
+
+    operator MatrixView<const value_type>() const requires (!std::is_const_v<E>) {
+        return MatrixView<const value_type>(data_, row_count_, column_count_, row_stride_, column_stride_);
+    }
+
+    size_t GetRowCount() const { return row_count_; }
+    size_t GetColumnCount() const { return column_count_; }
+    size_t GetRowStride() const { return row_stride_; }
+    size_t GetColumnStride() const { return column_stride_; }
+    E *GetData() const { return data_; }
+
+    // Rows are stored back to back, as in a Matrix.
+    bool IsContiguous() const {
+        return column_stride_ == 1 && (row_count_ <= 1 || row_stride_ == column_count_);
+    }
+
+    E &operator()(size_t num_row, size_t num_col) const {
+        if (num_row >= row_count_ || num_col >= column_count_)
+            throw std::range_error("View index is out of range");
+
+        return Eval(num_row, num_col);
+    }
+
+    E &Eval(size_t num_row, size_t num_col) const {
+        return data_[num_row * row_stride_ + num_col * column_stride_];
+    }
+
+    MatrixView Block(size_t first_row, size_t first_col, size_t row_count, size_t column_count) const {
+        if (first_row + row_count > row_count_ || first_col + column_count > column_count_)
+            throw std::range_error("Block is out of the view");
+
+        return MatrixView(data_ + first_row * row_stride_ + first_col * column_stride_,
+                          row_count, column_count, row_stride_, column_stride_);
+    }
+
+    MatrixView Row(size_t num_row) const { return Block(num_row, 0, 1, column_count_); }
+
+    MatrixView Column(size_t num_col) const { return Block(0, num_col, row_count_, 1); }
+
+    MatrixView Transposed() const {
+        return MatrixView(data_, column_count_, row_count_, column_stride_, row_stride_);
+    }
+
+    bool Aliases(const details::StridedTarget<value_type> &dst) const { return dst.Overlaps(data_, End()); }
+
+    bool Conflicts(const details::StridedTarget<value_type> &dst) const {
+        return dst.Conflicts(data_, row_stride_, column_stride_, End());
+    }
+
+    // Element-wise writes through the view; the shapes must match. Reading
+    // the viewed memory on the right-hand side is allowed.
+    template <typename Expr> requires details::IsMatrixOperand<Expr> && (!std::is_const_v<E>)
+    MatrixView &Assign(const Expr &expr) {
+        const auto &operand = details::AsExpr(expr);
+        CheckShape(operand);
+
+        if (!details::AssignExpr(Target(), operand))
+            details::AssignExpr(Target(), Matrix<value_type>(operand, GetScratchResource()).View());
+
+        return *this;
+    }
+
+    template <typename Expr> requires details::IsMatrixOperand<Expr> && (!std::is_const_v<E>)
+    MatrixView &operator+=(const Expr &expr) {
+        const auto &operand = details::AsExpr(expr);
+        CheckShape(operand);
+        details::AccumulateExpr(Target(), operand, false);
+        return *this;
+    }
+
+    template <typename Expr> requires details::IsMatrixOperand<Expr> && (!std::is_const_v<E>)
+    MatrixView &operator-=(const Expr &expr) {
+        const auto &operand = details::AsExpr(expr);
+        CheckShape(operand);
+        details::AccumulateExpr(Target(), operand, true);
+        return *this;
+    }
+
+    MatrixView &operator*=(const value_type &val) requires (!std::is_const_v<E>) {
+        for (size_t i = 0; i < row_count_; ++i) {
+            E *row = data_ + i * row_stride_;
+
+            if (column_stride_ == 1) {
+                details::simd::Scale(row, val, column_count_);
+                continue;
+            }
+
+            for (size_t j = 0; j < column_count_; ++j)
+                row[j * column_stride_] *= val;
+        }
+
+        return *this;
+    }
+private:
+    E *End() const { return details::StridedEnd(data_, row_count_, column_count_, row_stride_, column_stride_); }
+
+    details::StridedTarget<value_type> Target() const {
+        return {data_, row_count_, column_count_, row_stride_, column_stride_};
+    }
+
+    template <typename Expr> void CheckShape(const Expr &expr) const {
+        if (row_count_ != expr.GetRowCount() || column_count_ != expr.GetColumnCount())
+            throw std::logic_error("Matrixs sizes do not match");
+    }
+
+    E *data_ = nullptr;
+    size_t row_count_ = 0;
+    size_t column_count_ = 0;
+    size_t row_stride_ = 0;
+    size_t column_stride_ = 1;
+}; // class MatrixView
+
+template <typename T> using ConstMatrixView = MatrixView<const T>;
+} // namespace matrix
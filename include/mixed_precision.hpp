@@ -0,0 +1,197 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include "gemm.hpp"
+#include "lu.hpp"
+#include "matrix.hpp"
+
+// Double precision solves from a single precision factorization. The LU
+// runs in float, with twice the lanes per vector and half the memory
+// traffic of double, and iterative refinement recovers double accuracy:
+// the residual r = b - A x is computed in double against the original
+// matrix, the correction solves A d = r with the float factors, and x += d
+// until the residual is as small as a backward stable double solve would
+// leave it. This converges when cond(A) is well below 1 / eps(float), some
+// 10^7; past that, or when the refinement stalls, the matrix is factored
+// again in double and solved directly.
+
+namespace matrix {
+class MixedPrecisionLU {
+public:
+    // The stopping test and iteration cap of LAPACK's dsgesv.
+    static constexpr size_t kMaxIterations = 30;
+
+    explicit MixedPrecisionLU(const Matrix<double> &matrix) : matrix_(matrix), low_(ToFloat(matrix)) {
+        size_t size = GetSize();
+        std::vector<double> column_norms(size, 0.0);
+        for (size_t i = 0; i < size; ++i) {
+            double row_norm = 0;
+            for (size_t j = 0; j < size; ++j) {
+                double value = std::fabs(matrix_.GetData()[i * size + j]);
+                row_norm += value;
+                column_norms[j] += value;
+            }
+            norm_infinity_ = std::max(norm_infinity_, row_norm);
+        }
+        norm_one_ = *std::max_element(column_norms.begin(), column_norms.end());
+
+        condition_ = low_.IsSingular()
+                         ? std::numeric_limits<double>::infinity()
+                         : norm_one_ * static_cast<double>(low_.InverseNormEstimate());
+
+        // Refinement contracts by about cond * eps(float) per step; close
+        // to one it would not converge in any useful number of steps.
+        if (!(condition_ * std::numeric_limits<float>::epsilon() < 0.5))
+            Fallback();
+    }
+
+    size_t GetSize() const { return matrix_.GetRowCount(); }
+
+    // Estimate of the 1-norm condition number of the matrix, from the
+    // float factors; infinity when they are singular.
+    double GetConditionEstimate() const { return condition_; }
+
+    // True once solves go through a double factorization: the condition
+    // estimate was too large, or some refinement did not converge.
+    bool IsFallback() const { return high_.has_value(); }
+
+    // Refinement steps taken by the last solve; zero after a fallback.
+    size_t GetIterationCount() const { return iterations_; }
+
+    std::vector<double> Solve(const std::vector<double> &b) {
+        if (b.size() != GetSize())
+            throw std::logic_error("Right-hand side size does not match the matrix");
+
+        Matrix<double> x = Solve(Matrix<double>{GetSize(), 1, b.begin(), b.end()});
+        return std::vector<double>(x.GetData(), x.GetData() + GetSize());
+    }
+
+    // Solves A * X = B for every column of B.
+    Matrix<double> Solve(const Matrix<double> &b) {
+        size_t size = GetSize();
+        if (b.GetRowCount() != size)
+            throw std::logic_error("Right-hand side rows count does not match the matrix");
+
+        iterations_ = 0;
+        if (!high_) {
+            if (std::optional<Matrix<double>> x = Refine(b))
+                return std::move(*x);
+
+            Fallback();
+        }
+
+        return high_->Solve(b);
+    }
+
+    // Determinant and its logarithm from the factors in use: double ones
+    // after a fallback, otherwise the float ones, accumulated in double.
+    // The float factors give the determinant to about cond * n * eps(float)
+    // relative accuracy, not to double precision.
+    double Determinant() const { return DeterminantProduct().Get(); }
+
+    double LogAbsDeterminant() const { return DeterminantProduct().GetLogAbs(); }
+
+    int DeterminantSign() const { return DeterminantProduct().GetSign(); }
+private:
+    static Matrix<float> ToFloat(const Matrix<double> &matrix) {
+        Matrix<float> result{matrix.GetRowCount(), matrix.GetColumnCount()};
+        std::transform(matrix.GetData(), matrix.GetData() + matrix.GetRowCount() * matrix.GetColumnCount(),
+                       result.GetData(), [](double value) { return static_cast<float>(value); });
+        return result;
+    }
+
+    void Fallback() {
+        if (!high_)
+            high_.emplace(matrix_);
+    }
+
+    // The refined solution, or nullopt when the refinement does not reach
+    // double accuracy within kMaxIterations steps. As in dsgesv, a
+    // right-hand side or residual that does not fit float, or a solution
+    // that is not finite, ends the refinement as well.
+    std::optional<Matrix<double>> Refine(const Matrix<double> &b) {
+        size_t size = GetSize();
+        size_t rhs_count = b.GetColumnCount();
+        const double tolerance = std::sqrt(static_cast<double>(size)) * std::numeric_limits<double>::epsilon();
+
+        Matrix<float> low_b = ToFloat(b);
+        if (!IsFinite(low_b))
+            return std::nullopt;
+
+        Matrix<double> x = ToDouble(low_.Solve(low_b));
+        Matrix<double> residual{size, rhs_count};
+
+        for (;; ++iterations_) {
+            if (!IsFinite(x))
+                return std::nullopt;
+
+            // residual = b - A * x, in double throughout.
+            std::copy(b.GetData(), b.GetData() + size * rhs_count, residual.GetData());
+            details::Gemm(size, rhs_count, size, -1.0, matrix_.GetData(), size, size_t{1}, x.GetData(),
+                          rhs_count, size_t{1}, true, residual.GetData(), rhs_count, size_t{1});
+
+            bool is_converged = true;
+            for (size_t j = 0; j < rhs_count && is_converged; ++j) {
+                double residual_norm = 0;
+                double x_norm = 0;
+                for (size_t i = 0; i < size; ++i) {
+                    residual_norm = std::max(residual_norm, std::fabs(residual.GetData()[i * rhs_count + j]));
+                    x_norm = std::max(x_norm, std::fabs(x.GetData()[i * rhs_count + j]));
+                }
+
+                is_converged = residual_norm <= x_norm * norm_infinity_ * tolerance;
+            }
+
+            if (is_converged)
+                return x;
+
+            Matrix<float> low_residual = ToFloat(residual);
+            if (iterations_ == kMaxIterations || !IsFinite(low_residual))
+                return std::nullopt;
+
+            x += ToDouble(low_.Solve(low_residual));
+        }
+    }
+
+    template <typename T> static bool IsFinite(const Matrix<T> &matrix) {
+        const T *data = matrix.GetData();
+        return std::all_of(data, data + matrix.GetRowCount() * matrix.GetColumnCount(),
+                           [](T value) { return std::isfinite(value); });
+    }
+
+    static Matrix<double> ToDouble(const Matrix<float> &matrix) {
+        Matrix<double> result{matrix.GetRowCount(), matrix.GetColumnCount()};
+        std::copy(matrix.GetData(), matrix.GetData() + matrix.GetRowCount() * matrix.GetColumnCount(),
+                  result.GetData());
+        return result;
+    }
+
+    details::ScaledProduct<double> DeterminantProduct() const {
+        return high_ ? DeterminantProduct(*high_) : DeterminantProduct(low_);
+    }
+
+    template <typename T> static details::ScaledProduct<double> DeterminantProduct(const LU<T> &lu) {
+        details::ScaledProduct<double> det{static_cast<double>(lu.DeterminantSign())};
+        size_t size = lu.GetSize();
+        for (size_t i = 0; i < size; ++i)
+            det.Multiply(std::fabs(static_cast<double>(lu.GetPacked().GetData()[i * size + i])));
+
+        return det;
+    }
+
+    Matrix<double> matrix_;
+    LU<float> low_;
+    std::optional<LU<double>> high_;
+    double norm_one_ = 0;
+    double norm_infinity_ = 0;
+    double condition_ = 0;
+    size_t iterations_ = 0;
+}; // class MixedPrecisionLU
+} // namespace matrix
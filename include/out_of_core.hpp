@@ -0,0 +1,747 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "allocator.hpp"
+#include "gemm.hpp"
+#include "matrix.hpp"
+#include "matrix_file.hpp"
+#include "simd.hpp"
+
+// Out-of-core LU for matrices larger than memory. A TiledMatrix keeps a
+// square matrix in a scratch file as tile_size x tile_size tiles, each
+// stored contiguously, the matrix padded to whole tiles with the identity.
+// OutOfCoreLU factors it in place through a TileCache holding at most
+// memory_budget bytes of tiles: one tile column at a time is factored as
+// a panel that stays resident, the trailing tile columns stream through
+// the rest of the cache for their triangular solve and GEMM updates, and a
+// background thread reads the tiles of the update ahead of the arithmetic.
+// Each step reads and writes the trailing matrix once, so a matrix of n
+// rows costs about n / (3 tile_size) passes over the file; larger tiles
+// mean less I/O but a larger minimal budget of one tile column.
+
+namespace matrix {
+template <typename T> class TiledMatrix {
+    static_assert(std::is_floating_point_v<T>, "TiledMatrix needs a floating point element type");
+
+public:
+    static constexpr size_t kDefaultTileSize = 256;
+
+    // Copies the square view into a new file in directory. The file is
+    // unlinked as soon as it is open, so it goes away with the object, or
+    // with the process, whatever happens.
+    explicit TiledMatrix(const ConstMatrixView<T> &view, size_t tile_size = kDefaultTileSize,
+                         const std::string &directory = std::filesystem::temp_directory_path().string())
+        : size_(view.GetRowCount()), tile_size_(tile_size) {
+        if (view.GetRowCount() != view.GetColumnCount())
+            throw std::logic_error("Matrix rows and columns counts is not equal");
+
+        if (size_ == 0)
+            throw std::logic_error("Matrix is empty");
+
+        if (tile_size_ == 0)
+            throw std::logic_error("Tile size is zero");
+
+        tile_count_ = (size_ + tile_size_ - 1) / tile_size_;
+        Open(directory);
+
+        std::vector<T> tile(tile_size_ * tile_size_);
+        for (size_t tile_row = 0; tile_row < tile_count_; ++tile_row)
+            for (size_t tile_col = 0; tile_col < tile_count_; ++tile_col) {
+                for (size_t i = 0; i < tile_size_; ++i) {
+                    size_t row = tile_row * tile_size_ + i;
+                    size_t col = tile_col * tile_size_;
+                    T *dst = tile.data() + i * tile_size_;
+
+                    std::fill(dst, dst + tile_size_, T{});
+                    if (row < size_) {
+                        for (size_t j = 0; j < tile_size_ && col + j < size_; ++j)
+                            dst[j] = view.Eval(row, col + j);
+                    } else if (tile_row == tile_col) {
+                        dst[i] = T{1};
+                    }
+                }
+
+                WriteTile(tile_row, tile_col, tile.data());
+            }
+
+        read_count_ = 0;
+        write_count_ = 0;
+    }
+
+    explicit TiledMatrix(const Matrix<T> &matrix, size_t tile_size = kDefaultTileSize,
+                         const std::string &directory = std::filesystem::temp_directory_path().string())
+        : TiledMatrix(matrix.View(), tile_size, directory) {}
+
+    TiledMatrix(const TiledMatrix &other) = delete;
+    TiledMatrix &operator=(const TiledMatrix &other) = delete;
+
+    ~TiledMatrix() {
+        if (fd_ >= 0)
+            close(fd_);
+    }
+
+    size_t GetSize() const { return size_; }
+    size_t GetTileSize() const { return tile_size_; }
+
+    // Tiles per row and per column.
+    size_t GetTileCount() const { return tile_count_; }
+
+    size_t GetTileBytes() const { return tile_size_ * tile_size_ * sizeof(T); }
+
+    // Tiles transferred since construction; both are safe to call from any
+    // thread.
+    size_t GetReadCount() const { return read_count_.load(); }
+    size_t GetWriteCount() const { return write_count_.load(); }
+
+    // Whole tiles, tile_size x tile_size row-major; may be called from
+    // several threads at once for different tiles.
+    void ReadTile(size_t tile_row, size_t tile_col, T *tile) const {
+        details::file::ReadAllAt(fd_, tile, GetTileBytes(), Offset(tile_row, tile_col), path_);
+        ++read_count_;
+    }
+
+    void WriteTile(size_t tile_row, size_t tile_col, const T *tile) {
+        details::file::WriteAllAt(fd_, tile, GetTileBytes(), Offset(tile_row, tile_col), path_);
+        ++write_count_;
+    }
+
+    // The matrix without its padding, in memory; for matrices that fit.
+    Matrix<T> ToMatrix() const {
+        Matrix<T> matrix(size_, size_);
+        std::vector<T> tile(tile_size_ * tile_size_);
+
+        for (size_t tile_row = 0; tile_row < tile_count_; ++tile_row)
+            for (size_t tile_col = 0; tile_col < tile_count_; ++tile_col) {
+                ReadTile(tile_row, tile_col, tile.data());
+
+                size_t row_count = std::min(tile_size_, size_ - tile_row * tile_size_);
+                size_t col_count = std::min(tile_size_, size_ - tile_col * tile_size_);
+                for (size_t i = 0; i < row_count; ++i)
+                    std::copy(tile.data() + i * tile_size_, tile.data() + i * tile_size_ + col_count,
+                              matrix.GetData() + (tile_row * tile_size_ + i) * size_ + tile_col * tile_size_);
+            }
+
+        return matrix;
+    }
+private:
+    void Open(const std::string &directory) {
+        path_ = (std::filesystem::path(directory) / "matrix-tiles-XXXXXX").string();
+        fd_ = mkstemp(path_.data());
+        if (fd_ < 0)
+            throw details::file::FileError(std::string("Cannot create tile file (") + std::strerror(errno) + ")",
+                                           path_);
+
+        unlink(path_.c_str());
+    }
+
+    size_t Offset(size_t tile_row, size_t tile_col) const {
+        if (tile_row >= tile_count_ || tile_col >= tile_count_)
+            throw std::range_error("Tile index is out of range");
+
+        return (tile_row * tile_count_ + tile_col) * GetTileBytes();
+    }
+
+    int fd_ = -1;
+    std::string path_;
+    size_t size_ = 0;
+    size_t tile_size_ = 0;
+    size_t tile_count_ = 0;
+    mutable std::atomic<size_t> read_count_{0};
+    std::atomic<size_t> write_count_{0};
+}; // class TiledMatrix
+
+namespace details {
+namespace out_of_core {
+    // Fixed number of tile slots in one allocation, written back when
+    // dirty. Acquire pins a tile in memory until the matching Release;
+    // Prefetch queues a read for the loader thread, which only takes slots
+    // no one has pinned and skips the tile when there are none. Reads and
+    // write-backs run outside the lock, so the arithmetic on resident tiles
+    // goes on while the loader waits for the disk.
+    //
+    // Loaded tiles join the replacement order at the far end and released
+    // ones at the near end, the first to go. A sweep over more tiles than
+    // fit then evicts the tiles it is done with rather than the ones read
+    // ahead for it, and the part that stays is still there for the next
+    // sweep, where least recently used would have evicted it first.
+    template <typename T> class TileCache {
+    public:
+        TileCache(TiledMatrix<T> &matrix, size_t capacity)
+            : matrix_(matrix), tile_elements_(matrix.GetTileSize() * matrix.GetTileSize()),
+              storage_(capacity * tile_elements_), slots_(capacity),
+              slot_of_(matrix.GetTileCount() * matrix.GetTileCount(), kNone),
+              is_writing_(slot_of_.size(), false) {
+            for (size_t i = 0; i < capacity; ++i)
+                free_.push_back(i);
+
+            loader_ = std::thread([this] { LoaderLoop(); });
+        }
+
+        TileCache(const TileCache &other) = delete;
+        TileCache &operator=(const TileCache &other) = delete;
+
+        // Dirty tiles still in the cache are dropped; Flush first to keep them.
+        ~TileCache() {
+            {
+                std::lock_guard<std::mutex> lock{mutex_};
+                is_stopping_ = true;
+            }
+            changed_.notify_all();
+            loader_.join();
+        }
+
+        T *Acquire(size_t tile_row, size_t tile_col) {
+            size_t slot = Load(tile_row * matrix_.GetTileCount() + tile_col, true);
+            return storage_.data() + slot * tile_elements_;
+        }
+
+        void Release(size_t tile_row, size_t tile_col, bool is_dirty) {
+            std::lock_guard<std::mutex> lock{mutex_};
+            Slot &slot = slots_[slot_of_[tile_row * matrix_.GetTileCount() + tile_col]];
+            slot.is_dirty = slot.is_dirty || is_dirty;
+            if (--slot.pin_count == 0)
+                order_.splice(order_.begin(), order_, slot.position);
+        }
+
+        void Prefetch(size_t tile_row, size_t tile_col) {
+            size_t tile = tile_row * matrix_.GetTileCount() + tile_col;
+            {
+                std::lock_guard<std::mutex> lock{mutex_};
+                if (slot_of_[tile] != kNone)
+                    return;
+
+                queue_.push_back(tile);
+            }
+            changed_.notify_all();
+        }
+
+        // Waits for the queued reads, then writes every dirty tile back.
+        void Flush() {
+            std::unique_lock<std::mutex> lock{mutex_};
+            changed_.wait(lock, [this] { return queue_.empty() && !is_loader_busy_; });
+            ThrowIfFailed();
+
+            for (Slot &slot : slots_)
+                if (slot.is_dirty) {
+                    matrix_.WriteTile(slot.tile / matrix_.GetTileCount(), slot.tile % matrix_.GetTileCount(),
+                                      storage_.data() + (&slot - slots_.data()) * tile_elements_);
+                    slot.is_dirty = false;
+                }
+        }
+    private:
+        static constexpr size_t kNone = static_cast<size_t>(-1);
+
+        struct Slot {
+            size_t tile = kNone;
+            size_t pin_count = 0;
+            bool is_dirty = false;
+            bool is_loading = false;
+            std::list<size_t>::iterator position; // in order_, once loaded
+        }; // struct Slot
+
+        void ThrowIfFailed() const {
+            if (error_)
+                std::rethrow_exception(error_);
+        }
+
+        // Slot holding the tile, read in if needed, or kNone when a
+        // prefetch finds nothing to evict.
+        size_t Load(size_t tile, bool is_demand) {
+            std::unique_lock<std::mutex> lock{mutex_};
+
+            for (;;) {
+                ThrowIfFailed();
+
+                size_t index = slot_of_[tile];
+                bool is_busy = is_writing_[tile] || (index != kNone && slots_[index].is_loading);
+                if (!is_demand && (is_busy || index != kNone))
+                    return kNone;
+
+                if (is_busy) {
+                    changed_.wait(lock);
+                    continue;
+                }
+
+                if (index != kNone) {
+                    ++slots_[index].pin_count;
+                    return index;
+                }
+
+                index = FindVictim();
+                if (index != kNone)
+                    break;
+
+                if (!is_demand)
+                    return kNone;
+
+                if (loading_count_ == 0)
+                    throw std::runtime_error("Tile cache is too small for the tiles in use");
+
+                changed_.wait(lock);
+            }
+
+            size_t index = slot_of_[tile] = TakeSlot();
+            Slot &slot = slots_[index];
+            size_t evicted = slot.tile;
+            bool is_write_back = slot.is_dirty && evicted != kNone;
+            if (evicted != kNone)
+                slot_of_[evicted] = kNone;
+            if (is_write_back)
+                is_writing_[evicted] = true;
+
+            slot.tile = tile;
+            slot.is_dirty = false;
+            slot.is_loading = true;
+            ++loading_count_;
+            lock.unlock();
+
+            T *data = storage_.data() + index * tile_elements_;
+            size_t tile_count = matrix_.GetTileCount();
+            std::exception_ptr error;
+            try {
+                if (is_write_back)
+                    matrix_.WriteTile(evicted / tile_count, evicted % tile_count, data);
+                matrix_.ReadTile(tile / tile_count, tile % tile_count, data);
+            } catch (...) {
+                error = std::current_exception();
+            }
+
+            lock.lock();
+            --loading_count_;
+            slot.is_loading = false;
+            if (is_write_back)
+                is_writing_[evicted] = false;
+
+            if (error) {
+                // A lost write-back leaves the file wrong, so every later
+                // access fails too.
+                error_ = error;
+                slot_of_[tile] = kNone;
+                slot.tile = kNone;
+                free_.push_back(index);
+                changed_.notify_all();
+                std::rethrow_exception(error);
+            }
+
+            order_.push_back(index);
+            slot.position = std::prev(order_.end());
+            if (is_demand)
+                ++slot.pin_count;
+            changed_.notify_all();
+            return index;
+        }
+
+        // A free slot, else the first one in the order no one has pinned.
+        size_t FindVictim() const {
+            if (!free_.empty())
+                return free_.back();
+
+            for (size_t index : order_)
+                if (slots_[index].pin_count == 0)
+                    return index;
+
+            return kNone;
+        }
+
+        size_t TakeSlot() {
+            size_t index = FindVictim();
+            if (!free_.empty())
+                free_.pop_back();
+            else
+                order_.erase(slots_[index].position);
+
+            return index;
+        }
+
+        void LoaderLoop() {
+            std::unique_lock<std::mutex> lock{mutex_};
+            for (;;) {
+                changed_.wait(lock, [this] { return is_stopping_ || !queue_.empty(); });
+                if (is_stopping_)
+                    return;
+
+                size_t tile = queue_.front();
+                queue_.pop_front();
+                is_loader_busy_ = true;
+                lock.unlock();
+
+                try {
+                    Load(tile, false);
+                } catch (...) {
+                    // Kept in error_ for the next Acquire or Flush.
+                }
+
+                lock.lock();
+                is_loader_busy_ = false;
+                changed_.notify_all();
+            }
+        }
+
+        TiledMatrix<T> &matrix_;
+        size_t tile_elements_;
+        AlignedBuffer<T> storage_;
+        std::vector<Slot> slots_;
+        std::vector<size_t> free_;
+        std::list<size_t> order_; // of replacement, for loaded slots
+        std::vector<size_t> slot_of_;
+        std::vector<bool> is_writing_;
+
+        std::mutex mutex_;
+        std::condition_variable changed_;
+        std::deque<size_t> queue_;
+        std::thread loader_;
+        size_t loading_count_ = 0;
+        bool is_loader_busy_ = false;
+        bool is_stopping_ = false;
+        std::exception_ptr error_;
+    }; // class TileCache
+
+    // Issues prefetches along a known order of tiles, depth tiles ahead of
+    // the one in use.
+    template <typename T> class ReadAhead {
+    public:
+        ReadAhead(TileCache<T> &cache, size_t tile_count, const std::vector<size_t> &order, size_t depth)
+            : cache_(cache), tile_count_(tile_count), order_(order), depth_(depth) {}
+
+        void Advance(size_t position) {
+            size_t end = std::min(order_.size(), position + depth_);
+            for (; issued_ < end; ++issued_)
+                cache_.Prefetch(order_[issued_] / tile_count_, order_[issued_] % tile_count_);
+        }
+    private:
+        TileCache<T> &cache_;
+        size_t tile_count_;
+        const std::vector<size_t> &order_;
+        size_t depth_;
+        size_t issued_ = 0;
+    }; // class ReadAhead
+} // namespace out_of_core
+} // namespace details
+
+// LU decomposition with partial pivoting, P * A = L * U, of a TiledMatrix,
+// overwritten by the factors packed as in LU::GetPacked. Memory use is the
+// tile cache, memory_budget bytes, plus a few vectors of n elements.
+template <typename T> class OutOfCoreLU {
+public:
+    // Smallest budget the factorization runs in: one tile column plus two
+    // tiles. Anything above goes to reading ahead and to keeping tiles
+    // between steps.
+    static size_t MinimumMemoryBudget(const TiledMatrix<T> &matrix) {
+        return (matrix.GetTileCount() + 2) * matrix.GetTileBytes();
+    }
+
+    OutOfCoreLU(TiledMatrix<T> &matrix, size_t memory_budget)
+        : matrix_(matrix), capacity_(memory_budget / matrix.GetTileBytes()) {
+        if (memory_budget < MinimumMemoryBudget(matrix))
+            throw std::logic_error("Memory budget is less than one tile column and two tiles");
+
+        Factor();
+    }
+
+    size_t GetSize() const { return matrix_.GetSize(); }
+
+    // True when some pivot is exactly zero; solves then throw.
+    bool IsSingular() const { return singular_; }
+
+    // Row i of P * A is row GetPermutation()[i] of A.
+    const std::vector<size_t> &GetPermutation() const { return permutation_; }
+
+    T Determinant() const { return DeterminantProduct().Get(); }
+
+    // log |det|, finite wherever det is non-zero; negative infinity if
+    // singular.
+    T LogAbsDeterminant() const { return DeterminantProduct().GetLogAbs(); }
+
+    // -1, 0 or 1.
+    int DeterminantSign() const { return DeterminantProduct().GetSign(); }
+
+    // Solves A * x = b with one pass over the factors in the file.
+    std::vector<T> Solve(const std::vector<T> &b) {
+        size_t size = GetSize();
+        if (b.size() != size)
+            throw std::logic_error("Right-hand side size does not match the matrix");
+
+        if (singular_)
+            throw std::logic_error("Matrix is singular");
+
+        size_t tile_size = matrix_.GetTileSize();
+        size_t tile_count = matrix_.GetTileCount();
+        std::vector<T> x(tile_count * tile_size, T{});
+        for (size_t i = 0; i < size; ++i)
+            x[i] = b[permutation_[i]];
+
+        details::out_of_core::TileCache<T> cache{matrix_, capacity_};
+
+        // L y = P b by tile rows, the diagonal tile last in each.
+        std::vector<size_t> order;
+        for (size_t tile_row = 0; tile_row < tile_count; ++tile_row)
+            for (size_t tile_col = 0; tile_col <= tile_row; ++tile_col)
+                order.push_back(tile_row * tile_count + tile_col);
+        Stream(cache, order, [&](size_t tile_row, size_t tile_col, const T *tile) {
+            T *x_row = x.data() + tile_row * tile_size;
+            if (tile_col != tile_row) {
+                const T *x_col = x.data() + tile_col * tile_size;
+                for (size_t i = 0; i < tile_size; ++i)
+                    x_row[i] -= details::simd::Dot(tile + i * tile_size, x_col, tile_size);
+                return;
+            }
+
+            for (size_t i = 0; i < tile_size; ++i)
+                x_row[i] -= details::simd::Dot(tile + i * tile_size, x_row, i);
+        });
+
+        // U x = y from the last tile row up.
+        order.clear();
+        for (size_t tile_row = tile_count; tile_row-- > 0;)
+            for (size_t tile_col = tile_count; tile_col-- > tile_row;)
+                order.push_back(tile_row * tile_count + tile_col);
+        Stream(cache, order, [&](size_t tile_row, size_t tile_col, const T *tile) {
+            T *x_row = x.data() + tile_row * tile_size;
+            if (tile_col != tile_row) {
+                const T *x_col = x.data() + tile_col * tile_size;
+                for (size_t i = 0; i < tile_size; ++i)
+                    x_row[i] -= details::simd::Dot(tile + i * tile_size, x_col, tile_size);
+                return;
+            }
+
+            for (size_t i = tile_size; i-- > 0;)
+                x_row[i] = (x_row[i] - details::simd::Dot(tile + i * tile_size + i + 1, x_row + i + 1,
+                                                          tile_size - i - 1)) /
+                           tile[i * tile_size + i];
+        });
+
+        x.resize(size);
+        return x;
+    }
+private:
+    static constexpr size_t kNone = static_cast<size_t>(-1);
+
+    details::ScaledProduct<T> DeterminantProduct() const {
+        details::ScaledProduct<T> det{singular_ ? T{} : static_cast<T>(sign_)};
+        for (size_t i = 0; i < diagonal_.size() && !singular_; ++i)
+            det.Multiply(diagonal_[i]);
+
+        return det;
+    }
+
+    // Runs body(tile_row, tile_col, tile) over read-only tiles in order,
+    // reading ahead as far as the cache allows.
+    template <typename Body>
+    void Stream(details::out_of_core::TileCache<T> &cache, const std::vector<size_t> &order, Body &&body) {
+        size_t tile_count = matrix_.GetTileCount();
+        details::out_of_core::ReadAhead<T> read_ahead{cache, tile_count, order, capacity_ - 1};
+
+        for (size_t position = 0; position < order.size(); ++position) {
+            read_ahead.Advance(position);
+            size_t tile_row = order[position] / tile_count;
+            size_t tile_col = order[position] % tile_count;
+            body(tile_row, tile_col, cache.Acquire(tile_row, tile_col));
+            cache.Release(tile_row, tile_col, false);
+        }
+    }
+
+    // Right-looking by tile columns. Step k factors tile column k, which
+    // stays pinned, then updates the trailing tile columns one at a time:
+    // the row swaps of the step, the triangular solve of the tile in row k
+    // and a GEMM for every tile below it. The next panel, column k + 1, is
+    // updated last and so is still in the cache when step k + 1 starts.
+    // Swaps of later steps reach the columns of L left of them in one pass
+    // at the end.
+    void Factor() {
+        size_t size = GetSize();
+        size_t tile_size = matrix_.GetTileSize();
+        size_t tile_count = matrix_.GetTileCount();
+        pivots_.resize(tile_count * tile_size);
+        diagonal_.resize(size);
+
+        details::out_of_core::TileCache<T> cache{matrix_, capacity_};
+        std::vector<T *> panel;
+
+        for (size_t k = 0; k < tile_count; ++k) {
+            for (size_t i = k; i < tile_count; ++i)
+                cache.Prefetch(i, k);
+
+            panel.clear();
+            for (size_t i = k; i < tile_count; ++i)
+                panel.push_back(cache.Acquire(i, k));
+
+            FactorPanel(k, panel);
+
+            std::vector<size_t> columns;
+            for (size_t j = k + 2; j < tile_count; ++j)
+                columns.push_back(j);
+            if (k + 1 < tile_count)
+                columns.push_back(k + 1);
+
+            std::vector<size_t> order;
+            for (size_t j : columns)
+                for (size_t i = k; i < tile_count; ++i)
+                    order.push_back(i * tile_count + j);
+
+            // The panel, the tile of U and the one being updated are pinned.
+            size_t pinned = tile_count - k + 2;
+            details::out_of_core::ReadAhead<T> read_ahead{cache, tile_count, order,
+                                                          capacity_ - std::min(capacity_, pinned)};
+
+            size_t position = 0;
+            for (size_t j : columns) {
+                read_ahead.Advance(position);
+                T *u = cache.Acquire(k, j);
+                SwapRows(cache, k, j, u);
+
+                const T *l = panel[0];
+                for (size_t i = 1; i < tile_size; ++i)
+                    for (size_t r = 0; r < i; ++r)
+                        details::simd::SubScaled(u + i * tile_size, l[i * tile_size + r], u + r * tile_size,
+                                                 tile_size);
+                ++position;
+
+                for (size_t i = k + 1; i < tile_count; ++i, ++position) {
+                    read_ahead.Advance(position);
+                    T *c = cache.Acquire(i, j);
+                    details::Gemm(tile_size, tile_size, tile_size, T{-1}, panel[i - k], tile_size, size_t{1}, u,
+                                  tile_size, size_t{1}, true, c, tile_size, size_t{1});
+                    cache.Release(i, j, true);
+                }
+
+                cache.Release(k, j, true);
+            }
+
+            for (size_t i = k; i < tile_count; ++i)
+                cache.Release(i, k, true);
+        }
+
+        ApplyLaterSwaps(cache);
+        cache.Flush();
+
+        std::vector<size_t> permutation(pivots_.size());
+        std::iota(permutation.begin(), permutation.end(), 0);
+        for (size_t r = 0; r < pivots_.size(); ++r)
+            std::swap(permutation[r], permutation[pivots_[r]]);
+
+        permutation_.assign(permutation.begin(), permutation.begin() + size);
+    }
+
+    // Unblocked elimination of tile column k, whose tiles from row k down
+    // are panel[0], panel[1], ...
+    void FactorPanel(size_t k, const std::vector<T *> &panel) {
+        size_t tile_size = matrix_.GetTileSize();
+        auto element = [&](size_t row, size_t col) -> T & {
+            return panel[row / tile_size][(row % tile_size) * tile_size + col];
+        };
+        size_t row_count = panel.size() * tile_size;
+
+        for (size_t c = 0; c < tile_size; ++c) {
+            size_t pivot = c;
+            for (size_t i = c + 1; i < row_count; ++i)
+                if (std::fabs(element(i, c)) > std::fabs(element(pivot, c)))
+                    pivot = i;
+
+            pivots_[k * tile_size + c] = k * tile_size + pivot;
+            if (pivot != c) {
+                std::swap_ranges(&element(c, 0), &element(c, 0) + tile_size, &element(pivot, 0));
+                sign_ = -sign_;
+            }
+
+            T diag = element(c, c);
+            if (k * tile_size + c < diagonal_.size())
+                diagonal_[k * tile_size + c] = diag;
+
+            if (diag == T{}) {
+                singular_ = true;
+                continue;
+            }
+
+            for (size_t i = c + 1; i < row_count; ++i) {
+                T *row = &element(i, 0);
+                if (row[c] == T{})
+                    continue;
+
+                row[c] /= diag;
+                details::simd::SubScaled(row + c + 1, row[c], &element(c, c + 1), tile_size - c - 1);
+            }
+        }
+    }
+
+    // Row swaps of step k on tile column j, whose tile in row k is already
+    // pinned as top.
+    void SwapRows(details::out_of_core::TileCache<T> &cache, size_t k, size_t j, T *top) {
+        size_t tile_size = matrix_.GetTileSize();
+
+        for (size_t c = 0; c < tile_size; ++c) {
+            size_t pivot = pivots_[k * tile_size + c];
+            if (pivot == k * tile_size + c)
+                continue;
+
+            size_t pivot_tile = pivot / tile_size;
+            T *row = top + c * tile_size;
+            if (pivot_tile == k) {
+                std::swap_ranges(row, row + tile_size, top + (pivot % tile_size) * tile_size);
+                continue;
+            }
+
+            T *other = cache.Acquire(pivot_tile, j);
+            std::swap_ranges(row, row + tile_size, other + (pivot % tile_size) * tile_size);
+            cache.Release(pivot_tile, j, true);
+        }
+    }
+
+    // The swaps of step k were applied right of column k only; they reach
+    // the L tiles of every earlier column here, a column at a time.
+    void ApplyLaterSwaps(details::out_of_core::TileCache<T> &cache) {
+        size_t tile_size = matrix_.GetTileSize();
+        size_t tile_count = matrix_.GetTileCount();
+
+        size_t last_swap = kNone;
+        for (size_t r = 0; r < pivots_.size(); ++r)
+            if (pivots_[r] != r)
+                last_swap = r;
+
+        std::vector<size_t> order;
+        for (size_t j = 0; j + 1 < tile_count && last_swap != kNone && last_swap >= (j + 1) * tile_size; ++j)
+            for (size_t k = j + 1; k < tile_count; ++k)
+                order.push_back(k * tile_count + j);
+
+        // A swap pins two tiles.
+        details::out_of_core::ReadAhead<T> read_ahead{cache, tile_count, order, capacity_ - 2};
+        for (size_t position = 0; position < order.size(); ++position) {
+            read_ahead.Advance(position);
+            size_t k = order[position] / tile_count;
+            size_t j = order[position] % tile_count;
+
+            T *top = cache.Acquire(k, j);
+            SwapRows(cache, k, j, top);
+            cache.Release(k, j, true);
+        }
+    }
+
+    TiledMatrix<T> &matrix_;
+    size_t capacity_;
+    std::vector<size_t> pivots_;
+    std::vector<T> diagonal_;
+    std::vector<size_t> permutation_;
+    int sign_ = 1;
+    bool singular_ = false;
+}; // class OutOfCoreLU
+} // namespace matrix
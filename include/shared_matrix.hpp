@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <utility>
+
+#include "matrix.hpp"
+
+// A matrix with copy-on-write storage, for values handed through many
+// stages that mostly read them. Copies share one Matrix through a
+// reference count and cost O(1); the first mutating access from a copy
+// whose storage is shared takes a private deep copy, after which it
+// mutates in place like a Matrix. Matrix itself stays uniquely owned:
+// it hands out raw storage through GetData, views and expression targets,
+// writes a shared buffer could not see, and its hot loops would pay for
+// the count on every access.
+//
+// A SharedMatrix may be copied and read from several threads at once, as
+// a std::shared_ptr may; mutating one object needs the usual exclusive
+// access to that object only.
+
+namespace matrix {
+template <typename T> class SharedMatrix {
+public:
+    using value_type = T;
+
+    SharedMatrix() : SharedMatrix(Matrix<T>()) {}
+
+    SharedMatrix(Matrix<T> matrix) : matrix_(std::make_shared<Matrix<T>>(std::move(matrix))) {}
+
+    const Matrix<T> &Get() const { return *matrix_; }
+
+    // The matrix for writing, copied first when another SharedMatrix
+    // shares it.
+    Matrix<T> &GetMutable() {
+        if (matrix_.use_count() > 1) {
+            matrix_ = std::make_shared<Matrix<T>>(*matrix_);
+            return *matrix_;
+        }
+
+        // Pairs with the release by the last other copy, whose reads must
+        // be done before the first write here.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return *matrix_;
+    }
+
+    // Whether the storage is shared with another copy, so that the next
+    // mutation will copy it.
+    bool IsShared() const { return matrix_.use_count() > 1; }
+
+    size_t GetRowCount() const { return matrix_->GetRowCount(); }
+    size_t GetColumnCount() const { return matrix_->GetColumnCount(); }
+
+    const T *GetData() const { return matrix_->GetData(); }
+    T *GetData() { return GetMutable().GetData(); }
+
+    ConstMatrixView<T> View() const { return matrix_->View(); }
+    MatrixView<T> View() { return GetMutable().View(); }
+
+    // Rows for reading, as spans of const elements: a ProxyRow here could
+    // be copied into a mutable one and write to the shared storage.
+    std::span<const T> operator[](int num_row) const {
+        if (static_cast<size_t>(num_row) >= GetRowCount())
+            throw std::range_error("Row index is more count of exist rows");
+
+        return std::span<const T>(GetData() + num_row * GetColumnCount(), GetColumnCount());
+    }
+
+    // Rows for writing, after the copy if the storage is shared.
+    ProxyRow<T> operator[](int num_row) { return GetMutable()[num_row]; }
+
+    bool operator==(const SharedMatrix &other) const {
+        return matrix_ == other.matrix_ || *matrix_ == *other.matrix_;
+    }
+
+    bool operator!=(const SharedMatrix &other) const { return !(*this == other); }
+
+    T GetDeterminant() const { return matrix_->GetDeterminant(); }
+
+    Matrix<T> Transpose() const { return matrix_->Transpose(); }
+private:
+    std::shared_ptr<Matrix<T>> matrix_;
+}; // class SharedMatrix
+} // namespace matrix
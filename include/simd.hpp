@@ -0,0 +1,279 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// AVX-512F carries its own FMA instructions, so dropping "fma" from the
+// target is not enough to keep mul + add unfused; contraction is switched
+// off explicitly for every kernel that must round like the scalar loop.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MATRIX_SIMD_X86 1
+#define MATRIX_SIMD_TARGET(isa) __attribute__((target(isa), optimize("fp-contract=off")))
+#define MATRIX_SIMD_TARGET_FUSED(isa) __attribute__((target(isa), optimize("fp-contract=fast")))
+#else
+#define MATRIX_SIMD_TARGET(isa)
+#define MATRIX_SIMD_TARGET_FUSED(isa)
+#endif
+
+#if defined(__GNUC__)
+#define MATRIX_SIMD_INLINE inline __attribute__((always_inline))
+#else
+#define MATRIX_SIMD_INLINE inline
+#endif
+
+namespace matrix {
+namespace details {
+namespace simd {
+    enum class Isa { Scalar, Sse2, Avx2, Avx512 };
+
+    template <typename T>
+    constexpr bool kIsVectorizable =
+        std::is_same_v<T, float> || std::is_same_v<T, double> ||
+        std::is_same_v<T, int32_t> || std::is_same_v<T, int64_t> ||
+        std::is_same_v<T, uint32_t> || std::is_same_v<T, uint64_t>;
+
+    inline Isa DetectIsa() {
+        static const Isa isa = [] {
+#if defined(MATRIX_SIMD_X86) && defined(__GNUC__)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f"))
+                return Isa::Avx512;
+            if (__builtin_cpu_supports("avx2"))
+                return Isa::Avx2;
+            if (__builtin_cpu_supports("sse2"))
+                return Isa::Sse2;
+#endif
+            return Isa::Scalar;
+        }();
+        return isa;
+    }
+
+    inline std::atomic<Isa> isa_limit{Isa::Avx512};
+
+    // Caps the instruction set the kernels may use. The detected CPU
+    // support is an upper bound, so the limit can only lower it.
+    inline void SetIsaLimit(Isa isa) { isa_limit.store(isa); }
+
+    inline Isa GetIsa() { return std::min(DetectIsa(), isa_limit.load()); }
+
+    template <typename T, size_t Bytes> struct VecType {
+#if defined(__GNUC__)
+        typedef T type __attribute__((vector_size(Bytes)));
+#endif
+    }; // struct VecType
+
+    // Vectors are only passed by reference: returning one by value from a
+    // function compiled for a narrower target would change its ABI.
+    template <typename V, typename T> MATRIX_SIMD_INLINE void Load(V &vec, const T *ptr) {
+        std::memcpy(&vec, ptr, sizeof(V));
+    }
+
+    template <typename V, typename T> MATRIX_SIMD_INLINE void Store(T *ptr, const V &vec) {
+        std::memcpy(ptr, &vec, sizeof(V));
+    }
+
+    // The loop bodies below are written once over GCC vector types of the
+    // given width and stamped out per instruction set by the wrappers.
+    template <size_t Bytes, typename T>
+    MATRIX_SIMD_INLINE void AddImpl(T *dst, const T *src, size_t size) {
+        using Vec = typename VecType<T, Bytes>::type;
+        constexpr size_t kWidth = Bytes / sizeof(T);
+        size_t i = 0;
+
+        for (; i + 2 * kWidth <= size; i += 2 * kWidth) {
+            Vec dst_lo, dst_hi, src_lo, src_hi;
+            Load(dst_lo, dst + i);
+            Load(dst_hi, dst + i + kWidth);
+            Load(src_lo, src + i);
+            Load(src_hi, src + i + kWidth);
+            Store(dst + i, dst_lo + src_lo);
+            Store(dst + i + kWidth, dst_hi + src_hi);
+        }
+
+        for (; i < size; ++i)
+            dst[i] += src[i];
+    }
+
+    template <size_t Bytes, typename T>
+    MATRIX_SIMD_INLINE void SubImpl(T *dst, const T *src, size_t size) {
+        using Vec = typename VecType<T, Bytes>::type;
+        constexpr size_t kWidth = Bytes / sizeof(T);
+        size_t i = 0;
+
+        for (; i + 2 * kWidth <= size; i += 2 * kWidth) {
+            Vec dst_lo, dst_hi, src_lo, src_hi;
+            Load(dst_lo, dst + i);
+            Load(dst_hi, dst + i + kWidth);
+            Load(src_lo, src + i);
+            Load(src_hi, src + i + kWidth);
+            Store(dst + i, dst_lo - src_lo);
+            Store(dst + i + kWidth, dst_hi - src_hi);
+        }
+
+        for (; i < size; ++i)
+            dst[i] -= src[i];
+    }
+
+    template <size_t Bytes, typename T>
+    MATRIX_SIMD_INLINE void ScaleImpl(T *dst, T val, size_t size) {
+        using Vec = typename VecType<T, Bytes>::type;
+        constexpr size_t kWidth = Bytes / sizeof(T);
+        size_t i = 0;
+
+        for (; i + 2 * kWidth <= size; i += 2 * kWidth) {
+            Vec lo, hi;
+            Load(lo, dst + i);
+            Load(hi, dst + i + kWidth);
+            Store(dst + i, lo * val);
+            Store(dst + i + kWidth, hi * val);
+        }
+
+        for (; i < size; ++i)
+            dst[i] *= val;
+    }
+
+    // dst -= val * src, the row update of every elimination step.
+    template <size_t Bytes, typename T>
+    MATRIX_SIMD_INLINE void SubScaledImpl(T *dst, T val, const T *src, size_t size) {
+        using Vec = typename VecType<T, Bytes>::type;
+        constexpr size_t kWidth = Bytes / sizeof(T);
+        size_t i = 0;
+
+        for (; i + kWidth <= size; i += kWidth) {
+            Vec dst_vec, src_vec;
+            Load(dst_vec, dst + i);
+            Load(src_vec, src + i);
+            Store(dst + i, dst_vec - src_vec * val);
+        }
+
+        for (; i < size; ++i)
+            dst[i] -= src[i] * val;
+    }
+
+    template <size_t Bytes, typename T>
+    MATRIX_SIMD_INLINE T DotImpl(const T *lhs, const T *rhs, size_t size) {
+        using Vec = typename VecType<T, Bytes>::type;
+        constexpr size_t kWidth = Bytes / sizeof(T);
+        Vec acc0 = {}, acc1 = {};
+        size_t i = 0;
+
+        for (; i + 2 * kWidth <= size; i += 2 * kWidth) {
+            Vec lhs_lo, lhs_hi, rhs_lo, rhs_hi;
+            Load(lhs_lo, lhs + i);
+            Load(lhs_hi, lhs + i + kWidth);
+            Load(rhs_lo, rhs + i);
+            Load(rhs_hi, rhs + i + kWidth);
+            acc0 += lhs_lo * rhs_lo;
+            acc1 += lhs_hi * rhs_hi;
+        }
+
+        acc0 += acc1;
+        T sum{};
+        for (size_t j = 0; j < kWidth; ++j)
+            sum += acc0[j];
+
+        for (; i < size; ++i)
+            sum += lhs[i] * rhs[i];
+
+        return sum;
+    }
+
+#define MATRIX_SIMD_DEFINE_ISA(suffix, isa, bytes)                                   \
+    template <typename T>                                                            \
+    MATRIX_SIMD_TARGET(isa) void Add##suffix(T *dst, const T *src, size_t size) {    \
+        AddImpl<bytes>(dst, src, size);                                              \
+    }                                                                                \
+    template <typename T>                                                            \
+    MATRIX_SIMD_TARGET(isa) void Sub##suffix(T *dst, const T *src, size_t size) {    \
+        SubImpl<bytes>(dst, src, size);                                              \
+    }                                                                                \
+    template <typename T>                                                            \
+    MATRIX_SIMD_TARGET(isa) void Scale##suffix(T *dst, T val, size_t size) {         \
+        ScaleImpl<bytes>(dst, val, size);                                            \
+    }                                                                                \
+    template <typename T>                                                            \
+    MATRIX_SIMD_TARGET(isa) void SubScaled##suffix(T *dst, T val, const T *src,      \
+                                                   size_t size) {                    \
+        SubScaledImpl<bytes>(dst, val, src, size);                                   \
+    }                                                                                \
+    template <typename T>                                                            \
+    MATRIX_SIMD_TARGET(isa) T Dot##suffix(const T *lhs, const T *rhs, size_t size) { \
+        return DotImpl<bytes>(lhs, rhs, size);                                       \
+    }
+
+#if defined(MATRIX_SIMD_X86)
+    MATRIX_SIMD_DEFINE_ISA(Avx512, "avx512f", 64)
+    MATRIX_SIMD_DEFINE_ISA(Avx2, "avx2", 32)
+    MATRIX_SIMD_DEFINE_ISA(Sse2, "sse2", 16)
+#endif
+
+#undef MATRIX_SIMD_DEFINE_ISA
+
+#if defined(MATRIX_SIMD_X86)
+#define MATRIX_SIMD_DISPATCH(name, ...)                \
+    switch (GetIsa()) {                                \
+    case Isa::Avx512: return name##Avx512(__VA_ARGS__); \
+    case Isa::Avx2: return name##Avx2(__VA_ARGS__);     \
+    case Isa::Sse2: return name##Sse2(__VA_ARGS__);     \
+    case Isa::Scalar: break;                           \
+    }
+#else
+#define MATRIX_SIMD_DISPATCH(name, ...)
+#endif
+
+    // Public entry points: vectorizable element types take the widest
+    // instruction set available, everything else runs the scalar loop.
+    template <typename T> void Add(T *dst, const T *src, size_t size) {
+        if constexpr (kIsVectorizable<T>) {
+            MATRIX_SIMD_DISPATCH(Add, dst, src, size)
+        }
+
+        for (size_t i = 0; i < size; ++i)
+            dst[i] += src[i];
+    }
+
+    template <typename T> void Sub(T *dst, const T *src, size_t size) {
+        if constexpr (kIsVectorizable<T>) {
+            MATRIX_SIMD_DISPATCH(Sub, dst, src, size)
+        }
+
+        for (size_t i = 0; i < size; ++i)
+            dst[i] -= src[i];
+    }
+
+    template <typename T> void Scale(T *dst, const T &val, size_t size) {
+        if constexpr (kIsVectorizable<T>) {
+            MATRIX_SIMD_DISPATCH(Scale, dst, val, size)
+        }
+
+        for (size_t i = 0; i < size; ++i)
+            dst[i] *= val;
+    }
+
+    template <typename T> void SubScaled(T *dst, const T &val, const T *src, size_t size) {
+        if constexpr (kIsVectorizable<T>) {
+            MATRIX_SIMD_DISPATCH(SubScaled, dst, val, src, size)
+        }
+
+        for (size_t i = 0; i < size; ++i)
+            dst[i] -= src[i] * val;
+    }
+
+    template <typename T> T Dot(const T *lhs, const T *rhs, size_t size) {
+        if constexpr (kIsVectorizable<T>) {
+            MATRIX_SIMD_DISPATCH(Dot, lhs, rhs, size)
+        }
+
+        T sum{};
+        for (size_t i = 0; i < size; ++i)
+            sum += lhs[i] * rhs[i];
+
+        return sum;
+    }
+} // namespace simd
+} // namespace details
+} // namespace matrix
@@ -0,0 +1,529 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <numeric>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "matrix.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
+
+// Sparse matrix in compressed sparse row (CSR) form: the column indices and
+// values of row i are at positions [GetRowOffsets()[i], GetRowOffsets()[i + 1])
+// of GetColumnIndices() and GetValues(), sorted by column. Transpose() gives
+// the compressed sparse column (CSC) form of the same matrix, since the CSR
+// arrays of the transpose are the CSC arrays of the original. Work and
+// memory are proportional to the stored entries, not to rows * columns.
+
+namespace matrix {
+template <typename T> struct Triplet {
+    size_t row;
+    size_t column;
+    T value;
+}; // struct Triplet
+
+namespace details {
+namespace sparse {
+    constexpr size_t kNone = SIZE_MAX;
+
+    // Rows below this many stored entries in total run on this thread.
+    constexpr size_t kParallelEntries = 1 << 15;
+
+    // Elimination order of minimum degree on the graph of A + A^T, the
+    // ordering AMD approximates. The graph is eliminated explicitly: the
+    // neighbours of an eliminated node become a clique, which is exactly
+    // the fill its elimination causes, and the node of least degree goes
+    // next. Ties go to the lower index, so the order is deterministic.
+    // nullopt once the graph holds more than max_fill adjacency entries.
+    inline std::optional<std::vector<size_t>> MinimumDegreeOrder(size_t size, const std::vector<size_t> &row_offsets,
+                                                                 const std::vector<size_t> &column_indices,
+                                                                 size_t max_fill = kNone) {
+        std::vector<std::vector<size_t>> adjacency(size);
+        for (size_t i = 0; i < size; ++i)
+            for (size_t p = row_offsets[i]; p < row_offsets[i + 1]; ++p) {
+                size_t j = column_indices[p];
+                if (i != j) {
+                    adjacency[i].push_back(j);
+                    adjacency[j].push_back(i);
+                }
+            }
+
+        std::set<std::pair<size_t, size_t>> queue; // (degree, node)
+        size_t fill = 0;
+        for (size_t v = 0; v < size; ++v) {
+            std::sort(adjacency[v].begin(), adjacency[v].end());
+            adjacency[v].erase(std::unique(adjacency[v].begin(), adjacency[v].end()), adjacency[v].end());
+            queue.emplace(adjacency[v].size(), v);
+            fill += adjacency[v].size();
+        }
+
+        std::vector<size_t> order;
+        std::vector<size_t> merged;
+        order.reserve(size);
+
+        while (!queue.empty()) {
+            size_t v = queue.begin()->second;
+            queue.erase(queue.begin());
+            order.push_back(v);
+
+            // v leaves the graph: each neighbour drops it from its degree
+            // and takes the other neighbours of v instead.
+            const std::vector<size_t> &neighbours = adjacency[v];
+            for (size_t u : neighbours) {
+                queue.erase({adjacency[u].size(), u});
+
+                merged.clear();
+                std::set_union(adjacency[u].begin(), adjacency[u].end(), neighbours.begin(), neighbours.end(),
+                               std::back_inserter(merged));
+                merged.erase(std::remove_if(merged.begin(), merged.end(), [&](size_t w) { return w == u || w == v; }),
+                             merged.end());
+                fill = fill - adjacency[u].size() + merged.size();
+                adjacency[u].swap(merged);
+
+                queue.emplace(adjacency[u].size(), u);
+            }
+
+            fill -= neighbours.size();
+            if (fill > max_fill)
+                return std::nullopt;
+
+            std::vector<size_t>().swap(adjacency[v]);
+        }
+
+        return order;
+    }
+
+    // +1 or -1, from the number of cycles of the permutation.
+    inline int PermutationSign(const std::vector<size_t> &permutation) {
+        std::vector<bool> is_visited(permutation.size(), false);
+        size_t parity = 0;
+
+        for (size_t start = 0; start < permutation.size(); ++start) {
+            if (is_visited[start])
+                continue;
+
+            size_t length = 0;
+            for (size_t i = start; !is_visited[i]; i = permutation[i], ++length)
+                is_visited[i] = true;
+
+            parity += length - 1;
+        }
+
+        return (parity % 2 == 0) ? 1 : -1;
+    }
+
+    // Left-looking sparse LU (Gilbert-Peierls) of A with its columns taken
+    // in the given order, returning det(A). Column k of L and U is the
+    // solution of a sparse triangular system with the columns of L found so
+    // far; a depth-first search over them finds the entries it can have, so
+    // the work follows the fill and not the size. The pivot is the largest
+    // candidate, except that the diagonal entry is kept when it is within
+    // kPivotThreshold of it, which preserves the fill-reducing order. Only
+    // the pivots of U are needed for the determinant, so U is not stored.
+    // nullopt once L holds more than max_fill entries.
+    template <typename T>
+    std::optional<T> LuDeterminant(size_t size, const std::vector<size_t> &column_offsets,
+                                   const std::vector<size_t> &row_indices, const std::vector<T> &values,
+                                   const std::vector<size_t> &order, size_t max_fill = kNone) {
+        constexpr T kPivotThreshold = T(0.1);
+
+        std::vector<size_t> l_offsets{0};
+        std::vector<size_t> l_rows;
+        std::vector<T> l_values;
+
+        std::vector<size_t> pivot_step(size, kNone); // step at which a row became a pivot
+        std::vector<size_t> row_of_step(size);
+        std::vector<T> x(size, T{});
+        std::vector<bool> is_marked(size, false);
+        std::vector<size_t> reach;                       // postorder of the search
+        std::vector<std::pair<size_t, size_t>> stack;    // (row, next child position)
+        T det = 1;
+
+        for (size_t k = 0; k < size; ++k) {
+            size_t column = order[k];
+
+            reach.clear();
+            for (size_t p = column_offsets[column]; p < column_offsets[column + 1]; ++p) {
+                size_t root = row_indices[p];
+                if (is_marked[root])
+                    continue;
+
+                is_marked[root] = true;
+                stack.emplace_back(root, (pivot_step[root] == kNone) ? 0 : l_offsets[pivot_step[root]]);
+                while (!stack.empty()) {
+                    auto &[row, next] = stack.back();
+                    size_t step = pivot_step[row];
+                    size_t end = (step == kNone) ? 0 : l_offsets[step + 1];
+
+                    if (next < end) {
+                        size_t child = l_rows[next++];
+                        if (!is_marked[child]) {
+                            is_marked[child] = true;
+                            size_t child_step = pivot_step[child];
+                            stack.emplace_back(child, (child_step == kNone) ? 0 : l_offsets[child_step]);
+                        }
+                        continue;
+                    }
+
+                    reach.push_back(row);
+                    stack.pop_back();
+                }
+            }
+
+            T scale = 0;
+            for (size_t p = column_offsets[column]; p < column_offsets[column + 1]; ++p) {
+                x[row_indices[p]] = values[p];
+                scale = std::max<T>(scale, std::fabs(values[p]));
+            }
+
+            // Reverse postorder is a topological order: every row is final
+            // before its L column is applied.
+            for (size_t r = reach.size(); r-- > 0;) {
+                size_t row = reach[r];
+                size_t step = pivot_step[row];
+                if (step == kNone)
+                    continue;
+
+                T coef = x[row];
+                for (size_t p = l_offsets[step]; p < l_offsets[step + 1]; ++p)
+                    x[l_rows[p]] -= l_values[p] * coef;
+            }
+
+            size_t pivot = kNone;
+            T max_elem = 0;
+            for (size_t row : reach)
+                if (pivot_step[row] == kNone && std::fabs(x[row]) > max_elem) {
+                    max_elem = std::fabs(x[row]);
+                    pivot = row;
+                }
+
+            if (pivot == kNone || max_elem <= structure::PivotTolerance(scale, size))
+                return T{};
+
+            if (pivot_step[column] == kNone && is_marked[column] && std::fabs(x[column]) >= kPivotThreshold * max_elem)
+                pivot = column;
+
+            T pivot_value = x[pivot];
+            det *= pivot_value;
+            pivot_step[pivot] = k;
+            row_of_step[k] = pivot;
+
+            for (size_t row : reach) {
+                if (pivot_step[row] == kNone && x[row] != T{}) {
+                    l_rows.push_back(row);
+                    l_values.push_back(x[row] / pivot_value);
+                }
+
+                x[row] = T{};
+                is_marked[row] = false;
+            }
+            l_offsets.push_back(l_rows.size());
+            if (l_rows.size() > max_fill)
+                return std::nullopt;
+        }
+
+        // P A Q = L U, so det(A) = sign(P) sign(Q) prod(diag U).
+        return det * static_cast<T>(PermutationSign(row_of_step) * PermutationSign(order));
+    }
+} // namespace sparse
+} // namespace details
+
+template <typename T> class SparseMatrix {
+    static_assert(std::is_arithmetic_v<T>, "SparseMatrix needs an arithmetic element type");
+
+public:
+    using value_type = T;
+
+    SparseMatrix() : row_offsets_(1, 0) {}
+
+    // Entries in any order; the values of repeated positions are summed,
+    // in the order they are given.
+    SparseMatrix(size_t row_count, size_t column_count, std::vector<Triplet<T>> triplets)
+        : row_count_(row_count), column_count_(column_count), row_offsets_(row_count + 1, 0) {
+        for (const Triplet<T> &triplet : triplets)
+            if (triplet.row >= row_count || triplet.column >= column_count)
+                throw std::range_error("Triplet index is out of the matrix");
+
+        std::stable_sort(triplets.begin(), triplets.end(), [](const Triplet<T> &lhs, const Triplet<T> &rhs) {
+            return (lhs.row != rhs.row) ? lhs.row < rhs.row : lhs.column < rhs.column;
+        });
+
+        for (size_t p = 0; p < triplets.size(); ++p) {
+            const Triplet<T> &triplet = triplets[p];
+            if (p > 0 && triplet.row == triplets[p - 1].row && triplet.column == triplets[p - 1].column) {
+                values_.back() += triplet.value;
+                continue;
+            }
+
+            column_indices_.push_back(triplet.column);
+            values_.push_back(triplet.value);
+            ++row_offsets_[triplet.row + 1];
+        }
+
+        std::partial_sum(row_offsets_.begin(), row_offsets_.end(), row_offsets_.begin());
+    }
+
+    // The nonzero entries of a dense matrix; exact zeros are not stored.
+    explicit SparseMatrix(ConstMatrixView<T> dense)
+        : row_count_(dense.GetRowCount()), column_count_(dense.GetColumnCount()), row_offsets_(1, 0) {
+        row_offsets_.reserve(row_count_ + 1);
+        for (size_t i = 0; i < row_count_; ++i) {
+            for (size_t j = 0; j < column_count_; ++j) {
+                T value = dense.Eval(i, j);
+                if (value != T{}) {
+                    column_indices_.push_back(j);
+                    values_.push_back(value);
+                }
+            }
+
+            row_offsets_.push_back(values_.size());
+        }
+    }
+
+    explicit SparseMatrix(const Matrix<T> &dense) : SparseMatrix(dense.View()) {}
+
+    size_t GetRowCount() const { return row_count_; }
+    size_t GetColumnCount() const { return column_count_; }
+    size_t GetNonZeroCount() const { return values_.size(); }
+
+    // Stored entries over rows * columns.
+    double GetDensity() const {
+        size_t size = row_count_ * column_count_;
+        return (size == 0) ? 0.0 : static_cast<double>(values_.size()) / static_cast<double>(size);
+    }
+
+    const std::vector<size_t> &GetRowOffsets() const { return row_offsets_; }
+    const std::vector<size_t> &GetColumnIndices() const { return column_indices_; }
+    const std::vector<T> &GetValues() const { return values_; }
+
+    T operator()(size_t num_row, size_t num_col) const {
+        if (num_row >= row_count_ || num_col >= column_count_)
+            throw std::range_error("Sparse matrix index is out of range");
+
+        auto begin = column_indices_.begin() + row_offsets_[num_row];
+        auto end = column_indices_.begin() + row_offsets_[num_row + 1];
+        auto it = std::lower_bound(begin, end, num_col);
+        return (it != end && *it == num_col) ? values_[it - column_indices_.begin()] : T{};
+    }
+
+    Matrix<T> ToMatrix() const {
+        std::vector<T> dense(row_count_ * column_count_, T{});
+        for (size_t i = 0; i < row_count_; ++i)
+            for (size_t p = row_offsets_[i]; p < row_offsets_[i + 1]; ++p)
+                dense[i * column_count_ + column_indices_[p]] = values_[p];
+
+        return Matrix<T>(row_count_, column_count_, dense.begin(), dense.end());
+    }
+
+    // Counting sort of the entries by column.
+    SparseMatrix Transpose() const {
+        SparseMatrix transpose;
+        transpose.row_count_ = column_count_;
+        transpose.column_count_ = row_count_;
+        transpose.row_offsets_.assign(column_count_ + 1, 0);
+        transpose.column_indices_.resize(values_.size());
+        transpose.values_.resize(values_.size());
+
+        for (size_t column : column_indices_)
+            ++transpose.row_offsets_[column + 1];
+        std::partial_sum(transpose.row_offsets_.begin(), transpose.row_offsets_.end(), transpose.row_offsets_.begin());
+
+        std::vector<size_t> next(transpose.row_offsets_.begin(), transpose.row_offsets_.end() - 1);
+        for (size_t i = 0; i < row_count_; ++i)
+            for (size_t p = row_offsets_[i]; p < row_offsets_[i + 1]; ++p) {
+                size_t q = next[column_indices_[p]]++;
+                transpose.column_indices_[q] = i;
+                transpose.values_[q] = values_[p];
+            }
+
+        return transpose;
+    }
+
+    // y = A x.
+    std::vector<T> Multiply(const std::vector<T> &x) const {
+        if (x.size() != column_count_)
+            throw std::logic_error("Vector size does not match the matrix");
+
+        std::vector<T> y(row_count_, T{});
+        ForEachRowRange([&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                T sum{};
+                for (size_t p = row_offsets_[i]; p < row_offsets_[i + 1]; ++p)
+                    sum += values_[p] * x[column_indices_[p]];
+                y[i] = sum;
+            }
+        }, 1);
+
+        return y;
+    }
+
+    // Sparse times dense: row i of the result sums the rows of dense picked
+    // by the entries of row i, each one a vector update.
+    template <typename E> requires std::is_same_v<std::remove_const_t<E>, T>
+    Matrix<T> Multiply(const MatrixView<E> &dense) const {
+        if (column_count_ != dense.GetRowCount())
+            throw std::logic_error("Matrixes sizes do not valid for multiply");
+
+        size_t width = dense.GetColumnCount();
+        Matrix<T> result(row_count_, width);
+        T *data = result.GetData();
+        std::fill(data, data + row_count_ * width, T{});
+
+        ForEachRowRange([&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+                for (size_t p = row_offsets_[i]; p < row_offsets_[i + 1]; ++p) {
+                    const T *src = dense.GetData() + column_indices_[p] * dense.GetRowStride();
+                    T *dst = data + i * width;
+
+                    if (dense.GetColumnStride() == 1) {
+                        simd::SubScaled(dst, T(-values_[p]), src, width);
+                        continue;
+                    }
+
+                    for (size_t j = 0; j < width; ++j)
+                        dst[j] += values_[p] * src[j * dense.GetColumnStride()];
+                }
+        }, width);
+
+        return result;
+    }
+
+    Matrix<T> Multiply(const Matrix<T> &dense) const { return Multiply(dense.View()); }
+
+    // Gustavson's row-by-row product. A symbolic pass counts the entries of
+    // each result row, so the numeric pass writes every row in place.
+    SparseMatrix Multiply(const SparseMatrix &other) const {
+        if (column_count_ != other.row_count_)
+            throw std::logic_error("Matrixes sizes do not valid for multiply");
+
+        SparseMatrix result;
+        result.row_count_ = row_count_;
+        result.column_count_ = other.column_count_;
+        result.row_offsets_.assign(row_count_ + 1, 0);
+
+        ForEachRowRange([&](size_t begin, size_t end) {
+            std::vector<size_t> marker(other.column_count_, details::sparse::kNone);
+            for (size_t i = begin; i < end; ++i)
+                for (size_t p = row_offsets_[i]; p < row_offsets_[i + 1]; ++p) {
+                    size_t k = column_indices_[p];
+                    for (size_t q = other.row_offsets_[k]; q < other.row_offsets_[k + 1]; ++q)
+                        if (marker[other.column_indices_[q]] != i) {
+                            marker[other.column_indices_[q]] = i;
+                            ++result.row_offsets_[i + 1];
+                        }
+                }
+        }, 1);
+
+        std::partial_sum(result.row_offsets_.begin(), result.row_offsets_.end(), result.row_offsets_.begin());
+        result.column_indices_.resize(result.row_offsets_.back());
+        result.values_.resize(result.row_offsets_.back());
+
+        ForEachRowRange([&](size_t begin, size_t end) {
+            std::vector<size_t> marker(other.column_count_, details::sparse::kNone);
+            std::vector<T> accumulator(other.column_count_);
+
+            for (size_t i = begin; i < end; ++i) {
+                size_t *columns = result.column_indices_.data() + result.row_offsets_[i];
+                size_t count = 0;
+
+                for (size_t p = row_offsets_[i]; p < row_offsets_[i + 1]; ++p) {
+                    size_t k = column_indices_[p];
+                    for (size_t q = other.row_offsets_[k]; q < other.row_offsets_[k + 1]; ++q) {
+                        size_t j = other.column_indices_[q];
+                        T product = values_[p] * other.values_[q];
+
+                        if (marker[j] != i) {
+                            marker[j] = i;
+                            accumulator[j] = product;
+                            columns[count++] = j;
+                        } else {
+                            accumulator[j] += product;
+                        }
+                    }
+                }
+
+                std::sort(columns, columns + count);
+                for (size_t c = 0; c < count; ++c)
+                    result.values_[result.row_offsets_[i] + c] = accumulator[columns[c]];
+            }
+        }, 1);
+
+        return result;
+    }
+
+    // Sparse LU after a minimum degree ordering; see details::sparse.
+    T GetDeterminant() const { return *TryGetDeterminant(details::sparse::kNone); }
+
+    // As GetDeterminant, but gives up with nullopt as soon as the ordering
+    // graph or the L factor holds more than max_fill entries: past some
+    // fill the dense elimination is the faster one.
+    std::optional<T> TryGetDeterminant(size_t max_fill) const {
+        static_assert(std::is_floating_point_v<T>, "Sparse determinant needs a floating point element type");
+
+        if (row_count_ != column_count_)
+            throw std::logic_error(
+                "Matrix rows and columns counts is not equal");
+
+        if (row_count_ == 0)
+            throw std::logic_error("Matrix is empty");
+
+        std::optional<std::vector<size_t>> order =
+            details::sparse::MinimumDegreeOrder(row_count_, row_offsets_, column_indices_, max_fill);
+        if (!order)
+            return std::nullopt;
+
+        SparseMatrix columns = Transpose();
+        return details::sparse::LuDeterminant(row_count_, columns.row_offsets_, columns.column_indices_,
+                                              columns.values_, *order, max_fill);
+    }
+
+    void print() const {
+        std::cout << "SparseMatrix:" << std::endl;
+
+        for (size_t i = 0; i < row_count_; ++i) {
+            for (size_t p = row_offsets_[i]; p < row_offsets_[i + 1]; ++p)
+                std::cout << "(" << column_indices_[p] << ", " << values_[p] << ") ";
+
+            std::cout << std::endl;
+        }
+    }
+private:
+    // Splits the rows over the thread pool once the stored entries, each
+    // weighted by the work it costs, are worth it; a chunk holds about
+    // kParallelEntries of that work on average.
+    template <typename Body> void ForEachRowRange(Body &&body, size_t entry_cost) const {
+        if (values_.size() * entry_cost < details::sparse::kParallelEntries) {
+            body(0, row_count_);
+            return;
+        }
+
+        size_t grain = std::max<size_t>(row_count_ * details::sparse::kParallelEntries /
+                                            (values_.size() * entry_cost), 1);
+        details::GetThreadPool().ParallelFor(0, row_count_, grain, body);
+    }
+
+    size_t row_count_ = 0;
+    size_t column_count_ = 0;
+    std::vector<size_t> row_offsets_;
+    std::vector<size_t> column_indices_;
+    std::vector<T> values_;
+}; // class SparseMatrix
+
+template <typename T> Matrix<T> operator*(const SparseMatrix<T> &lhs, const Matrix<T> &rhs) {
+    return lhs.Multiply(rhs);
+}
+
+template <typename T> SparseMatrix<T> operator*(const SparseMatrix<T> &lhs, const SparseMatrix<T> &rhs) {
+    return lhs.Multiply(rhs);
+}
+} // namespace matrix
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+
+#include "allocator.hpp"
+#include "gemm.hpp"
+#include "instrumentation.hpp"
+
+// Strassen-Winograd multiplication: 7 half-size products and 15 additions
+// per level instead of 8 products, down to the packed GEMM below a
+// crossover size. The operation order follows the schedule of Boyer,
+// Dumas, Pernet and Zhou, which keeps every intermediate in the quadrants
+// of C plus two temporaries per level, so one workspace of about
+// (m k + k n + m n) / 3 elements, allocated up front, serves the whole
+// recursion. Odd dimensions are peeled: the even part recurses and the
+// last row, column and inner index are added by thin GEMM calls.
+//
+// The error bound grows with the recursion depth, so floating point types
+// only take this path in MultiplyMode::Strassen. Integer products are
+// exact either way and always take it.
+
+namespace matrix {
+namespace details {
+    inline std::atomic<size_t> strassen_crossover{512};
+} // namespace details
+
+// Products recurse while all their dimensions are at least this large.
+inline void SetStrassenCrossover(size_t size) { details::strassen_crossover.store(std::max<size_t>(size, 2)); }
+
+inline size_t GetStrassenCrossover() { return details::strassen_crossover.load(); }
+
+namespace details {
+namespace strassen {
+    // Workspace elements for the whole recursion of an m x k by k x n product.
+    inline size_t WorkspaceSize(size_t m, size_t k, size_t n, size_t crossover) {
+        size_t size = 0;
+        for (; std::min({m, k, n}) >= crossover; m /= 2, k /= 2, n /= 2)
+            size += m / 2 * std::max(k / 2, n / 2) + k / 2 * n / 2;
+
+        return size;
+    }
+
+    // dst = lhs + rhs or dst = lhs - rhs over a rows x cols block; dst may
+    // be either operand.
+    template <typename T>
+    void Combine(size_t rows, size_t cols, T *dst, size_t rs_dst, const T *lhs, size_t rs_lhs,
+                 const T *rhs, size_t rs_rhs, bool subtract) {
+        for (size_t i = 0; i < rows; ++i, dst += rs_dst, lhs += rs_lhs, rhs += rs_rhs) {
+            if (subtract)
+                for (size_t j = 0; j < cols; ++j)
+                    dst[j] = lhs[j] - rhs[j];
+            else
+                for (size_t j = 0; j < cols; ++j)
+                    dst[j] = lhs[j] + rhs[j];
+        }
+    }
+
+    // C = A * B for row-major operands (column stride 1).
+    template <typename T>
+    void Multiply(size_t m, size_t k, size_t n, const T *a, size_t rs_a, const T *b, size_t rs_b,
+                  T *c, size_t rs_c, T *work, size_t crossover) {
+        if (std::min({m, k, n}) < crossover) {
+            Gemm(m, n, k, T{1}, a, rs_a, size_t{1}, b, rs_b, size_t{1}, false, c, rs_c, size_t{1});
+            return;
+        }
+
+        size_t m2 = m / 2;
+        size_t k2 = k / 2;
+        size_t n2 = n / 2;
+
+        const T *a11 = a;
+        const T *a12 = a + k2;
+        const T *a21 = a + m2 * rs_a;
+        const T *a22 = a21 + k2;
+        const T *b11 = b;
+        const T *b12 = b + n2;
+        const T *b21 = b + k2 * rs_b;
+        const T *b22 = b21 + n2;
+        T *c11 = c;
+        T *c12 = c + n2;
+        T *c21 = c + m2 * rs_c;
+        T *c22 = c21 + n2;
+
+        // x holds an m2 x k2 sum of A blocks and later the m2 x n2 product
+        // P1; y holds a k2 x n2 sum of B blocks.
+        T *x = work;
+        T *y = x + m2 * std::max(k2, n2);
+        T *next = y + k2 * n2;
+
+        Combine(m2, k2, x, k2, a11, rs_a, a21, rs_a, true);         // S3 = A11 - A21
+        Combine(k2, n2, y, n2, b22, rs_b, b12, rs_b, true);         // T3 = B22 - B12
+        Multiply(m2, k2, n2, x, k2, y, n2, c21, rs_c, next, crossover); // P7 = S3 T3
+        Combine(m2, k2, x, k2, a21, rs_a, a22, rs_a, false);        // S1 = A21 + A22
+        Combine(k2, n2, y, n2, b12, rs_b, b11, rs_b, true);         // T1 = B12 - B11
+        Multiply(m2, k2, n2, x, k2, y, n2, c22, rs_c, next, crossover); // P5 = S1 T1
+        Combine(m2, k2, x, k2, x, k2, a11, rs_a, true);             // S2 = S1 - A11
+        Combine(k2, n2, y, n2, b22, rs_b, y, n2, true);             // T2 = B22 - T1
+        Multiply(m2, k2, n2, x, k2, y, n2, c12, rs_c, next, crossover); // P6 = S2 T2
+        Combine(m2, k2, x, k2, a12, rs_a, x, k2, true);             // S4 = A12 - S2
+        Multiply(m2, k2, n2, x, k2, b22, rs_b, c11, rs_c, next, crossover); // P3 = S4 B22
+        Multiply(m2, k2, n2, a11, rs_a, b11, rs_b, x, n2, next, crossover); // P1 = A11 B11
+        Combine(m2, n2, c12, rs_c, x, n2, c12, rs_c, false);        // U2 = P1 + P6
+        Combine(m2, n2, c21, rs_c, c12, rs_c, c21, rs_c, false);    // U3 = U2 + P7
+        Combine(m2, n2, c12, rs_c, c12, rs_c, c22, rs_c, false);    // U4 = U2 + P5
+        Combine(m2, n2, c22, rs_c, c21, rs_c, c22, rs_c, false);    // U7 = U3 + P5 = C22
+        Combine(m2, n2, c12, rs_c, c12, rs_c, c11, rs_c, false);    // U5 = U4 + P3 = C12
+        Combine(k2, n2, y, n2, y, n2, b21, rs_b, true);             // T4 = T2 - B21
+        Multiply(m2, k2, n2, a22, rs_a, y, n2, c11, rs_c, next, crossover); // P4 = A22 T4
+        Combine(m2, n2, c21, rs_c, c21, rs_c, c11, rs_c, true);     // U6 = U3 - P4 = C21
+        Multiply(m2, k2, n2, a12, rs_a, b21, rs_b, c11, rs_c, next, crossover); // P2 = A12 B21
+        Combine(m2, n2, c11, rs_c, c11, rs_c, x, n2, false);        // U1 = P1 + P2 = C11
+
+        // Peeling: the odd inner index is a rank-one update of the even
+        // block, the odd column and row are products of their own.
+        size_t m_even = 2 * m2;
+        size_t k_even = 2 * k2;
+        size_t n_even = 2 * n2;
+        if (k_even != k)
+            Gemm(m_even, n_even, size_t{1}, T{1}, a + k_even, rs_a, size_t{1}, b + k_even * rs_b, rs_b, size_t{1},
+                 true, c, rs_c, size_t{1});
+        if (n_even != n)
+            Gemm(m_even, size_t{1}, k, T{1}, a, rs_a, size_t{1}, b + n_even, rs_b, size_t{1}, false, c + n_even,
+                 rs_c, size_t{1});
+        if (m_even != m)
+            Gemm(size_t{1}, n, k, T{1}, a + m_even * rs_a, rs_a, size_t{1}, b, rs_b, size_t{1}, false,
+                 c + m_even * rs_c, rs_c, size_t{1});
+    }
+} // namespace strassen
+
+    template <typename T>
+    constexpr bool kHasStrassen = (std::is_integral_v<T> && !std::is_same_v<T, bool>) || std::is_floating_point_v<T>;
+
+    template <typename T> bool UseStrassen(size_t m, size_t n, size_t k) {
+        if (std::is_floating_point_v<T> && GetMultiplyMode() != MultiplyMode::Strassen)
+            return false;
+
+        return std::min({m, n, k}) >= GetStrassenCrossover();
+    }
+
+    // Same contract as Gemm. Plain row-major products C = A * B that are
+    // large enough go through Strassen-Winograd; everything else, and
+    // every product in the other multiply modes, through the packed GEMM.
+    template <typename T>
+    void Multiply(size_t m, size_t n, size_t k, T alpha,
+                  const T *a, size_t rs_a, size_t cs_a,
+                  const T *b, size_t rs_b, size_t cs_b,
+                  bool accumulate, T *c, size_t rs_c, size_t cs_c) {
+        if constexpr (kHasStrassen<T>) {
+            if (alpha == T{1} && !accumulate && cs_a == 1 && cs_b == 1 && cs_c == 1 && UseStrassen<T>(m, n, k)) {
+                // The sums of blocks may leave the range of a signed type
+                // even when the result does not. Unsigned arithmetic wraps
+                // instead, and the wrapped result is the exact one whenever
+                // that fits.
+                using U = std::conditional_t<std::is_integral_v<T>, std::make_unsigned<T>, std::type_identity<T>>::type;
+                // Counted as the classical product, for rates comparable
+                // across the crossover.
+                MATRIX_COUNT(Flops, 2 * m * n * k);
+                size_t crossover = GetStrassenCrossover();
+                AlignedBuffer<U> work(strassen::WorkspaceSize(m, k, n, crossover), GetScratchResource());
+                strassen::Multiply(m, k, n, reinterpret_cast<const U *>(a), rs_a, reinterpret_cast<const U *>(b),
+                                   rs_b, reinterpret_cast<U *>(c), rs_c, work.data(), crossover);
+                return;
+            }
+        }
+
+        Gemm(m, n, k, alpha, a, rs_a, cs_a, b, rs_b, cs_b, accumulate, c, rs_c, cs_c);
+    }
+} // namespace details
+} // namespace matrix
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <utility>
+
+#include "allocator.hpp"
+#include "simd.hpp"
+
+// Cheap structure detection for square matrices and the determinant
+// kernels that exploit it. Detection reads the matrix once at most and
+// stops at the first entry that rules a structure out, so a general dense
+// matrix costs a few rows. The kernels read the matrix through an
+// element(i, j) callable and report pivots to a product object through
+// Multiply, so that the dense determinant and the packed types of
+// structured_matrix.hpp share them.
+
+namespace matrix {
+// Bandwidths of a square matrix: every non-zero a_ij has i - j at most
+// lower_bandwidth and j - i at most upper_bandwidth.
+struct MatrixStructure {
+    size_t size = 0;
+    size_t lower_bandwidth = 0;
+    size_t upper_bandwidth = 0;
+    bool is_symmetric = false;
+
+    bool IsDiagonal() const { return lower_bandwidth == 0 && upper_bandwidth == 0; }
+    bool IsUpperTriangular() const { return lower_bandwidth == 0; }
+    bool IsLowerTriangular() const { return upper_bandwidth == 0; }
+    bool IsTriangular() const { return IsUpperTriangular() || IsLowerTriangular(); }
+}; // struct MatrixStructure
+
+namespace details {
+namespace structure {
+    // Band LU pays n (kl + 1) (2 kl + ku + 1) operations against n^3 / 3
+    // for dense elimination; it is taken while kl + ku stays below
+    // n / kBandRatio.
+    constexpr size_t kBandRatio = 8;
+
+    // Bandwidths of the size x size matrix with rows stride elements apart.
+    // Once one exceeds limit it is reported as size and no longer scanned.
+    template <typename T>
+    std::pair<size_t, size_t> Bandwidths(const T *data, size_t size, size_t stride, size_t limit) {
+        size_t lower = 0;
+        size_t upper = 0;
+
+        for (size_t i = 0; i < size && (lower <= limit || upper <= limit); ++i) {
+            const T *row = data + i * stride;
+
+            if (lower <= limit)
+                for (size_t j = 0; j + lower < i; ++j)
+                    if (row[j] != T{}) {
+                        lower = i - j;
+                        break;
+                    }
+
+            if (upper <= limit)
+                for (size_t j = size; j-- > i + upper + 1;)
+                    if (row[j] != T{}) {
+                        upper = j - i;
+                        break;
+                    }
+        }
+
+        return {(lower > limit) ? size : lower, (upper > limit) ? size : upper};
+    }
+
+    template <typename T> bool IsSymmetric(const T *data, size_t size, size_t stride) {
+        for (size_t i = 1; i < size; ++i)
+            for (size_t j = 0; j < i; ++j)
+                if (data[i * stride + j] != data[j * stride + i])
+                    return false;
+
+        return true;
+    }
+
+    template <typename T>
+    MatrixStructure Detect(const T *data, size_t size, size_t stride, size_t limit) {
+        MatrixStructure structure;
+        structure.size = size;
+        std::tie(structure.lower_bandwidth, structure.upper_bandwidth) = Bandwidths(data, size, stride, limit);
+        // A diagonal matrix is symmetric and no other triangular one is.
+        structure.is_symmetric = structure.lower_bandwidth == structure.upper_bandwidth &&
+                                 (structure.IsDiagonal() || IsSymmetric(data, size, stride));
+        return structure;
+    }
+
+    // Largest bandwidth sum that is still worth the band kernels.
+    inline size_t BandLimit(size_t size) { return size / kBandRatio; }
+
+    // Magnitude up to which a pivot counts as zero in every elimination:
+    // size rounding errors on the largest entry of the pivot's column in
+    // the input. Scaling a column scales the determinant and its
+    // tolerance alike, so no scaling of a regular matrix makes it singular.
+    template <typename T> T PivotTolerance(T column_scale, size_t size) {
+        return static_cast<T>(size) * std::numeric_limits<T>::epsilon() * column_scale;
+    }
+
+
+    // Gaussian elimination with partial pivoting inside the band. Row i is
+    // kept as the window of columns [i - kl, i + kl + ku], wide enough for
+    // the fill that row swaps bring; a row moved from position p to i has
+    // its non-zeros in columns [i, i + kl + ku], inside both windows, so a
+    // swap exchanges just that range. The pivots go to det; false when no
+    // pivot exceeds the tolerance of its column, the matrix being singular.
+    template <typename T, typename Element, typename Product>
+    bool BandDeterminant(size_t size, size_t kl, size_t ku, Element &&element, const T *tolerances, Product &det) {
+        size_t width = 2 * kl + ku + 1;
+        AlignedBuffer<T> band(size * width, GetScratchResource());
+        T *rows = band.data();
+        auto at = [&](size_t row, size_t col) -> T & { return rows[row * width + (col + kl - row)]; };
+
+        for (size_t i = 0; i < size; ++i) {
+            std::fill(rows + i * width, rows + (i + 1) * width, T{});
+            size_t first = (i > kl) ? i - kl : 0;
+            size_t last = std::min(size - 1, i + ku);
+            for (size_t j = first; j <= last; ++j)
+                at(i, j) = element(i, j);
+        }
+
+        int sign = 1;
+        for (size_t i = 0; i < size; ++i) {
+            size_t last_row = std::min(size - 1, i + kl);
+            size_t last_col = std::min(size - 1, i + kl + ku);
+
+            size_t pivot = i;
+            for (size_t r = i + 1; r <= last_row; ++r)
+                if (std::fabs(at(r, i)) > std::fabs(at(pivot, i)))
+                    pivot = r;
+
+            if (std::fabs(at(pivot, i)) <= tolerances[i])
+                return false;
+
+            if (pivot != i) {
+                std::swap_ranges(&at(i, i), &at(i, i) + (last_col - i + 1), &at(pivot, i));
+                sign = -sign;
+            }
+
+            const T *pivot_row = &at(i, i);
+            det.Multiply(pivot_row[0]);
+            for (size_t r = i + 1; r <= last_row; ++r) {
+                T *row = &at(r, i);
+                if (row[0] != T{})
+                    simd::SubScaled(row + 1, row[0] / pivot_row[0], pivot_row + 1, last_col - i);
+            }
+        }
+
+        det.Multiply(static_cast<T>(sign));
+        return true;
+    }
+
+    // LDL^T of a symmetric matrix, row by row in packed lower storage: row
+    // i holds L_i0 .. L_i,i-1 and then d_i, and each entry takes one dot
+    // product of two row prefixes, n^3 / 6 multiply-adds in all. Without
+    // pivoting it is only stable for positive definite matrices, so it
+    // stops with false at the first pivot not above the tolerance of its
+    // column, leaving the matrix to a pivoting elimination; the pivots go
+    // to det otherwise.
+    template <typename T, typename Element, typename Product>
+    bool LdltDeterminant(size_t size, Element &&element, const T *tolerances, Product &det) {
+        AlignedBuffer<T> packed(size * (size + 1) / 2, GetScratchResource());
+        AlignedBuffer<T> scaled(size, GetScratchResource());
+        T *w = scaled.data();
+
+        for (size_t i = 0; i < size; ++i) {
+            T *l_i = packed.data() + i * (i + 1) / 2;
+
+            for (size_t j = 0; j < i; ++j) {
+                const T *l_j = packed.data() + j * (j + 1) / 2;
+                // w_j = L_ij d_j, the row of L D in progress.
+                w[j] = element(i, j) - simd::Dot(w, l_j, j);
+                l_i[j] = w[j] / l_j[j];
+            }
+
+            T d = element(i, i) - simd::Dot(w, l_i, i);
+            if (!(d > tolerances[i]))
+                return false;
+
+            l_i[i] = d;
+        }
+
+        for (size_t i = 0; i < size; ++i)
+            det.Multiply(packed.data()[i * (i + 1) / 2 + i]);
+
+        return true;
+    }
+} // namespace structure
+} // namespace details
+} // namespace matrix
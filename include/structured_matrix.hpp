@@ -0,0 +1,467 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "matrix.hpp"
+#include "simd.hpp"
+#include "structure.hpp"
+
+// Packed storage for structured square matrices: the diagonal alone, one
+// triangle, a band of rows, or the lower half of a symmetric matrix. Each
+// keeps only the entries its structure allows and computes determinants
+// and products against dense matrices in time proportional to them:
+// O(n) for a diagonal, O(n^2) for a triangle, O(n k^2) for a band of
+// width k and an n^3 / 6 LDL^T for a positive definite symmetric matrix.
+// DetectStructure says which one a dense matrix fits.
+
+namespace matrix {
+// Bandwidths and symmetry of a square view, found in one pass that stops
+// as soon as each property is ruled out.
+template <typename T> MatrixStructure DetectStructure(const ConstMatrixView<T> &view) {
+    if (view.GetRowCount() != view.GetColumnCount())
+        throw std::logic_error("Matrix rows and columns counts is not equal");
+
+    size_t size = view.GetRowCount();
+    if (view.GetColumnStride() != 1) {
+        Matrix<T> copy(view);
+        return details::structure::Detect(copy.GetData(), size, size, size);
+    }
+
+    return details::structure::Detect(view.GetData(), size, view.GetRowStride(), size);
+}
+
+template <typename T> MatrixStructure DetectStructure(const Matrix<T> &matrix) {
+    return DetectStructure(matrix.View());
+}
+
+namespace details {
+namespace structure {
+    // Product of the diagonal entries: a ScaledProduct for floating point
+    // types, exact for integers, where std::range_error reports a result
+    // that does not fit T. A zero entry makes it 0 whatever the partial
+    // products before it, so it is looked for first.
+    template <typename T, typename Diagonal> T DiagonalDeterminant(size_t size, Diagonal &&diagonal) {
+        if constexpr (std::is_floating_point_v<T>) {
+            details::ScaledProduct<T> det;
+            for (size_t i = 0; i < size; ++i)
+                det.Multiply(diagonal(i));
+
+            return det.Get();
+        } else {
+            for (size_t i = 0; i < size; ++i)
+                if (diagonal(i) == T{})
+                    return T{};
+
+            T det = 1;
+            for (size_t i = 0; i < size; ++i)
+                if (__builtin_mul_overflow(det, diagonal(i), &det))
+                    throw std::range_error("Determinant does not fit the element type");
+
+            return det;
+        }
+    }
+
+    template <typename T> Matrix<T> Zeros(size_t row_count, size_t column_count) {
+        Matrix<T> result(row_count, column_count);
+        std::fill(result.GetData(), result.GetData() + row_count * column_count, T{});
+        return result;
+    }
+
+    template <typename T> void CheckMultiply(size_t size, const Matrix<T> &rhs) {
+        if (size != rhs.GetRowCount())
+            throw std::logic_error("Matrixes sizes do not valid for multiply");
+    }
+} // namespace structure
+} // namespace details
+
+template <typename T> class DiagonalMatrix {
+    static_assert(std::is_arithmetic_v<T>, "DiagonalMatrix needs an arithmetic element type");
+
+public:
+    using value_type = T;
+
+    explicit DiagonalMatrix(std::vector<T> diagonal) : diagonal_(std::move(diagonal)) {}
+
+    // The diagonal of a dense matrix, which must have nothing else.
+    explicit DiagonalMatrix(const ConstMatrixView<T> &dense) {
+        if (!DetectStructure(dense).IsDiagonal())
+            throw std::logic_error("Matrix is not diagonal");
+
+        for (size_t i = 0; i < dense.GetRowCount(); ++i)
+            diagonal_.push_back(dense.Eval(i, i));
+    }
+
+    size_t GetSize() const { return diagonal_.size(); }
+
+    const std::vector<T> &GetDiagonal() const { return diagonal_; }
+
+    T operator()(size_t num_row, size_t num_col) const {
+        if (num_row >= GetSize() || num_col >= GetSize())
+            throw std::range_error("Matrix index is out of range");
+
+        return (num_row == num_col) ? diagonal_[num_row] : T{};
+    }
+
+    Matrix<T> ToMatrix() const {
+        Matrix<T> dense = details::structure::Zeros<T>(GetSize(), GetSize());
+        for (size_t i = 0; i < GetSize(); ++i)
+            dense.GetData()[i * GetSize() + i] = diagonal_[i];
+
+        return dense;
+    }
+
+    T GetDeterminant() const {
+        if (diagonal_.empty())
+            throw std::logic_error("Matrix is empty");
+
+        return details::structure::DiagonalDeterminant<T>(GetSize(), [this](size_t i) { return diagonal_[i]; });
+    }
+
+    // D * B scales the rows of B, B * D its columns.
+    Matrix<T> Multiply(const Matrix<T> &rhs) const {
+        details::structure::CheckMultiply(GetSize(), rhs);
+
+        Matrix<T> result = rhs;
+        size_t width = rhs.GetColumnCount();
+        for (size_t i = 0; i < GetSize(); ++i)
+            details::simd::Scale(result.GetData() + i * width, diagonal_[i], width);
+
+        return result;
+    }
+
+    Matrix<T> MultiplyLeft(const Matrix<T> &lhs) const {
+        if (lhs.GetColumnCount() != GetSize())
+            throw std::logic_error("Matrixes sizes do not valid for multiply");
+
+        Matrix<T> result = lhs;
+        for (size_t i = 0; i < lhs.GetRowCount(); ++i) {
+            T *row = result.GetData() + i * GetSize();
+            for (size_t j = 0; j < GetSize(); ++j)
+                row[j] *= diagonal_[j];
+        }
+
+        return result;
+    }
+
+    DiagonalMatrix Multiply(const DiagonalMatrix &rhs) const {
+        if (GetSize() != rhs.GetSize())
+            throw std::logic_error("Matrixes sizes do not valid for multiply");
+
+        std::vector<T> diagonal = diagonal_;
+        for (size_t i = 0; i < GetSize(); ++i)
+            diagonal[i] *= rhs.diagonal_[i];
+
+        return DiagonalMatrix(std::move(diagonal));
+    }
+private:
+    std::vector<T> diagonal_;
+}; // class DiagonalMatrix
+
+enum class Triangle { Lower, Upper };
+
+// One triangle, diagonal included, packed row by row: row i of an upper
+// matrix holds columns i .. n - 1, row i of a lower one columns 0 .. i.
+template <typename T> class TriangularMatrix {
+    static_assert(std::is_arithmetic_v<T>, "TriangularMatrix needs an arithmetic element type");
+
+public:
+    using value_type = T;
+
+    TriangularMatrix(const ConstMatrixView<T> &dense, Triangle triangle)
+        : size_(dense.GetRowCount()), triangle_(triangle) {
+        MatrixStructure structure = DetectStructure(dense);
+        if ((triangle == Triangle::Upper) ? !structure.IsUpperTriangular() : !structure.IsLowerTriangular())
+            throw std::logic_error("Matrix is not triangular");
+
+        values_.reserve(size_ * (size_ + 1) / 2);
+        for (size_t i = 0; i < size_; ++i)
+            for (size_t j = GetFirst(i); j < GetLast(i); ++j)
+                values_.push_back(dense.Eval(i, j));
+    }
+
+    size_t GetSize() const { return size_; }
+    Triangle GetTriangle() const { return triangle_; }
+
+    T operator()(size_t num_row, size_t num_col) const {
+        if (num_row >= size_ || num_col >= size_)
+            throw std::range_error("Matrix index is out of range");
+
+        if (num_col < GetFirst(num_row) || num_col >= GetLast(num_row))
+            return T{};
+
+        return GetRow(num_row)[num_col - GetFirst(num_row)];
+    }
+
+    Matrix<T> ToMatrix() const {
+        Matrix<T> dense = details::structure::Zeros<T>(size_, size_);
+        for (size_t i = 0; i < size_; ++i)
+            std::copy(GetRow(i), GetRow(i) + (GetLast(i) - GetFirst(i)), dense.GetData() + i * size_ + GetFirst(i));
+
+        return dense;
+    }
+
+    T GetDeterminant() const {
+        if (size_ == 0)
+            throw std::logic_error("Matrix is empty");
+
+        return details::structure::DiagonalDeterminant<T>(
+            size_, [this](size_t i) { return GetRow(i)[i - GetFirst(i)]; });
+    }
+
+    // Row i of the product sums the rows of rhs the row of the triangle
+    // picks, n^2 / 2 vector updates in all.
+    Matrix<T> Multiply(const Matrix<T> &rhs) const {
+        details::structure::CheckMultiply(size_, rhs);
+
+        size_t width = rhs.GetColumnCount();
+        Matrix<T> result = details::structure::Zeros<T>(size_, width);
+        for (size_t i = 0; i < size_; ++i) {
+            const T *row = GetRow(i);
+            for (size_t k = GetFirst(i); k < GetLast(i); ++k)
+                details::simd::SubScaled(result.GetData() + i * width, T(-row[k - GetFirst(i)]),
+                                         rhs.GetData() + k * width, width);
+        }
+
+        return result;
+    }
+private:
+    // Columns [GetFirst(i), GetLast(i)) of row i are stored.
+    size_t GetFirst(size_t i) const { return (triangle_ == Triangle::Upper) ? i : 0; }
+    size_t GetLast(size_t i) const { return (triangle_ == Triangle::Upper) ? size_ : i + 1; }
+
+    const T *GetRow(size_t i) const {
+        size_t offset = (triangle_ == Triangle::Upper) ? i * size_ - i * (i - 1) / 2 : i * (i + 1) / 2;
+        return values_.data() + offset;
+    }
+
+    size_t size_ = 0;
+    Triangle triangle_ = Triangle::Upper;
+    std::vector<T> values_;
+}; // class TriangularMatrix
+
+// Band of lower_bandwidth diagonals below the main one and upper_bandwidth
+// above, one row of lower + upper + 1 entries per matrix row; row i starts
+// at column i - lower_bandwidth, the positions outside the matrix zero.
+template <typename T> class BandedMatrix {
+    static_assert(std::is_arithmetic_v<T>, "BandedMatrix needs an arithmetic element type");
+
+public:
+    using value_type = T;
+
+    // The bandwidths of the matrix itself.
+    explicit BandedMatrix(const ConstMatrixView<T> &dense) : BandedMatrix(dense, DetectStructure(dense)) {}
+
+    BandedMatrix(const ConstMatrixView<T> &dense, size_t lower_bandwidth, size_t upper_bandwidth)
+        : BandedMatrix(dense, DetectStructure(dense), lower_bandwidth, upper_bandwidth) {}
+
+    size_t GetSize() const { return size_; }
+    size_t GetLowerBandwidth() const { return lower_; }
+    size_t GetUpperBandwidth() const { return upper_; }
+
+    T operator()(size_t num_row, size_t num_col) const {
+        if (num_row >= size_ || num_col >= size_)
+            throw std::range_error("Matrix index is out of range");
+
+        if (num_col < GetFirst(num_row) || num_col >= GetLast(num_row))
+            return T{};
+
+        return Get(num_row, num_col);
+    }
+
+    Matrix<T> ToMatrix() const {
+        Matrix<T> dense = details::structure::Zeros<T>(size_, size_);
+        for (size_t i = 0; i < size_; ++i)
+            for (size_t j = GetFirst(i); j < GetLast(i); ++j)
+                dense.GetData()[i * size_ + j] = Get(i, j);
+
+        return dense;
+    }
+
+    // Band LU with partial pivoting for floating point types, in
+    // n (k_l + 1) (2 k_l + k_u + 1) operations; integers take the exact
+    // dense path.
+    T GetDeterminant() const {
+        if (size_ == 0)
+            throw std::logic_error("Matrix is empty");
+
+        if constexpr (std::is_integral_v<T>) {
+            return ToMatrix().GetDeterminant();
+        } else {
+            std::vector<T> tolerances(size_, T{});
+            for (size_t i = 0; i < size_; ++i)
+                for (size_t j = GetFirst(i); j < GetLast(i); ++j)
+                    tolerances[j] = std::max<T>(tolerances[j], std::fabs(Get(i, j)));
+
+            for (T &tolerance : tolerances)
+                tolerance = details::structure::PivotTolerance(tolerance, size_);
+
+            details::ScaledProduct<T> det;
+            auto element = [this](size_t i, size_t j) { return Get(i, j); };
+            if (!details::structure::BandDeterminant(size_, lower_, upper_, element, tolerances.data(), det))
+                return T{};
+
+            return det.Get();
+        }
+    }
+
+    Matrix<T> Multiply(const Matrix<T> &rhs) const {
+        details::structure::CheckMultiply(size_, rhs);
+
+        size_t width = rhs.GetColumnCount();
+        Matrix<T> result = details::structure::Zeros<T>(size_, width);
+        for (size_t i = 0; i < size_; ++i)
+            for (size_t k = GetFirst(i); k < GetLast(i); ++k)
+                details::simd::SubScaled(result.GetData() + i * width, T(-Get(i, k)), rhs.GetData() + k * width, width);
+
+        return result;
+    }
+private:
+    BandedMatrix(const ConstMatrixView<T> &dense, const MatrixStructure &structure)
+        : BandedMatrix(dense, structure, structure.lower_bandwidth, structure.upper_bandwidth) {}
+
+    BandedMatrix(const ConstMatrixView<T> &dense, const MatrixStructure &structure, size_t lower_bandwidth,
+                 size_t upper_bandwidth)
+        : size_(structure.size), lower_(lower_bandwidth), upper_(upper_bandwidth) {
+        if (structure.lower_bandwidth > lower_ || structure.upper_bandwidth > upper_)
+            throw std::logic_error("Matrix has entries outside the band");
+
+        values_.assign(size_ * GetWidth(), T{});
+        for (size_t i = 0; i < size_; ++i)
+            for (size_t j = GetFirst(i); j < GetLast(i); ++j)
+                At(i, j) = dense.Eval(i, j);
+    }
+
+    size_t GetWidth() const { return lower_ + upper_ + 1; }
+    size_t GetFirst(size_t i) const { return (i > lower_) ? i - lower_ : 0; }
+    size_t GetLast(size_t i) const { return std::min(size_, i + upper_ + 1); }
+
+    // a_ij for j within the band of row i.
+    T Get(size_t i, size_t j) const { return values_[i * GetWidth() + j + lower_ - i]; }
+    T &At(size_t i, size_t j) { return values_[i * GetWidth() + j + lower_ - i]; }
+
+    size_t size_ = 0;
+    size_t lower_ = 0;
+    size_t upper_ = 0;
+    std::vector<T> values_;
+}; // class BandedMatrix
+
+// The lower triangle of a symmetric matrix, packed row by row.
+template <typename T> class SymmetricMatrix {
+    static_assert(std::is_arithmetic_v<T>, "SymmetricMatrix needs an arithmetic element type");
+
+public:
+    using value_type = T;
+
+    explicit SymmetricMatrix(const ConstMatrixView<T> &dense) : size_(dense.GetRowCount()) {
+        if (!DetectStructure(dense).is_symmetric)
+            throw std::logic_error("Matrix is not symmetric");
+
+        values_.reserve(size_ * (size_ + 1) / 2);
+        for (size_t i = 0; i < size_; ++i)
+            for (size_t j = 0; j <= i; ++j)
+                values_.push_back(dense.Eval(i, j));
+    }
+
+    size_t GetSize() const { return size_; }
+
+    T operator()(size_t num_row, size_t num_col) const {
+        if (num_row >= size_ || num_col >= size_)
+            throw std::range_error("Matrix index is out of range");
+
+        return Get(std::max(num_row, num_col), std::min(num_row, num_col));
+    }
+
+    Matrix<T> ToMatrix() const {
+        Matrix<T> dense(size_, size_);
+        for (size_t i = 0; i < size_; ++i)
+            for (size_t j = 0; j <= i; ++j)
+                dense.GetData()[i * size_ + j] = dense.GetData()[j * size_ + i] = Get(i, j);
+
+        return dense;
+    }
+
+    // LDL^T in half the work of dense elimination for positive definite
+    // matrices; indefinite ones, and integer matrices, which need the exact
+    // path, are expanded for the dense determinant.
+    T GetDeterminant() const {
+        if (size_ == 0)
+            throw std::logic_error("Matrix is empty");
+
+        if constexpr (std::is_floating_point_v<T>) {
+            // The stored a_ij, j < i, is a_ji as well.
+            std::vector<T> tolerances(size_, T{});
+            for (size_t i = 0; i < size_; ++i)
+                for (size_t j = 0; j <= i; ++j) {
+                    T magnitude = std::fabs(Get(i, j));
+                    tolerances[i] = std::max(tolerances[i], magnitude);
+                    tolerances[j] = std::max(tolerances[j], magnitude);
+                }
+
+            for (T &tolerance : tolerances)
+                tolerance = details::structure::PivotTolerance(tolerance, size_);
+
+            details::ScaledProduct<T> det;
+            auto element = [this](size_t i, size_t j) { return Get(i, j); };
+            if (details::structure::LdltDeterminant(size_, element, tolerances.data(), det))
+                return det.Get();
+        }
+
+        return ToMatrix().GetDeterminant();
+    }
+
+    // Each stored a_ij with j < i adds to two rows of the product: a_ij
+    // times row j of rhs to row i, and times row i to row j.
+    Matrix<T> Multiply(const Matrix<T> &rhs) const {
+        details::structure::CheckMultiply(size_, rhs);
+
+        size_t width = rhs.GetColumnCount();
+        Matrix<T> result = details::structure::Zeros<T>(size_, width);
+        for (size_t i = 0; i < size_; ++i)
+            for (size_t j = 0; j <= i; ++j) {
+                T value = -Get(i, j);
+                details::simd::SubScaled(result.GetData() + i * width, value, rhs.GetData() + j * width, width);
+                if (j != i)
+                    details::simd::SubScaled(result.GetData() + j * width, value, rhs.GetData() + i * width, width);
+            }
+
+        return result;
+    }
+private:
+    // a_ij for j <= i.
+    T Get(size_t i, size_t j) const { return values_[i * (i + 1) / 2 + j]; }
+
+    size_t size_ = 0;
+    std::vector<T> values_;
+}; // class SymmetricMatrix
+
+template <typename T> Matrix<T> operator*(const DiagonalMatrix<T> &lhs, const Matrix<T> &rhs) {
+    return lhs.Multiply(rhs);
+}
+
+template <typename T> Matrix<T> operator*(const Matrix<T> &lhs, const DiagonalMatrix<T> &rhs) {
+    return rhs.MultiplyLeft(lhs);
+}
+
+template <typename T> DiagonalMatrix<T> operator*(const DiagonalMatrix<T> &lhs, const DiagonalMatrix<T> &rhs) {
+    return lhs.Multiply(rhs);
+}
+
+template <typename T> Matrix<T> operator*(const TriangularMatrix<T> &lhs, const Matrix<T> &rhs) {
+    return lhs.Multiply(rhs);
+}
+
+template <typename T> Matrix<T> operator*(const BandedMatrix<T> &lhs, const Matrix<T> &rhs) {
+    return lhs.Multiply(rhs);
+}
+
+template <typename T> Matrix<T> operator*(const SymmetricMatrix<T> &lhs, const Matrix<T> &rhs) {
+    return lhs.Multiply(rhs);
+}
+} // namespace matrix
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace matrix {
+namespace details {
+    // Fixed set of workers, each with its own task deque. A worker pops from
+    // the back of its own deque and steals from the front of the others, so
+    // chunks of one ParallelFor spread out without a shared queue lock.
+    class ThreadPool {
+    public:
+        explicit ThreadPool(size_t thread_count) {
+            size_t worker_count = (thread_count > 1) ? thread_count - 1 : 0;
+
+            for (size_t i = 0; i < worker_count; ++i)
+                queues_.push_back(std::make_unique<TaskQueue>());
+
+            for (size_t i = 0; i < worker_count; ++i)
+                workers_.emplace_back([this, i] { WorkerLoop(i); });
+        }
+
+        ThreadPool(const ThreadPool &other) = delete;
+        ThreadPool &operator=(const ThreadPool &other) = delete;
+
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock{sleep_mutex_};
+                stop_ = true;
+            }
+            wake_.notify_all();
+
+            for (std::thread &worker : workers_)
+                worker.join();
+        }
+
+        // Workers plus the calling thread, which always takes part.
+        size_t GetThreadCount() const { return workers_.size() + 1; }
+
+        // Runs body(lo, hi) over [begin, end) split into chunks of at least
+        // grain indices and returns when every chunk is done. The first
+        // exception thrown by a chunk is rethrown here. Calls made from
+        // inside a worker run inline, so nesting cannot deadlock the pool.
+        template <typename Body>
+        void ParallelFor(size_t begin, size_t end, size_t grain, Body &&body) {
+            if (end <= begin)
+                return;
+
+            size_t count = end - begin;
+            grain = std::max<size_t>(grain, 1);
+            size_t chunk_count = std::min((count + grain - 1) / grain, 4 * GetThreadCount());
+
+            if (workers_.empty() || chunk_count <= 1 || IsWorkerThread()) {
+                body(begin, end);
+                return;
+            }
+
+            JobState state;
+            state.remaining = chunk_count;
+
+            size_t chunk = count / chunk_count;
+            size_t extra = count % chunk_count;
+            size_t lo = begin;
+            for (size_t i = 0; i < chunk_count; ++i) {
+                size_t hi = lo + chunk + (i < extra ? 1 : 0);
+
+                Submit(i, [&state, &body, lo, hi] {
+                    try {
+                        body(lo, hi);
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock{state.error_mutex};
+                        if (!state.error)
+                            state.error = std::current_exception();
+                    }
+                    state.remaining.fetch_sub(1, std::memory_order_acq_rel);
+                });
+
+                lo = hi;
+            }
+
+            while (state.remaining.load(std::memory_order_acquire) > 0) {
+                std::function<void()> task;
+                if (TryPop(queues_.size(), task))
+                    task();
+                else
+                    std::this_thread::yield();
+            }
+
+            if (state.error)
+                std::rethrow_exception(state.error);
+        }
+
+    private:
+        struct TaskQueue {
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+        }; // struct TaskQueue
+
+        struct JobState {
+            std::atomic<size_t> remaining{0};
+            std::mutex error_mutex;
+            std::exception_ptr error;
+        }; // struct JobState
+
+        static bool &IsWorkerThread() {
+            thread_local bool is_worker = false;
+            return is_worker;
+        }
+
+        void Submit(size_t index, std::function<void()> task) {
+            TaskQueue &queue = *queues_[index % queues_.size()];
+            {
+                std::lock_guard<std::mutex> lock{queue.mutex};
+                queue.tasks.push_back(std::move(task));
+            }
+            {
+                std::lock_guard<std::mutex> lock{sleep_mutex_};
+                ++pending_;
+            }
+            wake_.notify_one();
+        }
+
+        // Own deque first (newest task), then the oldest task of the others.
+        bool TryPop(size_t self, std::function<void()> &task) {
+            size_t queue_count = queues_.size();
+
+            for (size_t i = 0; i < queue_count; ++i) {
+                size_t index = (self + i) % queue_count;
+                TaskQueue &queue = *queues_[index];
+                std::lock_guard<std::mutex> lock{queue.mutex};
+
+                if (queue.tasks.empty())
+                    continue;
+
+                if (index == self) {
+                    task = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                } else {
+                    task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+
+                std::lock_guard<std::mutex> sleep_lock{sleep_mutex_};
+                --pending_;
+                return true;
+            }
+
+            return false;
+        }
+
+        void WorkerLoop(size_t self) {
+            IsWorkerThread() = true;
+
+            while (true) {
+                std::function<void()> task;
+                if (TryPop(self, task)) {
+                    task();
+                    continue;
+                }
+
+                std::unique_lock<std::mutex> lock{sleep_mutex_};
+                wake_.wait(lock, [this] { return stop_ || pending_ > 0; });
+                if (stop_ && pending_ == 0)
+                    return;
+            }
+        }
+
+        std::vector<std::unique_ptr<TaskQueue>> queues_;
+        std::vector<std::thread> workers_;
+
+        std::mutex sleep_mutex_;
+        std::condition_variable wake_;
+        size_t pending_ = 0;
+        bool stop_ = false;
+    }; // class ThreadPool
+
+    // The pool is owned by thread_pool, replaced under the mutex by
+    // SetThreadCount, and read through current_thread_pool, so that the
+    // library calls behind every product and elimination take no lock.
+    inline std::mutex thread_pool_mutex;
+    inline std::unique_ptr<ThreadPool> thread_pool;
+    inline std::atomic<ThreadPool *> current_thread_pool{nullptr};
+    inline std::once_flag default_thread_pool_flag;
+
+    inline size_t DefaultThreadCount() {
+        return std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+    }
+
+    inline ThreadPool &GetThreadPool() {
+        if (ThreadPool *pool = current_thread_pool.load(std::memory_order_acquire))
+            return *pool;
+
+        std::call_once(default_thread_pool_flag, [] {
+            std::lock_guard<std::mutex> lock{thread_pool_mutex};
+            if (!thread_pool) {
+                thread_pool = std::make_unique<ThreadPool>(DefaultThreadCount());
+                current_thread_pool.store(thread_pool.get(), std::memory_order_release);
+            }
+        });
+
+        return *current_thread_pool.load(std::memory_order_acquire);
+    }
+} // namespace details
+
+// Sets how many threads the library uses, the caller included; 0 means one
+// per hardware thread and 1 runs everything on the calling thread. Must not
+// be called while another thread is inside a library call.
+inline void SetThreadCount(size_t thread_count) {
+    if (thread_count == 0)
+        thread_count = details::DefaultThreadCount();
+
+    // The new pool is published before the old one is destroyed, so a
+    // reader never loads a pointer to a pool that is already gone.
+    auto pool = std::make_unique<details::ThreadPool>(thread_count);
+    std::lock_guard<std::mutex> lock{details::thread_pool_mutex};
+    details::current_thread_pool.store(pool.get(), std::memory_order_release);
+    details::thread_pool.swap(pool);
+}
+
+inline size_t GetThreadCount() { return details::GetThreadPool().GetThreadCount(); }
+} // namespace matrix
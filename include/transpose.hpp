@@ -0,0 +1,331 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "simd.hpp"
+
+namespace matrix {
+namespace details {
+namespace transpose {
+    // Edge of the blocks the recursion stops at: a source and a destination
+    // block of doubles take 16 KiB together and stay in L1 while they are
+    // walked in micro tiles. A multiple of every SIMD width.
+    constexpr size_t kLeafSize = 32;
+
+    template <typename T> using LaneIndex = std::conditional_t<sizeof(T) == 4, int32_t, int64_t>;
+
+    // Shuffle mask interleaving the low (Offset = 0) or high (Offset =
+    // Width / 2) halves of two vectors: {a[o], b[o], a[o + 1], b[o + 1], ...}.
+    template <typename Mask, size_t Width, size_t Offset, typename Sequence> struct InterleaveMask;
+
+    template <typename Mask, size_t Width, size_t Offset, size_t... I>
+    struct InterleaveMask<Mask, Width, Offset, std::index_sequence<I...>> {
+        static constexpr Mask kValue = {(Offset + I / 2 + (I % 2) * Width)...};
+    }; // struct InterleaveMask
+
+    // Width x Width transpose of vectors held in registers: log2(Width)
+    // rounds of interleaving rows j and j + Width / 2.
+    template <size_t Bytes, typename T, typename Vec>
+    MATRIX_SIMD_INLINE void TransposeRegisters(Vec (&rows)[Bytes / sizeof(T)]) {
+        using Mask = typename simd::VecType<LaneIndex<T>, Bytes>::type;
+        constexpr size_t kWidth = Bytes / sizeof(T);
+        using Lanes = std::make_index_sequence<kWidth>;
+        constexpr Mask kLow = InterleaveMask<Mask, kWidth, 0, Lanes>::kValue;
+        constexpr Mask kHigh = InterleaveMask<Mask, kWidth, kWidth / 2, Lanes>::kValue;
+
+#if defined(__GNUC__)
+#pragma GCC unroll 4
+#endif
+        for (size_t round = 1; round < kWidth; round *= 2) {
+            Vec next[kWidth];
+#if defined(__GNUC__)
+#pragma GCC unroll 16
+#endif
+            for (size_t j = 0; j < kWidth / 2; ++j) {
+                next[2 * j] = __builtin_shuffle(rows[j], rows[j + kWidth / 2], kLow);
+                next[2 * j + 1] = __builtin_shuffle(rows[j], rows[j + kWidth / 2], kHigh);
+            }
+#if defined(__GNUC__)
+#pragma GCC unroll 16
+#endif
+            for (size_t j = 0; j < kWidth; ++j)
+                rows[j] = next[j];
+        }
+    }
+
+    // dst = src^T for one tile of Width x Width elements. src and dst may
+    // be the same tile, the whole tile is loaded before anything is stored.
+    template <size_t Bytes, typename T>
+    MATRIX_SIMD_INLINE void MicroTranspose(const T *src, size_t rs_src, T *dst, size_t rs_dst) {
+        using Vec = typename simd::VecType<T, Bytes>::type;
+        constexpr size_t kWidth = Bytes / sizeof(T);
+        Vec rows[kWidth];
+
+#if defined(__GNUC__)
+#pragma GCC unroll 16
+#endif
+        for (size_t i = 0; i < kWidth; ++i)
+            simd::Load(rows[i], src + i * rs_src);
+
+        TransposeRegisters<Bytes, T>(rows);
+
+#if defined(__GNUC__)
+#pragma GCC unroll 16
+#endif
+        for (size_t i = 0; i < kWidth; ++i)
+            simd::Store(dst + i * rs_dst, rows[i]);
+    }
+
+    // Swaps the tile at a with the transpose of the tile at b.
+    template <size_t Bytes, typename T>
+    MATRIX_SIMD_INLINE void MicroSwapTranspose(T *a, T *b, size_t rs) {
+        using Vec = typename simd::VecType<T, Bytes>::type;
+        constexpr size_t kWidth = Bytes / sizeof(T);
+        Vec a_rows[kWidth], b_rows[kWidth];
+
+#if defined(__GNUC__)
+#pragma GCC unroll 16
+#endif
+        for (size_t i = 0; i < kWidth; ++i) {
+            simd::Load(a_rows[i], a + i * rs);
+            simd::Load(b_rows[i], b + i * rs);
+        }
+
+        TransposeRegisters<Bytes, T>(a_rows);
+        TransposeRegisters<Bytes, T>(b_rows);
+
+#if defined(__GNUC__)
+#pragma GCC unroll 16
+#endif
+        for (size_t i = 0; i < kWidth; ++i) {
+            simd::Store(b + i * rs, a_rows[i]);
+            simd::Store(a + i * rs, b_rows[i]);
+        }
+    }
+
+    // Leaf kernels. Width 1 is the scalar version used by element types
+    // without vectors; wider ones cover whole micro tiles with the shuffles
+    // above and finish the ragged edges element by element.
+
+    // dst (cols x rows) = src (rows x cols)^T, blocks do not overlap.
+    template <size_t Width, size_t Bytes, typename T>
+    MATRIX_SIMD_INLINE void TransposeBlockImpl(const T *src, size_t rs_src, T *dst, size_t rs_dst,
+                                               size_t rows, size_t cols) {
+        size_t full_rows = (Width > 1) ? rows - rows % Width : 0;
+        size_t full_cols = (Width > 1) ? cols - cols % Width : 0;
+
+        if constexpr (Width > 1) {
+            for (size_t i = 0; i < full_rows; i += Width)
+                for (size_t j = 0; j < full_cols; j += Width)
+                    MicroTranspose<Bytes>(src + i * rs_src + j, rs_src, dst + j * rs_dst + i, rs_dst);
+        }
+
+        for (size_t i = 0; i < rows; ++i) {
+            size_t first_col = (i < full_rows) ? full_cols : 0;
+            for (size_t j = first_col; j < cols; ++j)
+                dst[j * rs_dst + i] = src[i * rs_src + j];
+        }
+    }
+
+    // Swaps a (rows x cols) with b (cols x rows)^T, blocks do not overlap.
+    template <size_t Width, size_t Bytes, typename T>
+    MATRIX_SIMD_INLINE void SwapBlocksImpl(T *a, T *b, size_t rs, size_t rows, size_t cols) {
+        size_t full_rows = (Width > 1) ? rows - rows % Width : 0;
+        size_t full_cols = (Width > 1) ? cols - cols % Width : 0;
+
+        if constexpr (Width > 1) {
+            for (size_t i = 0; i < full_rows; i += Width)
+                for (size_t j = 0; j < full_cols; j += Width)
+                    MicroSwapTranspose<Bytes>(a + i * rs + j, b + j * rs + i, rs);
+        }
+
+        for (size_t i = 0; i < rows; ++i) {
+            size_t first_col = (i < full_rows) ? full_cols : 0;
+            for (size_t j = first_col; j < cols; ++j)
+                std::swap(a[i * rs + j], b[j * rs + i]);
+        }
+    }
+
+    // Transposes the size x size block at a in place.
+    template <size_t Width, size_t Bytes, typename T>
+    MATRIX_SIMD_INLINE void TransposeDiagonalImpl(T *a, size_t rs, size_t size) {
+        size_t full = (Width > 1) ? size - size % Width : 0;
+
+        if constexpr (Width > 1) {
+            for (size_t i = 0; i < full; i += Width) {
+                MicroTranspose<Bytes>(a + i * rs + i, rs, a + i * rs + i, rs);
+                for (size_t j = i + Width; j < full; j += Width)
+                    MicroSwapTranspose<Bytes>(a + i * rs + j, a + j * rs + i, rs);
+            }
+        }
+
+        for (size_t i = 0; i < size; ++i)
+            for (size_t j = std::max(i + 1, full); j < size; ++j)
+                std::swap(a[i * rs + j], a[j * rs + i]);
+    }
+
+    template <typename T> struct Kernels {
+        void (*block)(const T *, size_t, T *, size_t, size_t, size_t);
+        void (*swap)(T *, T *, size_t, size_t, size_t);
+        void (*diagonal)(T *, size_t, size_t);
+    }; // struct Kernels
+
+    template <typename T>
+    void TransposeBlock(const T *src, size_t rs_src, T *dst, size_t rs_dst, size_t rows, size_t cols) {
+        TransposeBlockImpl<1, sizeof(T)>(src, rs_src, dst, rs_dst, rows, cols);
+    }
+
+    template <typename T> void SwapBlocks(T *a, T *b, size_t rs, size_t rows, size_t cols) {
+        SwapBlocksImpl<1, sizeof(T)>(a, b, rs, rows, cols);
+    }
+
+    template <typename T> void TransposeDiagonal(T *a, size_t rs, size_t size) {
+        TransposeDiagonalImpl<1, sizeof(T)>(a, rs, size);
+    }
+
+#define MATRIX_TRANSPOSE_DEFINE_ISA(suffix, isa, bytes)                                           \
+    template <typename T>                                                                         \
+    MATRIX_SIMD_TARGET(isa) void TransposeBlock##suffix(const T *src, size_t rs_src, T *dst,       \
+                                                        size_t rs_dst, size_t rows, size_t cols) { \
+        TransposeBlockImpl<bytes / sizeof(T), bytes>(src, rs_src, dst, rs_dst, rows, cols);       \
+    }                                                                                             \
+    template <typename T>                                                                         \
+    MATRIX_SIMD_TARGET(isa) void SwapBlocks##suffix(T *a, T *b, size_t rs, size_t rows,            \
+                                                    size_t cols) {                                \
+        SwapBlocksImpl<bytes / sizeof(T), bytes>(a, b, rs, rows, cols);                           \
+    }                                                                                             \
+    template <typename T>                                                                         \
+    MATRIX_SIMD_TARGET(isa) void TransposeDiagonal##suffix(T *a, size_t rs, size_t size) {         \
+        TransposeDiagonalImpl<bytes / sizeof(T), bytes>(a, rs, size);                             \
+    }
+
+#if defined(MATRIX_SIMD_X86)
+    MATRIX_TRANSPOSE_DEFINE_ISA(Avx512, "avx512f", 64)
+    MATRIX_TRANSPOSE_DEFINE_ISA(Avx2, "avx2", 32)
+    MATRIX_TRANSPOSE_DEFINE_ISA(Sse2, "sse2", 16)
+#endif
+
+#undef MATRIX_TRANSPOSE_DEFINE_ISA
+
+    template <typename T> Kernels<T> SelectKernels() {
+        if constexpr (simd::kIsVectorizable<T>) {
+#if defined(MATRIX_SIMD_X86)
+            switch (simd::GetIsa()) {
+            case simd::Isa::Avx512:
+                return {&TransposeBlockAvx512<T>, &SwapBlocksAvx512<T>, &TransposeDiagonalAvx512<T>};
+            case simd::Isa::Avx2:
+                return {&TransposeBlockAvx2<T>, &SwapBlocksAvx2<T>, &TransposeDiagonalAvx2<T>};
+            case simd::Isa::Sse2:
+                return {&TransposeBlockSse2<T>, &SwapBlocksSse2<T>, &TransposeDiagonalSse2<T>};
+            case simd::Isa::Scalar:
+                break;
+            }
+#endif
+        }
+
+        return {&TransposeBlock<T>, &SwapBlocks<T>, &TransposeDiagonal<T>};
+    }
+
+    // Splits the longer side in half, on a leaf boundary, so that every
+    // level of the cache sees blocks that fit it without knowing its size.
+    inline size_t SplitPoint(size_t size) { return (size / 2 + kLeafSize - 1) / kLeafSize * kLeafSize; }
+
+    template <typename T>
+    void BlockRecursive(const Kernels<T> &kernels, const T *src, size_t rs_src, T *dst, size_t rs_dst,
+                        size_t rows, size_t cols) {
+        if (rows <= kLeafSize && cols <= kLeafSize) {
+            kernels.block(src, rs_src, dst, rs_dst, rows, cols);
+        } else if (rows >= cols) {
+            size_t half = SplitPoint(rows);
+            BlockRecursive(kernels, src, rs_src, dst, rs_dst, half, cols);
+            BlockRecursive(kernels, src + half * rs_src, rs_src, dst + half, rs_dst, rows - half, cols);
+        } else {
+            size_t half = SplitPoint(cols);
+            BlockRecursive(kernels, src, rs_src, dst, rs_dst, rows, half);
+            BlockRecursive(kernels, src + half, rs_src, dst + half * rs_dst, rs_dst, rows, cols - half);
+        }
+    }
+
+    template <typename T>
+    void SwapRecursive(const Kernels<T> &kernels, T *a, T *b, size_t rs, size_t rows, size_t cols) {
+        if (rows <= kLeafSize && cols <= kLeafSize) {
+            kernels.swap(a, b, rs, rows, cols);
+        } else if (rows >= cols) {
+            size_t half = SplitPoint(rows);
+            SwapRecursive(kernels, a, b, rs, half, cols);
+            SwapRecursive(kernels, a + half * rs, b + half, rs, rows - half, cols);
+        } else {
+            size_t half = SplitPoint(cols);
+            SwapRecursive(kernels, a, b, rs, rows, half);
+            SwapRecursive(kernels, a + half, b + half * rs, rs, rows, cols - half);
+        }
+    }
+
+    // [A11 A12; A21 A22]^T = [A11^T A21^T; A12^T A22^T].
+    template <typename T> void SquareRecursive(const Kernels<T> &kernels, T *a, size_t rs, size_t size) {
+        if (size <= kLeafSize) {
+            kernels.diagonal(a, rs, size);
+            return;
+        }
+
+        size_t half = SplitPoint(size);
+        SquareRecursive(kernels, a, rs, half);
+        SquareRecursive(kernels, a + half * rs + half, rs, size - half);
+        SwapRecursive(kernels, a + half, a + half * rs, rs, half, size - half);
+    }
+} // namespace transpose
+
+    // dst (cols x rows, row stride rs_dst) = src (rows x cols)^T. Both hold
+    // constructed elements of a trivially copyable type and do not overlap.
+    template <typename T>
+    void TransposeInto(const T *src, size_t rs_src, T *dst, size_t rs_dst, size_t rows, size_t cols) {
+        static_assert(std::is_trivially_copyable_v<T>, "Element type is not trivially copyable");
+
+        transpose::BlockRecursive(transpose::SelectKernels<T>(), src, rs_src, dst, rs_dst, rows, cols);
+    }
+
+    template <typename T> void TransposeSquareInPlace(T *data, size_t size) {
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            transpose::SquareRecursive(transpose::SelectKernels<T>(), data, size, size);
+        } else {
+            for (size_t i = 0; i < size; ++i)
+                for (size_t j = i + 1; j < size; ++j)
+                    std::swap(data[i * size + j], data[j * size + i]);
+        }
+    }
+
+    // Rectangular rows x cols buffer rearranged into its cols x rows
+    // transpose by following the cycles of the index permutation
+    // k -> (k % cols) * rows + k / cols. Needs one bit per element to mark
+    // the cycles already moved, not a second buffer.
+    template <typename T> void TransposeInPlace(T *data, size_t rows, size_t cols) {
+        if (rows == cols) {
+            TransposeSquareInPlace(data, rows);
+            return;
+        }
+
+        size_t size = rows * cols;
+        if (rows <= 1 || cols <= 1)
+            return;
+
+        std::vector<bool> moved(size);
+        for (size_t start = 1; start + 1 < size; ++start) {
+            if (moved[start])
+                continue;
+
+            T value = std::move(data[start]);
+            size_t index = start;
+            do {
+                index = (index % cols) * rows + index / cols;
+                std::swap(value, data[index]);
+                moved[index] = true;
+            } while (index != start);
+        }
+    }
+} // namespace details
+} // namespace matrix
@@ -1,17 +1,49 @@
+#include <algorithm>
 #include <cassert>
-#include <iomanip>
+#include <cerrno>
+#include <charconv>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
 #include <iostream>
 #include <limits>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 #include <cmath>
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "input_reader.hpp"
 #include "real_nums.hpp"
 #include "matrix.hpp"
+#include "sparse_matrix.hpp"
 
 namespace {
-bool GetInput(size_t &size, std::vector<double> &nums) {
-    std::cin >> size;
-    if (!std::cin.good() || size <= 0) {
+// Batch mode hands matrices from the parsing thread to the computing one in
+// chunks of at least this many elements, so small matrices do not pay a
+// lock and a wake-up each.
+constexpr size_t kChunkElements = size_t{1} << 16;
+constexpr size_t kChunkCount = 3;
+constexpr size_t kMaxSize = size_t{1} << 20;
+constexpr size_t kOutputFlushBytes = size_t{1} << 16;
+
+// Inputs at least this large with at most 1 / kSparseDensityRatio of their
+// elements non-zero try the sparse LU first. It gives up for the dense one
+// once its factors pass 1 / kSparseFillRatio of the elements, which keeps
+// the failed attempt well below the cost of the dense elimination.
+constexpr size_t kSparseMinSize = 64;
+constexpr size_t kSparseDensityRatio = 20;
+constexpr size_t kSparseFillRatio = 16;
+
+bool GetInput(matrix::InputReader &reader, size_t &size, std::vector<double> &nums) {
+    if (!reader.Read(size) || size <= 0 || size > kMaxSize) {
         std::cout << "Incorrect data" << std::endl;
         return false;
     }
@@ -20,33 +52,187 @@ bool GetInput(size_t &size, std::vector<double> &nums) {
     nums.reserve(num_elems);
     for (size_t i = 0; i < num_elems; i++) {
         double x = 0;
-        std::cin >> x;
-        nums.push_back(x);
-        if (!std::cin.good()) {
+        if (!reader.Read(x)) {
             std::cout << "Incorrect data" << std::endl;
             return false;
         }
+        nums.push_back(x);
     }
 
     return true;
 }
-} // namespace
 
-int main() {
+// Same text as printing through std::cout: an integer when the determinant
+// is one up to rounding, otherwise all significant digits.
+void AppendDeterminant(std::string &out, double det) {
+    char text[64];
+    std::to_chars_result result;
+
+    if (std::fabs(std::round(det) - det) < 1e-5)
+        result = std::to_chars(text, text + sizeof(text), static_cast<long>(std::round(det)));
+    else
+        result = std::to_chars(text, text + sizeof(text), det, std::chars_format::general,
+                               std::numeric_limits<double>::max_digits10);
+
+    out.append(text, result.ptr);
+    out.push_back('\n');
+}
+
+double GetDeterminant(const double *values, size_t size, std::pmr::memory_resource *resource) {
+    size_t elements = size * size;
+    if (size >= kSparseMinSize &&
+        static_cast<size_t>(std::count_if(values, values + elements, [](double x) { return x != 0; })) <=
+            elements / kSparseDensityRatio) {
+        matrix::SparseMatrix<double> sparse{matrix::ConstMatrixView<double>{values, size, size, size}};
+        if (std::optional<double> det = sparse.TryGetDeterminant(elements / kSparseFillRatio))
+            return *det;
+    }
+
+    matrix::Matrix<double> matrix{size, size, values, values + elements, resource};
+    return std::move(matrix).GetDeterminant();
+}
+
+struct Chunk {
+    std::vector<size_t> sizes;
+    std::vector<double> values;
+    bool is_last = false;
+    bool is_broken = false;
+};
+
+// Blocking FIFO between the two threads of the batch mode.
+class ChunkQueue {
+public:
+    void Push(Chunk chunk) {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            chunks_.push_back(std::move(chunk));
+        }
+        ready_.notify_one();
+    }
+
+    Chunk Pop() {
+        std::unique_lock<std::mutex> lock{mutex_};
+        ready_.wait(lock, [this] { return !chunks_.empty(); });
+
+        Chunk chunk = std::move(chunks_.front());
+        chunks_.pop_front();
+        return chunk;
+    }
+private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<Chunk> chunks_;
+}; // class ChunkQueue
+
+// Parses size-prefixed matrices until the input ends or is malformed. The
+// chunks cycle between the queues, so their storage is reused.
+void ParseChunks(matrix::InputReader &reader, ChunkQueue &empty, ChunkQueue &filled) {
+    for (;;) {
+        Chunk chunk = empty.Pop();
+        chunk.sizes.clear();
+        chunk.values.clear();
+
+        try {
+            while (chunk.values.size() < kChunkElements) {
+                if (reader.AtEnd()) {
+                    chunk.is_last = true;
+                    break;
+                }
+
+                size_t size = 0;
+                if (!reader.Read(size) || size == 0 || size > kMaxSize) {
+                    chunk.is_broken = true;
+                    break;
+                }
+
+                size_t begin = chunk.values.size();
+                chunk.values.resize(begin + size * size);
+                for (size_t i = begin; i < chunk.values.size(); ++i)
+                    if (!reader.Read(chunk.values[i])) {
+                        chunk.is_broken = true;
+                        break;
+                    }
+
+                if (chunk.is_broken) {
+                    chunk.values.resize(begin);
+                    break;
+                }
+
+                chunk.sizes.push_back(size);
+            }
+        } catch (std::exception &) {
+            chunk.is_broken = true;
+        }
+
+        bool is_done = chunk.is_last || chunk.is_broken;
+        filled.Push(std::move(chunk));
+        if (is_done)
+            return;
+    }
+}
+
+// Batch mode: every matrix of the input, each given as its size followed by
+// its elements, gets one determinant line in the output. Parsing runs on a
+// separate thread a chunk ahead of the determinants.
+int RunBatch(int fd) {
+    matrix::InputReader reader{fd};
+    ChunkQueue empty;
+    ChunkQueue filled;
+    for (size_t i = 0; i < kChunkCount; ++i)
+        empty.Push(Chunk{});
+
+    std::thread parser{[&] { ParseChunks(reader, empty, filled); }};
+
+    std::string out;
+    bool is_broken = false;
+    for (bool is_last = false; !is_last;) {
+        Chunk chunk = filled.Pop();
+        is_last = chunk.is_last || chunk.is_broken;
+        is_broken = chunk.is_broken;
+
+        const double *values = chunk.values.data();
+        for (size_t size : chunk.sizes) {
+            try {
+                AppendDeterminant(out, GetDeterminant(values, size, matrix::GetScratchResource()));
+            } catch (std::exception &ex) {
+                out += "Error: ";
+                out += ex.what();
+                out.push_back('\n');
+            }
+            values += size * size;
+
+            if (out.size() >= kOutputFlushBytes) {
+                std::fwrite(out.data(), 1, out.size(), stdout);
+                out.clear();
+            }
+        }
+
+        empty.Push(std::move(chunk));
+    }
+
+    parser.join();
+    if (is_broken)
+        out += "Incorrect data\n";
+
+    std::fwrite(out.data(), 1, out.size(), stdout);
+    std::fflush(stdout);
+    return is_broken ? 1 : 0;
+}
+
+int RunSingle() {
+    matrix::InputReader reader{STDIN_FILENO};
     size_t size = 0;
     std::vector<double> nums;
-    if (!GetInput(size, nums))
-        return 1;
 
+    // Inside the try: a size below kMaxSize can still ask for more memory
+    // than there is.
     try {
-        matrix::Matrix<double> matrix{size, nums.begin(), nums.end()};
-        double det = matrix.GetDeterminant();
-
-        if (std::fabs(std::round(det) - det) < 1e-5)
-            std::cout << static_cast<long>(std::round(det)) << std::endl;
-        else
-            std::cout << std::setprecision(std::numeric_limits<double>::max_digits10)
-                      << det << std::endl;
+        if (!GetInput(reader, size, nums))
+            return 1;
+
+        std::string out;
+        AppendDeterminant(out, GetDeterminant(nums.data(), size, std::pmr::get_default_resource()));
+        std::cout << out;
     } catch (std::logic_error &logic_ex) {
         std::cout << "Logic error: " << std::endl
                   << logic_ex.what() << std::endl;
@@ -64,4 +250,32 @@ int main() {
     }
 
     return 0;
-}
\ No newline at end of file
+}
+} // namespace
+
+// Usage:
+//   main                    one matrix from stdin, its determinant to stdout
+//   main --batch [file]     a stream of matrices from file (or stdin), one
+//                           determinant per line
+int main(int argc, char *argv[]) {
+    if (argc == 1)
+        return RunSingle();
+
+    if (std::strcmp(argv[1], "--batch") != 0 || argc > 3) {
+        std::cerr << "Usage: " << argv[0] << " [--batch [file]]" << std::endl;
+        return 2;
+    }
+
+    if (argc == 2)
+        return RunBatch(STDIN_FILENO);
+
+    int fd = open(argv[2], O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Cannot open " << argv[2] << ": " << std::strerror(errno) << std::endl;
+        return 2;
+    }
+
+    int code = RunBatch(fd);
+    close(fd);
+    return code;
+}
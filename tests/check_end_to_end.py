@@ -24,7 +24,24 @@ for i in range(1, 9):
     print("-------------------------------------------------")
     num_test += 1
 
+# Batch mode: all the tests above as one stream, one determinant per line.
+batch_in = ""
+batch_ans = []
+for i in range(1, 9):
+    batch_in += open("tests/end_to_end/" + str(i) + ".dat").read() + "\n"
+    batch_ans.append(float(open("tests/end_to_end/" + str(i) + ".dat.ans").read().split()[0]))
+
+result = run(["build/src/main", "--batch"], capture_output = True, encoding='cp866', input=batch_in)
+res = list(map(float, result.stdout.split()))
+print("Test: batch")
+if len(res) == len(batch_ans) and all(abs(r - a) <= 0.00001 for r, a in zip(res, batch_ans)):
+    print("OK")
+else:
+    is_ok = False
+    print("ERROR\nExpect:", batch_ans, "\nGive:  ", res)
+print("-------------------------------------------------")
+
 if is_ok:
 	print("TESTS PASSED")
 else:
-	print("TESTS FAILED")
\ No newline at end of file
+	print("TESTS FAILED")
@@ -1,7 +1,24 @@
+#include "fixed_matrix.hpp"
+#include "input_reader.hpp"
+#include "lu.hpp"
 #include "matrix.hpp"
+#include "matrix_batch.hpp"
+#include "matrix_chain.hpp"
+#include "matrix_file.hpp"
+#include "matrix_power.hpp"
+#include "mixed_precision.hpp"
+#include "out_of_core.hpp"
+#include "shared_matrix.hpp"
+#include "sparse_matrix.hpp"
+#include "structured_matrix.hpp"
 #include <cmath>
 #include <gtest/gtest.h>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <unistd.h>
 
 TEST(MatrixTest, MatrixCtor) {
     matrix::Matrix<int> matrix1(2, 3);
@@ -296,4 +313,1601 @@ TEST(MatrixTest, OperatorEqual) {
     ASSERT_NE(matrix1, matrix2);
     ASSERT_EQ(matrix3, matrix1);
     ASSERT_EQ(matrix4, matrix2);
-}
\ No newline at end of file
+}
+
+TEST(MatrixTest, MatrixBlockedMultiply) {
+    const size_t rows = 67, inner = 601, columns = 45;
+
+    std::vector<double> vector1{};
+    for (size_t i = 0; i < rows * inner; i++)
+        vector1.push_back(std::sin(i * 0.37));
+
+    std::vector<double> vector2{};
+    for (size_t i = 0; i < inner * columns; i++)
+        vector2.push_back(std::cos(i * 0.11));
+
+    matrix::Matrix<double> matrix1(rows, inner, vector1.begin(), vector1.end());
+    matrix::Matrix<double> matrix2(inner, columns, vector2.begin(), vector2.end());
+
+    matrix::SetMultiplyMode(matrix::MultiplyMode::Deterministic);
+    matrix::Matrix<double> matrix3 = matrix1 * matrix2;
+    matrix::SetMultiplyMode(matrix::MultiplyMode::Fast);
+    matrix::Matrix<double> matrix4 = matrix1 * matrix2;
+
+    ASSERT_EQ(matrix3.GetRowCount(), rows);
+    ASSERT_EQ(matrix3.GetColumnCount(), columns);
+
+    for (size_t i = 0; i < rows; i++)
+        for (size_t j = 0; j < columns; j++) {
+            double sum = 0;
+            for (size_t k = 0; k < inner; k++)
+                sum += vector1[i * inner + k] * vector2[k * columns + j];
+
+            ASSERT_EQ(matrix3[i][j], sum);
+            ASSERT_NEAR(matrix4[i][j], sum, 1e-9);
+        }
+}
+
+template <typename T> void CheckSimdKernels() {
+    using matrix::details::simd::Isa;
+    const size_t size = 103;
+
+    std::vector<T> vector1{}, vector2{};
+    for (size_t i = 0; i < size; i++) {
+        vector1.push_back(static_cast<T>(i % 17) - 5);
+        vector2.push_back(static_cast<T>(i % 11) + 1);
+    }
+
+    for (Isa isa : {Isa::Scalar, Isa::Sse2, Isa::Avx2, Isa::Avx512}) {
+        matrix::details::simd::SetIsaLimit(isa);
+
+        matrix::Matrix<T> matrix1(1, size, vector1.begin(), vector1.end());
+        matrix::Matrix<T> matrix2(1, size, vector2.begin(), vector2.end());
+        matrix::Matrix<T> matrix3 = matrix1 + matrix2;
+        matrix::Matrix<T> matrix4 = matrix1 - matrix2;
+        matrix::Matrix<T> matrix5 = matrix1 * static_cast<T>(3);
+        T dot = matrix::details::simd::Dot(vector1.data(), vector2.data(), size);
+
+        T expected_dot = 0;
+        for (size_t i = 0; i < size; i++) {
+            ASSERT_EQ(matrix3[0][i], vector1[i] + vector2[i]);
+            ASSERT_EQ(matrix4[0][i], vector1[i] - vector2[i]);
+            ASSERT_EQ(matrix5[0][i], vector1[i] * 3);
+            expected_dot += vector1[i] * vector2[i];
+        }
+        ASSERT_EQ(dot, expected_dot);
+    }
+
+    matrix::details::simd::SetIsaLimit(Isa::Avx512);
+}
+
+TEST(MatrixTest, SimdKernels) {
+    CheckSimdKernels<float>();
+    CheckSimdKernels<double>();
+    CheckSimdKernels<int32_t>();
+    CheckSimdKernels<int64_t>();
+}
+
+TEST(MatrixTest, ThreadPoolMultiplyAndDeterminant) {
+    const size_t size = 150;
+
+    std::vector<double> vector1{};
+    std::vector<long> vector2{};
+    for (size_t i = 0; i < size * size; i++) {
+        vector1.push_back(std::sin(i * 0.7) + ((i % (size + 1) == 0) ? 4 : 0));
+        vector2.push_back((i % (size + 1) == 0) ? 2 : ((i * 7) % 5 == 0));
+    }
+
+    matrix::Matrix<double> matrix1(size, vector1.begin(), vector1.end());
+    matrix::Matrix<long> matrix2(size / 5, vector2.begin(), vector2.begin() + size * size / 25);
+
+    matrix::SetThreadCount(1);
+    matrix::Matrix<double> product1 = matrix1 * matrix1;
+    double det1 = matrix1.GetDeterminant();
+    long det2 = matrix2.GetDeterminant();
+
+    matrix::SetThreadCount(4);
+    ASSERT_EQ(matrix::GetThreadCount(), 4);
+    matrix::Matrix<double> product2 = matrix1 * matrix1;
+
+    ASSERT_EQ(product1, product2);
+    ASSERT_EQ(matrix1.GetDeterminant(), det1);
+    ASSERT_EQ(matrix2.GetDeterminant(), det2);
+
+    std::atomic<size_t> sum{0};
+    matrix::details::GetThreadPool().ParallelFor(0, 1000, 7, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            sum += i;
+    });
+    ASSERT_EQ(sum.load(), 999 * 1000 / 2);
+
+    ASSERT_THROW(matrix::details::GetThreadPool().ParallelFor(0, 100, 1, [](size_t begin, size_t) {
+        if (begin > 50)
+            throw std::runtime_error("chunk failed");
+    }), std::runtime_error);
+
+    matrix::SetThreadCount(0);
+}
+
+TEST(MatrixTest, LUDecomposition) {
+    const size_t size = 150;
+
+    std::vector<double> vector1{};
+    unsigned seed = 1;
+    for (size_t i = 0; i < size * size; i++) {
+        seed = seed * 1103515245 + 12345;
+        vector1.push_back((seed >> 16) % 1000 / 500.0 - 1);
+    }
+
+    matrix::Matrix<double> matrix1(size, vector1.begin(), vector1.end());
+    matrix::LU<double> lu(matrix1);
+    ASSERT_FALSE(lu.IsSingular());
+
+    matrix::Matrix<double> product = lu.GetL() * lu.GetU();
+    for (size_t i = 0; i < size; i++)
+        for (size_t j = 0; j < size; j++)
+            ASSERT_NEAR(product[i][j], matrix1[lu.GetPermutation()[i]][j], 1e-10);
+
+    double det = matrix1.GetDeterminant();
+    ASSERT_NEAR(lu.Determinant() / det, 1.0, 1e-8);
+
+    std::vector<double> b{};
+    for (size_t i = 0; i < size; i++)
+        b.push_back(i % 7);
+
+    std::vector<double> x = lu.Solve(b);
+    for (size_t i = 0; i < size; i++) {
+        double sum = 0;
+        for (size_t j = 0; j < size; j++)
+            sum += matrix1[i][j] * x[j];
+        ASSERT_NEAR(sum, b[i], 1e-8);
+    }
+
+    matrix::Matrix<double> identity = lu.Inverse() * matrix1;
+    for (size_t i = 0; i < size; i++)
+        for (size_t j = 0; j < size; j++)
+            ASSERT_NEAR(identity[i][j], (i == j) ? 1.0 : 0.0, 1e-8);
+
+    std::vector<double> vector2{1, 2, 3, 2, 4, 6, 1, 0, 1};
+    matrix::LU<double> singular(matrix::Matrix<double>(3, vector2.begin(), vector2.end()));
+    ASSERT_TRUE(singular.IsSingular());
+    ASSERT_EQ(singular.Determinant(), 0);
+    ASSERT_THROW(singular.Solve(b), std::logic_error);
+    ASSERT_THROW(singular.Inverse(), std::logic_error);
+}
+
+TEST(MatrixTest, PermutedRowsPivoting) {
+    std::vector<int> vector1{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+    matrix::details::PermutedRows<int> rows(vector1.data(), 4, 3);
+    rows.Swap(0, 3);
+    rows.Swap(1, 3);
+
+    ASSERT_EQ(rows[0][2], 11);
+    ASSERT_EQ(rows[1][0], 0);
+    ASSERT_EQ(rows.GetOrder(), std::vector<size_t>({3, 0, 2, 1}));
+    ASSERT_EQ(vector1[0], 0);
+
+    std::vector<int> vector2(12);
+    rows.CopyTo(vector2.data());
+    ASSERT_EQ(vector2, std::vector<int>({9, 10, 11, 0, 1, 2, 6, 7, 8, 3, 4, 5}));
+
+    // Reversed identity pivots at every step of both elimination paths.
+    const size_t size = 9;
+    std::vector<double> vector3(size * size, 0);
+    for (size_t i = 0; i < size; i++)
+        vector3[i * size + size - 1 - i] = i + 1;
+    std::vector<long> vector4(vector3.begin(), vector3.end());
+
+    matrix::Matrix<double> matrix1(size, vector3.begin(), vector3.end());
+    matrix::Matrix<long> matrix2(size, vector4.begin(), vector4.end());
+    ASSERT_DOUBLE_EQ(matrix1.GetDeterminant(), 362880);
+    ASSERT_EQ(matrix2.GetDeterminant(), 362880);
+    ASSERT_EQ(matrix1[0][size - 1], 1);
+}
+
+TEST(MatrixTest, ExpressionTemplates) {
+    std::vector<int> vector1{1, 2, 3, 4, 5, 6, 7, 8, 9};
+    std::vector<int> vector2{9, 8, 7, 6, 5, 4, 3, 2, 1};
+    std::vector<int> vector3{1, 0, 2, 0, 1, 0, 2, 0, 1};
+
+    matrix::Matrix<int> matrix1(3, vector1.begin(), vector1.end());
+    matrix::Matrix<int> matrix2(3, vector2.begin(), vector2.end());
+    matrix::Matrix<int> matrix3(3, vector3.begin(), vector3.end());
+
+    matrix::Matrix<int> matrix4 = matrix1 + matrix2 - 2 * matrix3;
+    for (size_t i = 0; i < 9; i++)
+        ASSERT_EQ(matrix4.GetData()[i], vector1[i] + vector2[i] - 2 * vector3[i]);
+
+    matrix::Matrix<int> product = matrix1;
+    product *= matrix2;
+
+    matrix::Matrix<int> matrix5 = matrix1 * matrix2 + matrix3;
+    matrix::Matrix<int> matrix6 = matrix3 - matrix1 * matrix2;
+    matrix::Matrix<int> matrix7 = (matrix1 + matrix3) * matrix2 * 3;
+    for (size_t i = 0; i < 3; i++)
+        for (size_t j = 0; j < 3; j++) {
+            int sum = 0;
+            for (size_t k = 0; k < 3; k++)
+                sum += (matrix1[i][k] + matrix3[i][k]) * matrix2[k][j];
+
+            ASSERT_EQ(matrix5[i][j], product[i][j] + matrix3[i][j]);
+            ASSERT_EQ(matrix6[i][j], matrix3[i][j] - product[i][j]);
+            ASSERT_EQ(matrix7[i][j], 3 * sum);
+        }
+
+    auto lazy = matrix1 * matrix2;
+    ASSERT_EQ(lazy[1][2], product[1][2]);
+    ASSERT_THROW(lazy[3], std::range_error);
+
+    matrix::Matrix<int> matrix8 = matrix1;
+    matrix8 = matrix8 * matrix2;
+    ASSERT_EQ(matrix8, product);
+
+    matrix8 += matrix8 * matrix3;
+    matrix8 -= matrix1 * matrix2;
+    ASSERT_EQ(matrix8, product * matrix3);
+
+    matrix8 = matrix2 + matrix8;
+    ASSERT_EQ(matrix8, matrix2 + product * matrix3);
+
+    matrix::Matrix<int> matrix9(2, 3);
+    ASSERT_THROW(matrix9 = matrix1 + matrix9, std::logic_error);
+    ASSERT_THROW(matrix9 * matrix9, std::logic_error);
+
+    // Temporaries are kept by the expression, which outlives the statement.
+    auto make = [&] { return matrix::Matrix<int>(matrix1); };
+    auto owning_product = make() * matrix2;
+    auto owning_sum = matrix3 + make();
+    auto owning_difference = make() - make() * matrix2;
+    auto owning_scale = 2 * make();
+    ASSERT_EQ(owning_product[1][2], product[1][2]);
+    ASSERT_EQ(owning_sum[2][0], matrix3[2][0] + matrix1[2][0]);
+    ASSERT_EQ(owning_difference[0][1], matrix1[0][1] - product[0][1]);
+    ASSERT_EQ(owning_scale[1][1], 2 * matrix1[1][1]);
+    ASSERT_EQ(matrix::Matrix<int>(owning_product), product);
+}
+
+TEST(MatrixTest, MatrixViews) {
+    std::vector<double> values(5 * 4);
+    for (size_t i = 0; i < values.size(); i++)
+        values[i] = static_cast<double>(i);
+
+    matrix::Matrix<double> matrix1(5, 4, values.begin(), values.end());
+    const matrix::Matrix<double> &const_matrix = matrix1;
+
+    matrix::ConstMatrixView<double> block = const_matrix.View().Block(1, 1, 3, 2);
+    ASSERT_EQ(block.GetRowCount(), 3);
+    ASSERT_EQ(block.GetColumnCount(), 2);
+    ASSERT_EQ(block(2, 1), matrix1[3][2]);
+    ASSERT_EQ(block[0][0], matrix1[1][1]);
+    ASSERT_FALSE(block.IsContiguous());
+    ASSERT_THROW(block.Block(1, 1, 3, 1), std::range_error);
+    ASSERT_THROW(block(3, 0), std::range_error);
+
+    matrix::ConstMatrixView<double> column = const_matrix.View().Column(3);
+    matrix::ConstMatrixView<double> transposed = const_matrix.View().Transposed();
+    ASSERT_EQ(transposed.GetData(), matrix1.GetData());
+    for (size_t i = 0; i < 5; i++) {
+        ASSERT_EQ(column(i, 0), matrix1[i][3]);
+        for (size_t j = 0; j < 4; j++)
+            ASSERT_EQ(transposed(j, i), matrix1[i][j]);
+    }
+
+    matrix::Matrix<double> copy = transposed;
+    ASSERT_EQ(copy, matrix1.Transpose());
+
+    // Writes through a view land in the matrix.
+    matrix::Matrix<double> matrix2 = matrix1;
+    matrix::MatrixView<double> row = matrix2.View().Row(4);
+    row *= 2.0;
+    row += matrix1.View().Row(0);
+    matrix2.View().Column(0).Assign(matrix1.View().Column(1) - matrix1.View().Column(2));
+    for (size_t j = 0; j < 4; j++)
+        ASSERT_EQ(matrix2[4][j], (j == 0) ? -1.0 : 2 * matrix1[4][j] + matrix1[0][j]);
+    for (size_t i = 0; i < 4; i++)
+        ASSERT_EQ(matrix2[i][0], -1.0);
+
+    // Products read views in place, transposed or not.
+    matrix::Matrix<double> gram = matrix1.View().Transposed() * matrix1;
+    matrix::Matrix<double> gram_copy = matrix1.Transpose() * matrix1;
+    ASSERT_EQ(gram, gram_copy);
+
+    matrix::Matrix<double> square(4, 4, values.begin(), values.begin() + 16);
+    matrix::Matrix<double> expected = square.Transpose();
+    square.View().Assign(square.View().Transposed());
+    ASSERT_EQ(square, expected);
+
+    square.View().Block(0, 0, 2, 4) -= block.Block(0, 0, 2, 2) * const_matrix.View().Block(0, 0, 2, 4);
+    for (size_t i = 0; i < 2; i++)
+        for (size_t j = 0; j < 4; j++) {
+            double sum = 0;
+            for (size_t k = 0; k < 2; k++)
+                sum += matrix1[i + 1][k + 1] * matrix1[k][j];
+
+            ASSERT_EQ(square[i][j], expected[i][j] - sum);
+        }
+
+    ASSERT_THROW(square.View().Block(0, 0, 2, 2).Assign(block), std::logic_error);
+}
+
+template <typename T> void CheckTranspose() {
+    using matrix::details::simd::Isa;
+    const std::vector<std::pair<size_t, size_t>> shapes{{1, 1}, {3, 5}, {37, 53}, {64, 64}, {100, 100}, {130, 70}};
+
+    for (Isa isa : {Isa::Scalar, Isa::Sse2, Isa::Avx2, Isa::Avx512}) {
+        matrix::details::simd::SetIsaLimit(isa);
+
+        for (auto [rows, cols] : shapes) {
+            std::vector<T> values(rows * cols);
+            for (size_t i = 0; i < values.size(); i++)
+                values[i] = static_cast<T>(i);
+
+            matrix::Matrix<T> matrix1(rows, cols, values.begin(), values.end());
+            matrix::Matrix<T> matrix2 = matrix1.Transpose();
+            ASSERT_EQ(matrix2.GetRowCount(), cols);
+            ASSERT_EQ(matrix2.GetColumnCount(), rows);
+            for (size_t i = 0; i < rows; i++)
+                for (size_t j = 0; j < cols; j++)
+                    ASSERT_EQ(matrix2[j][i], matrix1[i][j]);
+
+            matrix::Matrix<T> matrix3 = matrix1;
+            matrix3.TransposeInPlace();
+            ASSERT_EQ(matrix3, matrix2);
+            matrix3.TransposeInPlace();
+            ASSERT_EQ(matrix3, matrix1);
+        }
+    }
+
+    matrix::details::simd::SetIsaLimit(Isa::Avx512);
+}
+
+TEST(MatrixTest, TiledTranspose) {
+    CheckTranspose<float>();
+    CheckTranspose<double>();
+    CheckTranspose<int32_t>();
+    CheckTranspose<int64_t>();
+    CheckTranspose<int16_t>();
+}
+
+template <typename T, size_t N> void CheckFixedMatrix() {
+    std::vector<T> values{};
+    for (size_t i = 0; i < N * N; i++)
+        values.push_back(static_cast<T>((i * 7 + 3) % 11) - 5 + ((i % (N + 1) == 0) ? 4 : 0));
+
+    matrix::FixedMatrix<T, N> fixed1(values.begin(), values.end());
+    matrix::Matrix<T> matrix1(N, values.begin(), values.end());
+    matrix::FixedMatrix<T, N> fixed2 = fixed1.Transpose() + fixed1 * static_cast<T>(2);
+    matrix::Matrix<T> matrix2 = matrix1.Transpose() + matrix1 * static_cast<T>(2);
+    ASSERT_EQ(fixed2.ToMatrix(), matrix2);
+
+    matrix::Matrix<T> product = matrix1;
+    product *= matrix2;
+    ASSERT_EQ((fixed1 * fixed2).ToMatrix(), product);
+
+    if constexpr (std::is_integral_v<T>)
+        ASSERT_EQ(fixed1.GetDeterminant(), matrix1.GetDeterminant());
+    else
+        ASSERT_NEAR(fixed1.GetDeterminant(), matrix1.GetDeterminant(), 1e-9 * std::fabs(matrix1.GetDeterminant()));
+}
+
+TEST(MatrixTest, FixedMatrix) {
+    constexpr std::array<int, 6> values{1, 2, 3, 4, 5, 6};
+    constexpr matrix::FixedMatrix<int, 2, 3> fixed1(values.begin(), values.end());
+    constexpr matrix::FixedMatrix<int, 3, 2> fixed2 = fixed1.Transpose();
+    constexpr matrix::FixedMatrix<int, 2> gram = fixed1 * fixed2;
+    static_assert(gram[0][0] == 14 && gram[0][1] == 32 && gram[1][1] == 77);
+    static_assert(gram.GetDeterminant() == 14 * 77 - 32 * 32);
+    static_assert((gram * matrix::FixedMatrix<int, 2>::Identity()) == gram);
+    static_assert(sizeof(matrix::FixedMatrix<double, 4>) == 16 * sizeof(double));
+
+    CheckFixedMatrix<int64_t, 1>();
+    CheckFixedMatrix<int64_t, 2>();
+    CheckFixedMatrix<int64_t, 3>();
+    CheckFixedMatrix<int64_t, 4>();
+    CheckFixedMatrix<int64_t, 6>();
+    CheckFixedMatrix<double, 2>();
+    CheckFixedMatrix<double, 3>();
+    CheckFixedMatrix<double, 4>();
+    CheckFixedMatrix<double, 5>();
+
+    matrix::FixedMatrix<double, 3> singular{};
+    ASSERT_EQ(singular.GetDeterminant(), 0);
+    ASSERT_THROW((matrix::FixedMatrix<int, 2>(values.begin(), values.end())), std::range_error);
+    ASSERT_THROW((matrix::FixedMatrix<int, 2>(matrix::Matrix<int>(3))), std::logic_error);
+    ASSERT_THROW(gram[2], std::range_error);
+
+    // Integer overflow goes to Matrix<T>: its exact path gives a determinant
+    // that fits, std::range_error one that does not.
+    std::array<int64_t, 25> wide{};
+    for (size_t i = 0; i < 4; ++i)
+        wide[i * 6] = (i < 2) ? int64_t{1} << 40 : 1;
+
+    matrix::FixedMatrix<int64_t, 5> wide_singular(wide.begin(), wide.end());
+    ASSERT_EQ(wide_singular.GetDeterminant(), 0);
+    wide[24] = 1;
+    matrix::FixedMatrix<int64_t, 5> wide_regular(wide.begin(), wide.end());
+    ASSERT_THROW(wide_regular.GetDeterminant(), std::range_error);
+    ASSERT_THROW(wide_regular.ToMatrix().GetDeterminant(), std::range_error);
+}
+
+namespace {
+class CountingResource : public std::pmr::memory_resource {
+public:
+    size_t allocations = 0;
+    size_t deallocations = 0;
+    size_t max_alignment = 0;
+private:
+    void *do_allocate(size_t bytes, size_t alignment) override {
+        ++allocations;
+        max_alignment = std::max(max_alignment, alignment);
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *ptr, size_t bytes, size_t alignment) override {
+        ++deallocations;
+        std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+}; // class CountingResource
+} // namespace
+
+TEST(MatrixTest, MemoryResources) {
+    std::vector<double> values{2, 1, 0, 1, 3, 1, 0, 1, 4};
+    CountingResource counting;
+
+    {
+        matrix::Matrix<double> matrix1(3, 3, values.begin(), values.end(), &counting);
+        ASSERT_EQ(matrix1.GetResource(), &counting);
+        ASSERT_EQ(counting.allocations, 1);
+        ASSERT_EQ(counting.max_alignment, alignof(double));
+
+        matrix::Matrix<double> copy = matrix1;
+        ASSERT_EQ(copy.GetResource(), std::pmr::get_default_resource());
+
+        matrix1 *= copy;
+        ASSERT_EQ(matrix1.GetResource(), &counting);
+        ASSERT_EQ(counting.allocations, 2);
+
+        matrix::Matrix<double> moved = std::move(matrix1);
+        ASSERT_EQ(moved.GetResource(), &counting);
+        ASSERT_EQ(counting.allocations, 2);
+    }
+    ASSERT_EQ(counting.deallocations, counting.allocations);
+
+    // Buffers from 1 KiB on start on a cache line.
+    matrix::Matrix<double> large(16, 16, &counting);
+    ASSERT_EQ(counting.max_alignment, 64);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(large.GetData()) % 64, 0);
+
+    // Library temporaries come from the thread's scratch pool, not the default resource.
+    matrix::Matrix<double> matrix2(3, 3, values.begin(), values.end());
+    matrix::Matrix<double> matrix3(3, 3, values.begin(), values.end());
+    CountingResource global;
+    std::pmr::memory_resource *previous = std::pmr::set_default_resource(&global);
+    double det = matrix2.GetDeterminant();
+    matrix2 += matrix2.View().Transposed() * matrix3;
+    std::pmr::set_default_resource(previous);
+
+    ASSERT_NEAR(det, 18, 1e-12);
+    ASSERT_EQ(global.allocations, 0);
+    ASSERT_EQ(matrix::GetScratchResource(), matrix::GetScratchResource());
+    ASSERT_EQ(matrix::details::PaddedStride<double>(3), 8);
+    ASSERT_EQ(matrix::details::PaddedStride<float>(17), 32);
+}
+
+namespace {
+// Reads "3 +1.5 -2e3 1e-2 7" and a trailing malformed token from reader.
+void CheckInputReader(matrix::InputReader &reader) {
+    size_t size = 0;
+    ASSERT_TRUE(reader.Read(size));
+    ASSERT_EQ(size, 3);
+
+    double values[4] = {};
+    for (double &value : values)
+        ASSERT_TRUE(reader.Read(value));
+    ASSERT_EQ(values[0], 1.5);
+    ASSERT_EQ(values[1], -2000.0);
+    ASSERT_EQ(values[2], 0.01);
+    ASSERT_EQ(values[3], 7.0);
+
+    ASSERT_FALSE(reader.AtEnd());
+    ASSERT_FALSE(reader.Read(values[0]));
+    ASSERT_TRUE(reader.AtEnd());
+    ASSERT_FALSE(reader.Read(values[0]));
+}
+} // namespace
+
+TEST(MatrixTest, InputReader) {
+    const std::string text = "  3\n+1.5 -2e3\t1e-2\r\n7 1.2.3\n\n";
+
+    FILE *file = std::tmpfile();
+    ASSERT_NE(file, nullptr);
+    std::fwrite(text.data(), 1, text.size(), file);
+    std::fflush(file);
+    {
+        matrix::InputReader reader{fileno(file)};
+        ASSERT_TRUE(reader.IsMapped());
+        CheckInputReader(reader);
+    }
+    std::fclose(file);
+
+    // A pipe is read through the buffer; two bytes force tokens across refills.
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    ASSERT_EQ(write(fds[1], text.data(), text.size()), static_cast<ssize_t>(text.size()));
+    close(fds[1]);
+    {
+        matrix::InputReader reader{fds[0], 2};
+        ASSERT_FALSE(reader.IsMapped());
+        CheckInputReader(reader);
+    }
+    close(fds[0]);
+
+    ASSERT_EQ(pipe(fds), 0);
+    ASSERT_EQ(write(fds[1], "-1 x", 4), 4);
+    close(fds[1]);
+    {
+        matrix::InputReader reader{fds[0]};
+        size_t size = 0;
+        ASSERT_FALSE(reader.Read(size));
+        ASSERT_FALSE(reader.Read(size));
+        ASSERT_TRUE(reader.AtEnd());
+    }
+    close(fds[0]);
+}
+
+namespace {
+// Unique file name under /tmp, removed by the destructor.
+class TempFile {
+public:
+    TempFile() {
+        char name[] = "/tmp/matrix_test_XXXXXX";
+        int fd = mkstemp(name);
+        close(fd);
+        path_ = name;
+    }
+    TempFile(const TempFile &other) = delete;
+    TempFile &operator=(const TempFile &other) = delete;
+    ~TempFile() { std::remove(path_.c_str()); }
+
+    const std::string &Path() const { return path_; }
+private:
+    std::string path_;
+};
+} // namespace
+
+TEST(MatrixTest, MatrixFile) {
+    std::vector<double> values(35);
+    for (size_t i = 0; i < values.size(); ++i)
+        values[i] = 0.5 * static_cast<double>(i) - 3;
+    matrix::Matrix<double> matrix1(5, 7, values.begin(), values.end());
+
+    TempFile file;
+    matrix::WriteMatrixFile(file.Path(), matrix1);
+    ASSERT_TRUE(matrix::ReadMatrixFile<double>(file.Path()) == matrix1);
+
+    {
+        matrix::MappedMatrix<double> mapped(file.Path());
+        ASSERT_EQ(mapped.GetHeader().payload_offset, 64);
+        ASSERT_EQ(mapped.GetHeader().dtype, matrix::DType::Float64);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(mapped.View().GetData()) % 64, 0);
+        ASSERT_TRUE(matrix::Matrix<double>(mapped.View()) == matrix1);
+        ASSERT_THROW(mapped.MutableView() += matrix1, std::logic_error);
+        ASSERT_THROW(matrix::MappedMatrix<float>(file.Path()), std::logic_error);
+    }
+
+    // A strided block with padded rows and a wider payload alignment.
+    matrix::ConstMatrixView<double> block = matrix1.View().Block(1, 2, 3, 4).Transposed();
+    matrix::WriteMatrixFile(file.Path(), block, 8, 256);
+    {
+        matrix::MappedMatrix<double> mapped(file.Path(), matrix::MapMode::ReadWrite);
+        ASSERT_EQ(mapped.GetHeader().payload_offset, 256);
+        ASSERT_EQ(mapped.View().GetRowStride(), 8);
+        ASSERT_TRUE(matrix::Matrix<double>(mapped.View()) == matrix::Matrix<double>(block));
+        mapped.MutableView() *= 2.0;
+    }
+    matrix::Matrix<double> doubled = 2.0 * block;
+    ASSERT_TRUE(matrix::ReadMatrixFile<double>(file.Path()) == doubled);
+
+    // The same file as a machine of the other byte order would write it.
+    {
+        matrix::MappedMatrix<double> mapped(file.Path(), matrix::MapMode::ReadWrite);
+        matrix::FileHeader header = mapped.GetHeader();
+        matrix::MatrixView<double> payload = mapped.MutableView();
+        for (size_t i = 0; i < payload.GetRowCount(); ++i)
+            for (size_t j = 0; j < payload.GetColumnCount(); ++j)
+                payload(i, j) = matrix::details::file::ByteSwap(payload(i, j));
+
+        header.version = matrix::details::file::ByteSwap(header.version);
+        header.byte_order = matrix::details::file::ByteSwap(header.byte_order);
+        header.alignment = matrix::details::file::ByteSwap(header.alignment);
+        header.row_count = matrix::details::file::ByteSwap(header.row_count);
+        header.column_count = matrix::details::file::ByteSwap(header.column_count);
+        header.row_stride = matrix::details::file::ByteSwap(header.row_stride);
+        header.payload_offset = matrix::details::file::ByteSwap(header.payload_offset);
+        std::memcpy(payload.GetData() - 256 / sizeof(double), &header, sizeof(header));
+    }
+    {
+        matrix::MappedMatrix<double> mapped(file.Path());
+        ASSERT_TRUE(mapped.IsByteSwapped());
+        ASSERT_THROW(mapped.View(), std::logic_error);
+        ASSERT_TRUE(mapped.ToMatrix() == doubled);
+    }
+
+    ASSERT_EQ(truncate(file.Path().c_str(), 300), 0);
+    ASSERT_THROW(matrix::MappedMatrix<double>(file.Path()), std::runtime_error);
+    ASSERT_THROW(matrix::MappedMatrix<double>("/nonexistent/matrix"), std::runtime_error);
+    ASSERT_THROW(matrix::WriteMatrixFile(file.Path(), matrix1, 3), std::logic_error);
+}
+
+TEST(MatrixTest, BigInt) {
+    matrix::BigInt value = matrix::BigInt::FromUnsigned(1);
+    for (int i = 0; i < 3; ++i)
+        value.MultiplyAdd(10'000'000'000ULL, 0);
+    value.MultiplyAdd(1, 7);
+
+    ASSERT_EQ(value.ToString(), "1000000000000000000000000000007");
+    ASSERT_EQ((-value).ToString(), "-1000000000000000000000000000007");
+    ASSERT_EQ((value - value).ToString(), "0");
+    ASSERT_EQ((matrix::BigInt(5) - value).ToString(), "-1000000000000000000000000000002");
+    ASSERT_EQ((matrix::BigInt(-5) - matrix::BigInt(-7)).ToString(), "2");
+    ASSERT_TRUE(matrix::BigInt(-3) < matrix::BigInt(2));
+    ASSERT_TRUE(-value < matrix::BigInt(-3));
+    ASSERT_EQ(value.GetBitCount(), 100);
+    ASSERT_NEAR(value.ToDouble(), 1e30, 1e15);
+
+    ASSERT_EQ(matrix::BigInt(-128).To<int8_t>(), -128);
+    ASSERT_EQ(matrix::BigInt::FromUnsigned(~0ULL).To<uint64_t>(), ~0ULL);
+    ASSERT_THROW(matrix::BigInt(128).To<int8_t>(), std::range_error);
+    ASSERT_THROW(matrix::BigInt(-1).To<unsigned>(), std::range_error);
+    ASSERT_THROW(value.To<int64_t>(), std::range_error);
+}
+
+namespace {
+// Rows of L * U in a shuffled order, with L unit lower triangular and U
+// upper triangular with the given diagonal: the determinant is known
+// exactly, while elimination meets minors far larger than the entries.
+template <typename T>
+matrix::Matrix<T> KnownDeterminantMatrix(const std::vector<int64_t> &diagonal, int64_t range,
+                                         matrix::BigInt &det) {
+    size_t size = diagonal.size();
+    std::vector<int64_t> lower(size * size, 0);
+    std::vector<int64_t> upper(size * size, 0);
+    uint64_t seed = 7;
+    auto next = [&] {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<int64_t>((seed >> 33) % static_cast<uint64_t>(2 * range + 1)) - range;
+    };
+
+    for (size_t i = 0; i < size; ++i) {
+        lower[i * size + i] = 1;
+        upper[i * size + i] = diagonal[i];
+        for (size_t j = 0; j < i; ++j)
+            lower[i * size + j] = next();
+        for (size_t j = i + 1; j < size; ++j)
+            upper[i * size + j] = next();
+    }
+
+    // Reversing the rows is size / 2 swaps.
+    std::vector<T> values(size * size);
+    for (size_t i = 0; i < size; ++i)
+        for (size_t j = 0; j < size; ++j) {
+            int64_t sum = 0;
+            for (size_t k = 0; k < size; ++k)
+                sum += lower[i * size + k] * upper[k * size + j];
+            values[(size - 1 - i) * size + j] = static_cast<T>(sum);
+        }
+
+    det = matrix::BigInt::FromUnsigned(1);
+    bool is_negative = (size / 2) % 2 == 1;
+    for (int64_t value : diagonal) {
+        det.MultiplyAdd(static_cast<uint64_t>(value < 0 ? -value : value), 0);
+        is_negative ^= value < 0;
+    }
+    if (is_negative)
+        det = -det;
+
+    return matrix::Matrix<T>(size, values.begin(), values.end());
+}
+} // namespace
+
+TEST(MatrixTest, ExactDeterminant) {
+    matrix::BigInt det;
+
+    // Far past int64_t: every path but the modular one overflows.
+    std::vector<int64_t> diagonal(40);
+    for (size_t i = 0; i < diagonal.size(); ++i)
+        diagonal[i] = (i % 3 == 0) ? -999'983 : 1'000'003 + static_cast<int64_t>(i);
+    matrix::Matrix<int64_t> large = KnownDeterminantMatrix<int64_t>(diagonal, 1000, det);
+    ASSERT_EQ(large.GetExactDeterminant(), det);
+    ASSERT_THROW(large.GetDeterminant(), std::range_error);
+
+    // A small determinant behind intermediate minors that overflow int.
+    std::vector<int64_t> small(24, 1);
+    small[3] = -2;
+    small[10] = 3;
+    matrix::Matrix<int> overflowing = KnownDeterminantMatrix<int>(small, 30, det);
+    ASSERT_EQ(det.ToString(), "-6");
+    ASSERT_EQ(overflowing.GetDeterminant(), -6);
+    ASSERT_EQ(overflowing.GetExactDeterminant(), det);
+    ASSERT_EQ(matrix::details::exact::Determinant(overflowing.GetData(), 24, 24), det);
+
+    matrix::Matrix<unsigned> unsigned_matrix = KnownDeterminantMatrix<unsigned>({3, 1, 2, 1}, 0, det);
+    ASSERT_EQ(unsigned_matrix.GetDeterminant(), 6);
+
+    // Singular: rows 0 and 2 are equal.
+    std::vector<long> singular_values{2, -7, 4, 1, 5, 3, 2, -7, 4};
+    matrix::Matrix<long> singular(3, singular_values.begin(), singular_values.end());
+    ASSERT_EQ(singular.GetDeterminant(), 0);
+    ASSERT_EQ(matrix::details::exact::Determinant(singular.GetData(), 3, 3), matrix::BigInt(0));
+
+    std::vector<int> values{2, -7, 4, 1, 5, 3, 6, 0, -8};
+    matrix::Matrix<int> matrix1(3, values.begin(), values.end());
+    ASSERT_EQ(matrix::details::exact::Determinant(matrix1.GetData(), 3, 3), matrix::BigInt(matrix1.GetDeterminant()));
+
+    ASSERT_TRUE(matrix::details::exact::IsPrime((1ULL << 61) - 1));
+    ASSERT_FALSE(matrix::details::exact::IsPrime(3215031751ULL));
+    matrix::details::exact::Modulus modulus{(1ULL << 61) - 1};
+    ASSERT_EQ(modulus.Mul(modulus.Inverse(123456789), 123456789), 1);
+}
+
+namespace {
+bool CheckMatrixEqual(const matrix::Matrix<double> &lhs, const matrix::Matrix<double> &rhs, double tolerance) {
+    if (lhs.GetRowCount() != rhs.GetRowCount() || lhs.GetColumnCount() != rhs.GetColumnCount())
+        return false;
+
+    for (size_t i = 0; i < lhs.GetRowCount() * lhs.GetColumnCount(); ++i)
+        if (std::fabs(lhs.GetData()[i] - rhs.GetData()[i]) > tolerance)
+            return false;
+
+    return true;
+}
+
+// Random size x size matrix with about density * size^2 nonzeros and a
+// strong diagonal, as both triplets and a dense matrix.
+matrix::Matrix<double> RandomSparse(size_t size, double density, uint64_t seed,
+                                    std::vector<matrix::Triplet<double>> &triplets) {
+    std::vector<double> values(size * size, 0.0);
+    triplets.clear();
+    auto next = [&] {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<double>(seed >> 11) / static_cast<double>(1ULL << 53);
+    };
+
+    for (size_t i = 0; i < size; ++i)
+        for (size_t j = 0; j < size; ++j)
+            if (i == j || next() < density) {
+                double value = (i == j) ? 2.0 + next() : next() - 0.5;
+                values[i * size + j] = value;
+                triplets.push_back({i, j, value});
+            }
+
+    return matrix::Matrix<double>(size, values.begin(), values.end());
+}
+} // namespace
+
+TEST(MatrixTest, SparseMatrix) {
+    std::vector<matrix::Triplet<double>> triplets{{1, 2, 3.0}, {0, 0, 1.0}, {1, 2, 0.5}, {2, 1, -2.0}, {1, 0, 4.0}};
+    matrix::SparseMatrix<double> sparse(3, 3, triplets);
+    ASSERT_EQ(sparse.GetNonZeroCount(), 4);
+    ASSERT_EQ(sparse.GetRowOffsets(), (std::vector<size_t>{0, 1, 3, 4}));
+    ASSERT_EQ(sparse.GetColumnIndices(), (std::vector<size_t>{0, 0, 2, 1}));
+    ASSERT_EQ(sparse(1, 2), 3.5);
+    ASSERT_EQ(sparse(2, 2), 0.0);
+    ASSERT_THROW(sparse(3, 0), std::range_error);
+    ASSERT_THROW(matrix::SparseMatrix<double>(2, 2, {{2, 0, 1.0}}), std::range_error);
+
+    std::vector<double> dense_values{1, 0, 0, 4, 0, 3.5, 0, -2, 0};
+    matrix::Matrix<double> dense(3, dense_values.begin(), dense_values.end());
+    ASSERT_TRUE(sparse.ToMatrix() == dense);
+    ASSERT_TRUE(matrix::SparseMatrix<double>(dense).ToMatrix() == dense);
+    ASSERT_TRUE(sparse.Transpose().ToMatrix() == dense.Transpose());
+    ASSERT_EQ(sparse.Multiply(std::vector<double>{1, 2, 3}), (std::vector<double>{1, 14.5, -4}));
+    ASSERT_NEAR(sparse.GetDeterminant(), dense.GetDeterminant(), 1e-12);
+
+    for (size_t size : {1, 7, 60, 300}) {
+        matrix::Matrix<double> lhs = RandomSparse(size, 0.03, size, triplets);
+        matrix::SparseMatrix<double> lhs_sparse(size, size, triplets);
+        matrix::Matrix<double> rhs = RandomSparse(size, 0.05, size + 1, triplets);
+        matrix::SparseMatrix<double> rhs_sparse(size, size, triplets);
+
+        ASSERT_TRUE(matrix::SparseMatrix<double>(lhs).ToMatrix() == lhs);
+        ASSERT_TRUE(CheckMatrixEqual(lhs_sparse * rhs, lhs * rhs, 1e-9));
+        ASSERT_TRUE(CheckMatrixEqual((lhs_sparse * rhs_sparse).ToMatrix(), lhs * rhs, 1e-9));
+        ASSERT_TRUE(CheckMatrixEqual(lhs_sparse.Multiply(rhs.View().Transposed()), lhs * rhs.Transpose(), 1e-9));
+
+        double det = lhs.GetDeterminant();
+        ASSERT_NEAR(lhs_sparse.GetDeterminant() / det, 1.0, 1e-9);
+        ASSERT_NEAR(*lhs_sparse.TryGetDeterminant(size * size) / det, 1.0, 1e-9);
+    }
+
+    // Permuted rows: the pivots have to come off the diagonal.
+    std::vector<double> permuted{0, 0, 2, 0, 3, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 5, 0, 0};
+    matrix::Matrix<double> permuted_dense(3, 6, permuted.begin(), permuted.end());
+    std::vector<double> square{0, 0, 2, 1, 0, 0, 0, 3, 0};
+    matrix::Matrix<double> square_dense(3, square.begin(), square.end());
+    ASSERT_NEAR(matrix::SparseMatrix<double>(square_dense).GetDeterminant(), square_dense.GetDeterminant(), 1e-12);
+    ASSERT_THROW(matrix::SparseMatrix<double>(permuted_dense).GetDeterminant(), std::logic_error);
+
+    std::vector<double> singular{1, 2, 0, 2, 4, 0, 0, 0, 3};
+    matrix::Matrix<double> singular_dense(3, singular.begin(), singular.end());
+    ASSERT_EQ(matrix::SparseMatrix<double>(singular_dense).GetDeterminant(), 0.0);
+
+    // A dense pattern fills in past any small budget.
+    std::vector<double> full{4, 1, 1, 1, 4, 1, 1, 1, 4};
+    matrix::SparseMatrix<double> full_sparse(matrix::Matrix<double>(3, full.begin(), full.end()));
+    ASSERT_FALSE(full_sparse.TryGetDeterminant(2).has_value());
+    ASSERT_NEAR(*full_sparse.TryGetDeterminant(9), 54.0, 1e-12);
+
+    // A path 0 - 1 - 2 - 3 is eliminated from its end: every elimination
+    // takes the node out of its neighbour's degree and out of the graph,
+    // which shrinks from 6 adjacency entries to 4, 2 and 0.
+    std::vector<double> path{2, 1, 0, 0, 1, 2, 1, 0, 0, 1, 2, 1, 0, 0, 1, 2};
+    matrix::SparseMatrix<double> path_sparse(matrix::Matrix<double>(4, path.begin(), path.end()));
+    std::optional<std::vector<size_t>> path_order = matrix::details::sparse::MinimumDegreeOrder(
+        4, path_sparse.GetRowOffsets(), path_sparse.GetColumnIndices(), 4);
+    ASSERT_TRUE(path_order.has_value());
+    ASSERT_EQ(*path_order, (std::vector<size_t>{0, 1, 2, 3}));
+    ASSERT_FALSE(matrix::details::sparse::MinimumDegreeOrder(4, path_sparse.GetRowOffsets(),
+                                                             path_sparse.GetColumnIndices(), 3).has_value());
+}
+
+TEST(MatrixTest, StrassenMultiply) {
+    // A small crossover makes these sizes recurse two or three levels, with
+    // every kind of odd dimension on the way down.
+    matrix::SetStrassenCrossover(8);
+
+    for (auto [rows, inner, columns] : {std::tuple<size_t, size_t, size_t>{32, 32, 32}, {37, 41, 53}, {50, 9, 64}}) {
+        std::vector<int> values1(rows * inner);
+        std::vector<int> values2(inner * columns);
+        for (size_t i = 0; i < values1.size(); ++i)
+            values1[i] = static_cast<int>(i * 7919 % 201) - 100;
+        for (size_t i = 0; i < values2.size(); ++i)
+            values2[i] = static_cast<int>(i * 104729 % 199) - 99;
+
+        matrix::Matrix<int> lhs(rows, inner, values1.begin(), values1.end());
+        matrix::Matrix<int> rhs(inner, columns, values2.begin(), values2.end());
+
+        std::vector<int> naive(rows * columns, 0);
+        for (size_t i = 0; i < rows; ++i)
+            for (size_t j = 0; j < columns; ++j)
+                for (size_t k = 0; k < inner; ++k)
+                    naive[i * columns + j] += values1[i * inner + k] * values2[k * columns + j];
+        matrix::Matrix<int> expected(rows, columns, naive.begin(), naive.end());
+
+        // Integers always take the recursion, and stay exact.
+        ASSERT_TRUE(matrix::Matrix<int>(lhs * rhs) == expected);
+        matrix::Matrix<int> product = lhs;
+        product *= rhs;
+        ASSERT_TRUE(product == expected);
+
+        matrix::Matrix<long> wide_lhs(rows, inner, values1.begin(), values1.end());
+        matrix::Matrix<long> wide_rhs(inner, columns, values2.begin(), values2.end());
+        matrix::Matrix<long> wide = wide_lhs * wide_rhs;
+        for (size_t i = 0; i < rows; ++i)
+            for (size_t j = 0; j < columns; ++j)
+                ASSERT_EQ(wide[i][j], expected[i][j]);
+
+        // Floating point only in Strassen mode, close to the plain GEMM.
+        matrix::Matrix<double> double_lhs(rows, inner, values1.begin(), values1.end());
+        matrix::Matrix<double> double_rhs(inner, columns, values2.begin(), values2.end());
+        matrix::Matrix<double> plain = double_lhs * double_rhs;
+        matrix::SetMultiplyMode(matrix::MultiplyMode::Strassen);
+        matrix::Matrix<double> fast = double_lhs * double_rhs;
+        matrix::SetMultiplyMode(matrix::MultiplyMode::Fast);
+        ASSERT_TRUE(CheckMatrixEqual(fast, plain, 1e-9));
+        for (size_t i = 0; i < rows; ++i)
+            for (size_t j = 0; j < columns; ++j)
+                ASSERT_EQ(plain[i][j], expected[i][j]);
+    }
+
+    matrix::SetStrassenCrossover(512);
+}
+
+TEST(MatrixTest, MatrixBatch) {
+    // 37 matrices: not a whole number of vectors, so the last one shares
+    // its register with padding lanes.
+    constexpr size_t kCount = 37;
+    constexpr size_t kSize = 5;
+
+    matrix::MatrixBatch<double> doubles(kCount, kSize, kSize);
+    matrix::MatrixBatch<int64_t> integers(kCount, kSize, kSize);
+    std::vector<matrix::Matrix<double>> double_matrices;
+    std::vector<matrix::Matrix<int64_t>> integer_matrices;
+    for (size_t k = 0; k < kCount; ++k) {
+        std::vector<int64_t> values(kSize * kSize);
+        for (size_t e = 0; e < values.size(); ++e)
+            values[e] = static_cast<int64_t>((k * 31 + e * 17) % 11) - 5;
+
+        // A zero first column, then a repeated row: singular lanes next
+        // to regular ones.
+        if (k % 7 == 3)
+            for (size_t i = 0; i < kSize; ++i)
+                values[i * kSize] = 0;
+        if (k % 7 == 5)
+            std::copy_n(values.begin(), kSize, values.begin() + kSize);
+
+        double_matrices.emplace_back(kSize, values.begin(), values.end());
+        integer_matrices.emplace_back(kSize, values.begin(), values.end());
+        doubles.Set(k, double_matrices.back());
+        integers.Set(k, integer_matrices.back());
+    }
+
+    // Every vector width the CPU offers takes its turn.
+    using matrix::details::simd::Isa;
+    for (Isa isa : {Isa::Avx512, Isa::Avx2, Isa::Sse2}) {
+        matrix::details::simd::SetIsaLimit(isa);
+        std::vector<double> double_dets = doubles.Determinant();
+        std::vector<int64_t> integer_dets = integers.Determinant();
+        ASSERT_EQ(double_dets.size(), kCount);
+        for (size_t k = 0; k < kCount; ++k) {
+            ASSERT_EQ(integer_dets[k], integer_matrices[k].GetDeterminant());
+            ASSERT_NEAR(double_dets[k], static_cast<double>(integer_dets[k]), 1e-9);
+            if (k % 7 == 3 || k % 7 == 5) {
+                ASSERT_EQ(integer_dets[k], 0);
+            }
+        }
+    }
+    matrix::details::simd::SetIsaLimit(Isa::Avx512);
+
+    // Entries near 2^40 overflow the intermediates of the vector Bareiss;
+    // those lanes come out exact, and a determinant past int64_t throws.
+    matrix::MatrixBatch<int64_t> large(integers);
+    std::vector<int64_t> repeated(kSize * kSize, int64_t{1} << 40);
+    std::vector<int64_t> diagonal(kSize * kSize, 0);
+    for (size_t i = 0; i < kSize; ++i) {
+        repeated[i * kSize + i] += static_cast<int64_t>(i);
+        diagonal[i * kSize + i] = (i < 3) ? (int64_t{1} << 20) : 1;
+    }
+    std::copy_n(repeated.begin(), kSize, repeated.begin() + kSize);
+    large.Set(0, matrix::Matrix<int64_t>(kSize, repeated.begin(), repeated.end()));
+    large.Set(kCount - 1, matrix::Matrix<int64_t>(kSize, diagonal.begin(), diagonal.end()));
+    std::vector<int64_t> large_dets = large.Determinant();
+    ASSERT_EQ(large_dets[0], 0);
+    ASSERT_EQ(large_dets[kCount - 1], int64_t{1} << 60);
+    for (size_t k = 1; k + 1 < kCount; ++k)
+        ASSERT_EQ(large_dets[k], integer_matrices[k].GetDeterminant());
+    diagonal[kSize * kSize - 1] = 16;
+    large.Set(1, matrix::Matrix<int64_t>(kSize, diagonal.begin(), diagonal.end()));
+    ASSERT_THROW(large.Determinant(), std::range_error);
+
+    matrix::MatrixBatch<double> transposed = doubles.Transpose();
+    matrix::MatrixBatch<double> products = doubles.Multiply(transposed);
+    for (size_t k = 0; k < kCount; ++k) {
+        ASSERT_TRUE(transposed.ToMatrix(k) == double_matrices[k].Transpose());
+        ASSERT_TRUE(products.ToMatrix(k) == matrix::Matrix<double>(double_matrices[k] * double_matrices[k].Transpose()));
+    }
+
+    matrix::MatrixBatch<double> wide(kCount, kSize, kSize + 1);
+    ASSERT_EQ(doubles.Multiply(wide).GetColumnCount(), kSize + 1);
+    ASSERT_THROW(wide.Determinant(), std::logic_error);
+    ASSERT_THROW(wide.Multiply(doubles), std::logic_error);
+    ASSERT_THROW(doubles.Multiply(matrix::MatrixBatch<double>(kCount + 1, kSize, kSize)), std::logic_error);
+    ASSERT_THROW(doubles(kCount, 0, 0), std::range_error);
+
+    // Results come from the resource of the batch they are computed from.
+    CountingResource counting;
+    matrix::MatrixBatch<double> pooled(doubles, &counting);
+    ASSERT_EQ(pooled.GetResource(), &counting);
+    ASSERT_EQ(pooled.Transpose().GetResource(), &counting);
+    ASSERT_EQ(pooled.Multiply(doubles).GetResource(), &counting);
+    ASSERT_EQ(counting.allocations, 3);
+}
+
+TEST(MatrixTest, MixedPrecisionSolve) {
+    // Pivot products that leave the range of double on the way although
+    // the determinant itself is 1, and a determinant past the range.
+    constexpr size_t kScaledSize = 160;
+    std::vector<double> scaled(kScaledSize * kScaledSize, 0.0);
+    for (size_t i = 0; i < kScaledSize; ++i)
+        scaled[i * kScaledSize + i] = (i < kScaledSize / 2) ? 1e4 : 1e-4;
+    matrix::Matrix<double> scaled_matrix(kScaledSize, scaled.begin(), scaled.end());
+    ASSERT_NEAR(scaled_matrix.GetDeterminant(), 1.0, 1e-12);
+    ASSERT_NEAR(matrix::LU<double>(scaled_matrix).Determinant(), 1.0, 1e-12);
+
+    // The pivot tolerance follows the scale of the entries.
+    std::vector<double> tiny{3e-12, 1e-12, 1e-12, 2e-12};
+    ASSERT_NEAR(matrix::Matrix<double>(2, tiny.begin(), tiny.end()).GetDeterminant(), 5e-24, 1e-36);
+
+    constexpr size_t kSize = 400;
+    std::vector<double> diagonal(kSize * kSize, 0.0);
+    for (size_t i = 0; i < kSize; ++i)
+        diagonal[i * kSize + i] = (i == 0) ? -10.0 : 10.0;
+    matrix::LU<double> huge(matrix::Matrix<double>(kSize, diagonal.begin(), diagonal.end()));
+    ASSERT_TRUE(std::isinf(huge.Determinant()));
+    ASSERT_NEAR(huge.LogAbsDeterminant(), kSize * std::log(10.0), 1e-9);
+    ASSERT_EQ(huge.DeterminantSign(), -1);
+
+    // Well conditioned: refined from the float factors to double accuracy.
+    constexpr size_t kSolveSize = 60;
+    std::vector<double> values(kSolveSize * kSolveSize);
+    for (size_t i = 0; i < kSolveSize; ++i)
+        for (size_t j = 0; j < kSolveSize; ++j)
+            values[i * kSolveSize + j] = std::sin(static_cast<double>(i * kSolveSize + j)) + ((i == j) ? 8.0 : 0.0);
+    matrix::Matrix<double> a(kSolveSize, values.begin(), values.end());
+    std::vector<double> b(kSolveSize);
+    for (size_t i = 0; i < kSolveSize; ++i)
+        b[i] = std::cos(static_cast<double>(i));
+
+    matrix::LU<double> exact(a);
+    std::vector<double> expected = exact.Solve(b);
+    matrix::MixedPrecisionLU mixed(a);
+    std::vector<double> x = mixed.Solve(b);
+    ASSERT_FALSE(mixed.IsFallback());
+    ASSERT_GT(mixed.GetIterationCount(), 0u);
+    for (size_t i = 0; i < kSolveSize; ++i)
+        ASSERT_NEAR(x[i], expected[i], 1e-13);
+    ASSERT_NEAR(mixed.LogAbsDeterminant(), exact.LogAbsDeterminant(), 1e-4);
+    ASSERT_EQ(mixed.DeterminantSign(), exact.DeterminantSign());
+
+    // The estimate never exceeds the true 1-norm condition number and is
+    // usually close to it.
+    matrix::Matrix<double> inverse = exact.Inverse();
+    double norm = 0;
+    double inverse_norm = 0;
+    for (size_t j = 0; j < kSolveSize; ++j) {
+        double column = 0;
+        double inverse_column = 0;
+        for (size_t i = 0; i < kSolveSize; ++i) {
+            column += std::fabs(a[i][j]);
+            inverse_column += std::fabs(inverse[i][j]);
+        }
+        norm = std::max(norm, column);
+        inverse_norm = std::max(inverse_norm, inverse_column);
+    }
+    ASSERT_LE(exact.InverseNormEstimate(), inverse_norm * (1 + 1e-12));
+    ASSERT_GE(exact.InverseNormEstimate(), inverse_norm / 3);
+    ASSERT_NEAR(mixed.GetConditionEstimate() / (norm * inverse_norm), 1.0, 0.7);
+
+    std::vector<double> transposed = exact.SolveTransposed(b);
+    matrix::Matrix<double> check = a.Transpose() * matrix::Matrix<double>(kSolveSize, 1, transposed.begin(), transposed.end());
+    for (size_t i = 0; i < kSolveSize; ++i)
+        ASSERT_NEAR(check[i][0], b[i], 1e-12);
+
+    // Hilbert: far too ill-conditioned for float, so it goes to double.
+    constexpr size_t kHilbertSize = 10;
+    std::vector<double> hilbert(kHilbertSize * kHilbertSize);
+    for (size_t i = 0; i < kHilbertSize; ++i)
+        for (size_t j = 0; j < kHilbertSize; ++j)
+            hilbert[i * kHilbertSize + j] = 1.0 / static_cast<double>(i + j + 1);
+    matrix::Matrix<double> hilbert_matrix(kHilbertSize, hilbert.begin(), hilbert.end());
+    matrix::MixedPrecisionLU fallback(hilbert_matrix);
+    std::vector<double> ones(kHilbertSize, 1.0);
+    std::vector<double> hilbert_x = fallback.Solve(ones);
+    ASSERT_TRUE(fallback.IsFallback());
+    ASSERT_GT(fallback.GetConditionEstimate(), 1e7);
+    std::vector<double> hilbert_expected = matrix::LU<double>(hilbert_matrix).Solve(ones);
+    for (size_t i = 0; i < kHilbertSize; ++i)
+        ASSERT_EQ(hilbert_x[i], hilbert_expected[i]);
+
+    // A right-hand side past the range of float cannot be refined.
+    std::vector<double> identity{1, 0, 0, 1};
+    matrix::MixedPrecisionLU out_of_range(matrix::Matrix<double>(2, identity.begin(), identity.end()));
+    std::vector<double> large_x = out_of_range.Solve(std::vector<double>{1, 1e50});
+    ASSERT_TRUE(out_of_range.IsFallback());
+    ASSERT_EQ(large_x[0], 1.0);
+    ASSERT_EQ(large_x[1], 1e50);
+}
+
+TEST(MatrixTest, PivotTolerance) {
+    // Pivots twelve orders of magnitude apart, det = 10: the tolerance is
+    // taken per column, so none of them counts as zero.
+    std::vector<double> graded(64 * 64, 0.0);
+    for (size_t i = 0; i < 64; ++i)
+        graded[i * 64 + i] = (i == 63) ? 1e-5 : (i % 2 == 0) ? 1e6 : 1e-6;
+
+    matrix::Matrix<double> graded_diagonal(64, graded.begin(), graded.end());
+    graded[0 * 64 + 63] = 1;
+    graded[63 * 64 + 1] = 1;
+    matrix::Matrix<double> graded_dense(64, graded.begin(), graded.end());
+    ASSERT_NEAR(graded_dense.GetDeterminant(), 10.0, 1e-9);
+    ASSERT_NEAR(matrix::SparseMatrix<double>(graded_dense).GetDeterminant(), 10.0, 1e-9);
+    ASSERT_NEAR(graded_diagonal.GetDeterminant(), 10.0, 1e-9);
+    ASSERT_NEAR(matrix::BandedMatrix<double>(graded_diagonal.View(), 1, 1).GetDeterminant(), 10.0, 1e-9);
+
+    // Rounding residue of an exactly singular matrix still counts as zero.
+    std::vector<double> singular{1, 2, 3, 4, 5, 6, 7, 8, 9};
+    ASSERT_EQ(matrix::Matrix<double>(3, singular.begin(), singular.end()).GetDeterminant(), 0.0);
+}
+
+TEST(MatrixTest, OutOfCoreLU) {
+    // 150 rows in tiles of 32: five tile rows, the last one padded.
+    constexpr size_t kSize = 150;
+    constexpr size_t kTileSize = 32;
+    std::vector<double> values(kSize * kSize);
+    for (size_t i = 0; i < kSize; ++i)
+        for (size_t j = 0; j < kSize; ++j)
+            values[i * kSize + j] = std::sin(static_cast<double>(i * i + 3 * j * j + i * j + 1));
+    matrix::Matrix<double> a(kSize, values.begin(), values.end());
+    matrix::LU<double> expected(a);
+
+    std::vector<double> b(kSize);
+    for (size_t i = 0; i < kSize; ++i)
+        b[i] = std::cos(static_cast<double>(i));
+
+    // The smallest budget, one tile column and two tiles, and one that
+    // holds every tile, which then is read and written once.
+    for (bool is_minimal : {true, false}) {
+        matrix::TiledMatrix<double> tiled(a, kTileSize);
+        ASSERT_EQ(tiled.GetTileCount(), 5);
+        ASSERT_TRUE(tiled.ToMatrix() == a);
+
+        size_t budget = is_minimal ? matrix::OutOfCoreLU<double>::MinimumMemoryBudget(tiled)
+                                   : 25 * tiled.GetTileBytes();
+        size_t reads = tiled.GetReadCount();
+        matrix::OutOfCoreLU<double> lu(tiled, budget);
+        if (!is_minimal) {
+            ASSERT_EQ(tiled.GetReadCount() - reads, 25);
+            ASSERT_EQ(tiled.GetWriteCount(), 25);
+        }
+
+        ASSERT_FALSE(lu.IsSingular());
+        ASSERT_EQ(lu.DeterminantSign(), expected.DeterminantSign());
+        ASSERT_NEAR(lu.LogAbsDeterminant(), expected.LogAbsDeterminant(), 1e-9);
+
+        // P * A = L * U from the packed factors in the file.
+        matrix::Matrix<double> packed = tiled.ToMatrix();
+        const std::vector<size_t> &permutation = lu.GetPermutation();
+        for (size_t i = 0; i < kSize; ++i)
+            for (size_t j = 0; j < kSize; ++j) {
+                double sum = (i <= j) ? packed[i][j] : 0.0;
+                for (size_t r = 0; r < std::min(i, j + 1); ++r)
+                    sum += packed[i][r] * packed[r][j];
+                ASSERT_NEAR(sum, a[permutation[i]][j], 1e-12);
+            }
+
+        std::vector<double> x = lu.Solve(b);
+        std::vector<double> x_expected = expected.Solve(b);
+        for (size_t i = 0; i < kSize; ++i)
+            ASSERT_NEAR(x[i], x_expected[i], 1e-9);
+    }
+
+    matrix::TiledMatrix<double> small(a, kTileSize);
+    ASSERT_THROW(matrix::OutOfCoreLU<double>(small, 6 * small.GetTileBytes()), std::logic_error);
+
+    // A zero column in the middle of a tile.
+    for (size_t i = 0; i < kSize; ++i)
+        values[i * kSize + 70] = 0.0;
+    matrix::TiledMatrix<double> singular(matrix::Matrix<double>(kSize, values.begin(), values.end()), kTileSize);
+    matrix::OutOfCoreLU<double> singular_lu(singular, 10 * singular.GetTileBytes());
+    ASSERT_TRUE(singular_lu.IsSingular());
+    ASSERT_EQ(singular_lu.Determinant(), 0.0);
+    ASSERT_THROW(singular_lu.Solve(b), std::logic_error);
+}
+
+TEST(MatrixTest, InPlaceVariants) {
+    std::vector<double> values{2, -1, 0, 3, 1, 4, -2, 5, 1, 0, 2, -3, 6, 1, 1, 1};
+    matrix::Matrix<double> matrix1(4, values.begin(), values.end());
+    double det = matrix1.GetDeterminant();
+    matrix::Matrix<double> consumed = matrix1;
+    ASSERT_NEAR(std::move(consumed).GetDeterminant(), det, 1e-12);
+    ASSERT_EQ(consumed.GetRowCount(), 4);
+
+    std::vector<int> ints{2, 0, 1, 1, 3, 0, 0, 1, 4};
+    matrix::Matrix<int> int_matrix(3, ints.begin(), ints.end());
+    ASSERT_EQ(std::move(int_matrix).GetDeterminant(), 25);
+
+    // Products land in the caller's storage when it has the right shape.
+    std::vector<double> rect_values{1, 2, 3, 4, 5, 6};
+    matrix::Matrix<double> rect(2, 3, rect_values.begin(), rect_values.end());
+    matrix::Matrix<double> expected = rect * matrix1.View().Block(0, 0, 3, 4);
+    matrix::Matrix<double> block(matrix1.View().Block(0, 0, 3, 4));
+    matrix::Matrix<double> out(2, 4);
+    const double *storage = out.GetData();
+    Multiply(rect, block, out);
+    ASSERT_TRUE(out == expected);
+    ASSERT_EQ(out.GetData(), storage);
+
+    matrix::Matrix<double> square = matrix1;
+    Multiply(square, matrix1, square);
+    ASSERT_TRUE(square == matrix::Matrix<double>(matrix1 * matrix1));
+    matrix::Matrix<double> reshaped(1, 1);
+    Multiply(rect, block, reshaped);
+    ASSERT_TRUE(reshaped == expected);
+    ASSERT_THROW(Multiply(block, rect, out), std::logic_error);
+
+    // Elements without a packed kernel are replaced, not leaked.
+    std::vector<int> cell_values{1, 2, 3, 4};
+    matrix::Matrix<int> cell(2, cell_values.begin(), cell_values.end());
+    std::vector<matrix::Matrix<int>> cells(4, cell);
+    matrix::Matrix<matrix::Matrix<int>> nested(2, cells.begin(), cells.end());
+    matrix::Matrix<matrix::Matrix<int>> nested_out(2, cells.begin(), cells.end());
+    Multiply(nested, nested, nested_out);
+    matrix::Matrix<int> cell_square = cell;
+    cell_square *= cell;
+    ASSERT_EQ(nested_out[1][0], cell_square + cell_square);
+
+    // Transposes reuse storage of the same element count, any shape.
+    matrix::Matrix<double> transposed(3, 2);
+    storage = transposed.GetData();
+    rect.Transpose(transposed);
+    ASSERT_TRUE(transposed == rect.Transpose());
+    ASSERT_EQ(transposed.GetData(), storage);
+    rect.Transpose(rect);
+    ASSERT_TRUE(rect == transposed);
+    matrix::Matrix<double> small(1);
+    matrix1.Transpose(small);
+    ASSERT_TRUE(small == matrix1.Transpose());
+
+    // Storage of non-trivial elements that was never constructed.
+    std::vector<std::string> words{"a", "b", "c", "d", "e", "f"};
+    matrix::Matrix<std::string> text(2, 3, words.begin(), words.end());
+    matrix::Matrix<std::string> text_out(3, 2);
+    text.Transpose(text_out);
+    ASSERT_TRUE(text_out == text.Transpose());
+    text.Transpose(text_out);
+    ASSERT_EQ(text_out[2][1], "f");
+}
+
+TEST(MatrixTest, StructuredMatrices) {
+    constexpr size_t kSize = 40;
+    auto max_difference = [](const matrix::Matrix<double> &lhs, const matrix::Matrix<double> &rhs) {
+        double difference = 0;
+        for (size_t i = 0; i < lhs.GetRowCount() * lhs.GetColumnCount(); ++i)
+            difference = std::max(difference, std::fabs(lhs.GetData()[i] - rhs.GetData()[i]));
+        return difference;
+    };
+    auto dense = [](auto &&entry) {
+        std::vector<double> values(kSize * kSize);
+        for (size_t i = 0; i < kSize; ++i)
+            for (size_t j = 0; j < kSize; ++j)
+                values[i * kSize + j] = entry(i, j);
+        return matrix::Matrix<double>(kSize, values.begin(), values.end());
+    };
+    auto wave = [](size_t i, size_t j) { return std::sin(static_cast<double>(i * i + 3 * j * j + i * j + 1)); };
+
+    std::vector<double> rhs_values(kSize * 3);
+    for (size_t i = 0; i < rhs_values.size(); ++i)
+        rhs_values[i] = std::cos(static_cast<double>(i));
+    matrix::Matrix<double> rhs(kSize, 3, rhs_values.begin(), rhs_values.end());
+
+    // Band of two diagonals below and one above, inside the band limit.
+    matrix::Matrix<double> band = dense([&](size_t i, size_t j) {
+        return (i <= j + 2 && j <= i + 1) ? wave(i, j) + ((i == j) ? 0.5 : 0.0) : 0.0;
+    });
+    matrix::MatrixStructure structure = matrix::DetectStructure(band);
+    ASSERT_EQ(structure.lower_bandwidth, 2);
+    ASSERT_EQ(structure.upper_bandwidth, 1);
+    ASSERT_FALSE(structure.is_symmetric);
+    matrix::LU<double> band_lu(band);
+    ASSERT_EQ(matrix::details::ScaledProduct<double>(band.GetDeterminant()).GetSign(), band_lu.DeterminantSign());
+    ASSERT_NEAR(std::log(std::fabs(band.GetDeterminant())), band_lu.LogAbsDeterminant(), 1e-9);
+
+    matrix::BandedMatrix<double> packed_band(band.View());
+    ASSERT_NEAR(packed_band.GetDeterminant() / band.GetDeterminant(), 1.0, 1e-12);
+    ASSERT_EQ(max_difference(packed_band.ToMatrix(), band), 0.0);
+    ASSERT_LT(max_difference(packed_band * rhs, band * rhs), 1e-12);
+    matrix::BandedMatrix<double> wide_band(band.View(), 3, 2);
+    ASSERT_NEAR(wide_band.GetDeterminant() / band.GetDeterminant(), 1.0, 1e-12);
+    ASSERT_THROW(matrix::BandedMatrix<double>(band.View(), 1, 1), std::logic_error);
+
+    // A zero row inside the band makes it singular.
+    matrix::Matrix<double> singular_band = band;
+    std::fill(singular_band.GetData() + 7 * kSize, singular_band.GetData() + 8 * kSize, 0.0);
+    ASSERT_EQ(singular_band.GetDeterminant(), 0.0);
+
+    // Triangular and diagonal determinants are the product of the diagonal.
+    matrix::Matrix<double> upper = dense([&](size_t i, size_t j) { return (j >= i) ? wave(i, j) + 1.5 : 0.0; });
+    ASSERT_TRUE(matrix::DetectStructure(upper).IsUpperTriangular());
+    double diagonal_product = 1;
+    for (size_t i = 0; i < kSize; ++i)
+        diagonal_product *= upper.GetData()[i * kSize + i];
+    ASSERT_NEAR(upper.GetDeterminant() / diagonal_product, 1.0, 1e-12);
+    ASSERT_NEAR(upper.Transpose().GetDeterminant() / diagonal_product, 1.0, 1e-12);
+
+    matrix::TriangularMatrix<double> packed_upper(upper.View(), matrix::Triangle::Upper);
+    matrix::Matrix<double> lower_dense = upper.Transpose();
+    matrix::TriangularMatrix<double> packed_lower(lower_dense.View(), matrix::Triangle::Lower);
+    ASSERT_NEAR(packed_upper.GetDeterminant() / diagonal_product, 1.0, 1e-12);
+    ASSERT_EQ(max_difference(packed_upper.ToMatrix(), upper), 0.0);
+    ASSERT_EQ(max_difference(packed_lower.ToMatrix(), lower_dense), 0.0);
+    ASSERT_EQ(packed_upper(3, 1), 0.0);
+    ASSERT_EQ(packed_lower(3, 1), lower_dense.GetData()[3 * kSize + 1]);
+    ASSERT_LT(max_difference(packed_upper * rhs, upper * rhs), 1e-12);
+    ASSERT_LT(max_difference(packed_lower * rhs, lower_dense * rhs), 1e-12);
+    ASSERT_THROW(matrix::TriangularMatrix<double>(upper.View(), matrix::Triangle::Lower), std::logic_error);
+
+    matrix::Matrix<double> identity = dense([](size_t i, size_t j) { return (i == j) ? 1.0 : 0.0; });
+    ASSERT_EQ(identity.GetDeterminant(), 1.0);
+
+    std::vector<double> diagonal_values(kSize);
+    for (size_t i = 0; i < kSize; ++i)
+        diagonal_values[i] = 1.0 + 0.1 * static_cast<double>(i);
+    matrix::DiagonalMatrix<double> diagonal(diagonal_values);
+    matrix::Matrix<double> diagonal_dense = diagonal.ToMatrix();
+    ASSERT_TRUE(matrix::DetectStructure(diagonal_dense).IsDiagonal());
+    ASSERT_NEAR(diagonal.GetDeterminant() / diagonal_dense.GetDeterminant(), 1.0, 1e-12);
+    ASSERT_LT(max_difference(diagonal * rhs, diagonal_dense * rhs), 1e-12);
+    matrix::Matrix<double> rhs_transposed = rhs.Transpose();
+    ASSERT_LT(max_difference(rhs_transposed * diagonal, rhs_transposed * diagonal_dense), 1e-12);
+    ASSERT_LT(max_difference((diagonal * diagonal).ToMatrix(), diagonal_dense * diagonal_dense), 1e-12);
+    ASSERT_THROW(matrix::DiagonalMatrix<double>(band.View()), std::logic_error);
+
+    // Symmetric positive definite matrices go through LDL^T, indefinite ones
+    // fall back to pivoting elimination.
+    matrix::Matrix<double> waves = dense(wave);
+    matrix::Matrix<double> definite = waves.Transpose() * waves;
+    for (size_t i = 0; i < kSize; ++i)
+        definite.GetData()[i * kSize + i] += 1.0;
+    for (size_t i = 0; i < kSize; ++i)
+        for (size_t j = 0; j < i; ++j)
+            definite.GetData()[i * kSize + j] = definite.GetData()[j * kSize + i];
+    ASSERT_TRUE(matrix::DetectStructure(definite).is_symmetric);
+
+    matrix::Matrix<double> indefinite = waves + waves.Transpose();
+    for (auto *symmetric : {&definite, &indefinite}) {
+        matrix::LU<double> lu(*symmetric);
+        double det = symmetric->GetDeterminant();
+        ASSERT_EQ(det < 0 ? -1 : 1, lu.DeterminantSign());
+        ASSERT_NEAR(std::log(std::fabs(det)), lu.LogAbsDeterminant(), 1e-8);
+
+        matrix::SymmetricMatrix<double> packed(symmetric->View());
+        ASSERT_NEAR(packed.GetDeterminant() / det, 1.0, 1e-8);
+        ASSERT_EQ(max_difference(packed.ToMatrix(), *symmetric), 0.0);
+        ASSERT_LT(max_difference(packed * rhs, *symmetric * rhs), 1e-10);
+    }
+    ASSERT_THROW(matrix::SymmetricMatrix<double>(band.View()), std::logic_error);
+
+    // Integer triangular matrices keep the exact product.
+    std::vector<int> ints{2, 7, -3, 0, 3, 5, 0, 0, -4};
+    matrix::Matrix<int> int_upper(3, ints.begin(), ints.end());
+    ASSERT_EQ(int_upper.GetDeterminant(), -24);
+    matrix::TriangularMatrix<int> packed_int(int_upper.View(), matrix::Triangle::Upper);
+    ASSERT_EQ(packed_int.GetDeterminant(), -24);
+    matrix::BandedMatrix<int> int_band(int_upper.View());
+    ASSERT_EQ(int_band.GetDeterminant(), -24);
+    matrix::DiagonalMatrix<int> int_diagonal(std::vector<int>{1 << 20, 1 << 20});
+    ASSERT_THROW(int_diagonal.GetDeterminant(), std::range_error);
+
+    // Partial products past the range do not matter once an entry is 0.
+    std::vector<int64_t> wide{int64_t{1} << 40, 0, 0, 0, int64_t{1} << 40, 0, 0, 0, 0};
+    matrix::Matrix<int64_t> wide_diagonal(3, wide.begin(), wide.end());
+    ASSERT_EQ(wide_diagonal.GetDeterminant(), 0);
+    ASSERT_EQ(matrix::DiagonalMatrix<int64_t>(std::vector<int64_t>{int64_t{1} << 40, int64_t{1} << 40, 0})
+                  .GetDeterminant(), 0);
+    ASSERT_EQ(matrix::TriangularMatrix<int64_t>(wide_diagonal.View(), matrix::Triangle::Lower).GetDeterminant(), 0);
+}
+
+TEST(MatrixTest, Instrumentation) {
+    namespace instrumentation = matrix::instrumentation;
+    instrumentation::Reset();
+
+    std::vector<double> values{0, 2, 1, 1, 1, 0, 3, 1, 2};
+    matrix::Matrix<double> lhs(3, values.begin(), values.end());
+    matrix::Matrix<double> copy = lhs;
+    matrix::Matrix<double> product = lhs * copy.Transpose();
+    ASSERT_NE(copy.GetDeterminant(), 0.0);
+    std::thread worker([&] { matrix::Matrix<double> other = lhs; });
+    worker.join();
+
+    instrumentation::Snapshot snapshot = instrumentation::GetSnapshot();
+    std::ostringstream json;
+    instrumentation::WriteJson(json, snapshot);
+    ASSERT_NE(json.str().find("\"row_swaps\": "), std::string::npos);
+    ASSERT_NE(json.str().find("\"pivoting\": {\"calls\": "), std::string::npos);
+
+    if constexpr (instrumentation::kEnabled) {
+        // The copies, the transpose, the product and the worker's copy.
+        ASSERT_GE(snapshot.Get(instrumentation::Counter::Allocations), 5);
+        ASSERT_GE(snapshot.Get(instrumentation::Counter::BytesCopied), 2 * 9 * sizeof(double));
+        ASSERT_GE(snapshot.Get(instrumentation::Counter::Flops), 2 * 27);
+        ASSERT_GE(snapshot.Get(instrumentation::Counter::RowSwaps), 1);
+        ASSERT_EQ(snapshot.Get(instrumentation::Region::Transpose).calls, 1);
+        ASSERT_EQ(snapshot.Get(instrumentation::Region::Multiply).calls, 1);
+        ASSERT_EQ(snapshot.Get(instrumentation::Region::Elimination).calls, 1);
+        ASSERT_EQ(snapshot.Get(instrumentation::Region::Pivoting).calls, 2);
+        ASSERT_NE(json.str().find("\"enabled\": true"), std::string::npos);
+
+        instrumentation::Reset();
+        ASSERT_EQ(instrumentation::GetSnapshot().Get(instrumentation::Counter::Allocations), 0);
+    } else {
+        ASSERT_EQ(snapshot.Get(instrumentation::Counter::Allocations), 0);
+        ASSERT_EQ(snapshot.Get(instrumentation::Region::Multiply).calls, 0);
+        ASSERT_FALSE(instrumentation::HardwareCountersAvailable());
+        ASSERT_NE(json.str().find("\"enabled\": false"), std::string::npos);
+    }
+}
+
+TEST(MatrixTest, MatrixChain) {
+    // 10 x 100, 100 x 5, 5 x 50: (A0 A1) A2 costs 7500 multiply-adds and
+    // A0 (A1 A2) 75000.
+    matrix::ChainPlan textbook({10, 100, 5, 50});
+    ASSERT_EQ(textbook.GetCost(), 7500);
+    ASSERT_EQ(textbook.ToString(), "((A0 A1) A2)");
+
+    matrix::ChainPlan clrs({30, 35, 15, 5, 10, 20, 25});
+    ASSERT_EQ(clrs.GetCost(), 15125);
+    ASSERT_EQ(clrs.ToString(), "((A0 (A1 A2)) ((A3 A4) A5))");
+    ASSERT_THROW(matrix::ChainPlan({7}), std::logic_error);
+
+    auto make = [](size_t row_count, size_t column_count, double seed) {
+        std::vector<double> values(row_count * column_count);
+        for (size_t i = 0; i < values.size(); ++i)
+            values[i] = std::sin(seed + static_cast<double>(i));
+        return matrix::Matrix<double>(row_count, column_count, values.begin(), values.end());
+    };
+
+    // A column vector at the end: right to left multiplies vectors only.
+    matrix::Matrix<double> a = make(60, 80, 1);
+    matrix::Matrix<double> b = make(80, 70, 2);
+    matrix::Matrix<double> c = make(70, 90, 3);
+    matrix::Matrix<double> d = make(90, 1, 4);
+    matrix::Matrix<double> expected = a * b;
+    expected = expected * c;
+    expected = expected * d;
+
+    matrix::Matrix<double> chain = matrix::MultiplyChain(a, b, c, d);
+    ASSERT_EQ(chain.GetRowCount(), 60);
+    ASSERT_EQ(chain.GetColumnCount(), 1);
+    for (size_t i = 0; i < 60; ++i)
+        ASSERT_NEAR(chain.GetData()[i], expected.GetData()[i], 1e-9);
+    ASSERT_EQ(matrix::PlanChain<double>({a.View(), b.View(), c.View(), d.View()}).ToString(), "(A0 (A1 (A2 A3)))");
+
+    // Views, strided ones included, and a split with products on both sides.
+    matrix::Matrix<double> wide = make(40, 30, 5);
+    matrix::Matrix<double> tall = make(30, 40, 6);
+    std::vector<matrix::ConstMatrixView<double>> operands{wide.View(), tall.View(), tall.View().Transposed(),
+                                                          wide.View().Transposed(), wide.View().Block(0, 0, 40, 5)};
+    matrix::Matrix<double> chained = matrix::MultiplyChain(operands);
+    matrix::Matrix<double> naive{operands[0]};
+    for (size_t i = 1; i < operands.size(); ++i)
+        naive = naive * matrix::Matrix<double>{operands[i]};
+    ASSERT_EQ(chained.GetRowCount(), 40);
+    ASSERT_EQ(chained.GetColumnCount(), 5);
+    for (size_t i = 0; i < 40 * 5; ++i)
+        ASSERT_NEAR(chained.GetData()[i], naive.GetData()[i], 1e-8 * std::fabs(naive.GetData()[i]) + 1e-8);
+
+    // Both halves are products, evaluated side by side on the pool.
+    matrix::Matrix<double> e = make(10, 50, 7);
+    matrix::Matrix<double> f = make(50, 10, 8);
+    ASSERT_EQ(matrix::PlanChain<double>({e.View(), f.View(), e.View(), f.View()}).ToString(), "((A0 A1) (A2 A3))");
+    matrix::Matrix<double> serial = matrix::MultiplyChain(e, f, e, f);
+    matrix::SetThreadCount(4);
+    matrix::Matrix<double> parallel = matrix::MultiplyChain(e, f, e, f);
+    matrix::SetThreadCount(0);
+    matrix::Matrix<double> halves = e * f;
+    halves = halves * halves;
+    for (size_t i = 0; i < 10 * 10; ++i) {
+        ASSERT_NEAR(serial.GetData()[i], halves.GetData()[i], 1e-9);
+        ASSERT_NEAR(parallel.GetData()[i], halves.GetData()[i], 1e-9);
+    }
+
+    ASSERT_TRUE(matrix::MultiplyChain(a) == a);
+    ASSERT_THROW(matrix::MultiplyChain(a, c), std::logic_error);
+
+    std::vector<int> ints{1, 2, 3, 4};
+    matrix::Matrix<int> square(2, ints.begin(), ints.end());
+    matrix::Matrix<int> cube = square * square;
+    cube = cube * square;
+    ASSERT_TRUE(matrix::MultiplyChain(square, square, square) == cube);
+}
+
+TEST(MatrixTest, MatrixPower) {
+    // Fibonacci numbers: [[1, 1], [1, 0]]^k = [[F(k+1), F(k)], [F(k), F(k-1)]].
+    std::vector<int64_t> fibonacci{1, 1, 1, 0};
+    matrix::Matrix<int64_t> step(2, fibonacci.begin(), fibonacci.end());
+    matrix::Matrix<int64_t> power = matrix::Pow(step, 90);
+    ASSERT_EQ(power[0][1], 2880067194370816120);
+    ASSERT_EQ(power[1][1], 1779979416004714189);
+    ASSERT_TRUE(matrix::Pow(step, 1) == step);
+    ASSERT_EQ(matrix::Pow(step, 0)[0][0], 1);
+    ASSERT_EQ(matrix::Pow(step, 0)[0][1], 0);
+
+    std::vector<double> values{0.5, 0.25, 0.25, 0.2, 0.6, 0.2, 0.1, 0.3, 0.6};
+    matrix::Matrix<double> markov(3, values.begin(), values.end());
+    matrix::Matrix<double> expected = markov;
+    for (int i = 1; i < 37; ++i)
+        expected = expected * markov;
+    matrix::Matrix<double> markov_power = matrix::Pow(markov, 37);
+    for (size_t i = 0; i < 9; ++i)
+        ASSERT_NEAR(markov_power.GetData()[i], expected.GetData()[i], 1e-14);
+
+    // F(10^18) mod 10^9 + 7, and a modulus whose products need 128 bits.
+    ASSERT_EQ(matrix::PowMod(step, 1000000000000000000, int64_t{1000000007})[0][1], 209783453);
+    int64_t large = (int64_t{1} << 61) - 1;
+    matrix::Matrix<int64_t> large_power = matrix::PowMod(step, 1000, large);
+    matrix::Matrix<int64_t> large_expected = matrix::PowMod(step, 500, large);
+    matrix::Matrix<int64_t> square(2, 2);
+    for (size_t i = 0; i < 2; ++i)
+        for (size_t j = 0; j < 2; ++j) {
+            unsigned __int128 sum = 0;
+            for (size_t k = 0; k < 2; ++k)
+                sum += static_cast<unsigned __int128>(large_expected[i][k]) * large_expected[k][j];
+            square[i][j] = static_cast<int64_t>(sum % large);
+        }
+    ASSERT_TRUE(large_power == square);
+    std::vector<int> negative{-1, 3, 2, -5};
+    matrix::Matrix<int> negative_matrix(2, negative.begin(), negative.end());
+    matrix::Matrix<int> reduced = matrix::PowMod(negative_matrix, 1, 7);
+    ASSERT_EQ(reduced[0][0], 6);
+    ASSERT_EQ(reduced[1][1], 2);
+    ASSERT_THROW(matrix::PowMod(negative_matrix, 2, 0), std::logic_error);
+
+    // n (m - 1)^2 overflows 128 bits: every entry is -1 mod m, so A^2 has
+    // entries n and A^3 entries -n^2.
+    int64_t huge = (int64_t{1} << 62) + 1;
+    matrix::Matrix<int64_t> minus_ones(16, 16);
+    std::fill(minus_ones.GetData(), minus_ones.GetData() + 16 * 16, huge - 1);
+    matrix::Matrix<int64_t> huge_square = matrix::PowMod(minus_ones, 2, huge);
+    matrix::Matrix<int64_t> huge_cube = matrix::PowMod(minus_ones, 3, huge);
+    for (size_t i = 0; i < 16 * 16; ++i) {
+        ASSERT_EQ(huge_square.GetData()[i], 16);
+        ASSERT_EQ(huge_cube.GetData()[i], huge - 256);
+    }
+
+    // e^A for a rotation generator, diagonal and nilpotent matrices, small
+    // and large enough to need scaling and squaring.
+    for (double angle : {1e-3, 0.1, 0.7, 2.0, 30.0}) {
+        std::vector<double> generator{0, -angle, angle, 0};
+        matrix::Matrix<double> rotation =
+            matrix::MatrixExp(matrix::Matrix<double>(2, generator.begin(), generator.end()));
+        ASSERT_NEAR(rotation[0][0], std::cos(angle), 1e-13);
+        ASSERT_NEAR(rotation[0][1], -std::sin(angle), 1e-13);
+        ASSERT_NEAR(rotation[1][0], std::sin(angle), 1e-13);
+    }
+
+    std::vector<double> diagonal{-3, 0, 0, 0, 0.5, 0, 0, 0, 4};
+    matrix::Matrix<double> exp_diagonal =
+        matrix::MatrixExp(matrix::Matrix<double>(3, diagonal.begin(), diagonal.end()));
+    ASSERT_NEAR(exp_diagonal[0][0] / std::exp(-3.0), 1.0, 1e-14);
+    ASSERT_NEAR(exp_diagonal[1][1] / std::exp(0.5), 1.0, 1e-14);
+    ASSERT_NEAR(exp_diagonal[2][2] / std::exp(4.0), 1.0, 1e-14);
+    ASSERT_EQ(exp_diagonal[0][2], 0.0);
+
+    std::vector<double> nilpotent{0, 1, 0, 0, 0, 1, 0, 0, 0};
+    matrix::Matrix<double> exp_nilpotent =
+        matrix::MatrixExp(matrix::Matrix<double>(3, nilpotent.begin(), nilpotent.end()));
+    ASSERT_NEAR(exp_nilpotent[0][0], 1.0, 1e-15);
+    ASSERT_NEAR(exp_nilpotent[0][1], 1.0, 1e-15);
+    ASSERT_NEAR(exp_nilpotent[0][2], 0.5, 1e-15);
+    ASSERT_NEAR(exp_nilpotent[1][0], 0.0, 1e-15);
+
+    matrix::Matrix<double> rectangle(2, 3);
+    ASSERT_THROW(matrix::MatrixExp(rectangle), std::logic_error);
+    ASSERT_THROW(matrix::Pow(rectangle, 2), std::logic_error);
+}
+
+TEST(MatrixTest, SharedMatrix) {
+    std::vector<double> values{1, 2, 3, 4, 5, 6};
+    matrix::SharedMatrix<double> original(matrix::Matrix<double>(2, 3, values.begin(), values.end()));
+    ASSERT_FALSE(original.IsShared());
+
+    // Copies share the storage until one of them writes.
+    matrix::SharedMatrix<double> copy = original;
+    const matrix::SharedMatrix<double> &reader = copy;
+    ASSERT_TRUE(original.IsShared());
+    ASSERT_EQ(reader.GetData(), std::as_const(original).GetData());
+    ASSERT_EQ(reader[1][2], 6);
+    ASSERT_THROW(reader[2], std::range_error);
+    ASSERT_TRUE(copy == original);
+    static_assert(std::is_same_v<decltype(reader[0]), std::span<const double>>);
+
+    copy[0][1] = 20;
+    ASSERT_FALSE(copy.IsShared());
+    ASSERT_FALSE(original.IsShared());
+    ASSERT_EQ(copy[0][1], 20);
+    ASSERT_EQ(std::as_const(original)[0][1], 2);
+    ASSERT_TRUE(copy != original);
+
+    // A sole owner writes in place.
+    const double *storage = std::as_const(copy).GetData();
+    copy[1] *= 2.0;
+    copy.View()(0, 0) = -1;
+    ASSERT_EQ(std::as_const(copy).GetData(), storage);
+    ASSERT_EQ(reader[1][0], 8);
+    ASSERT_EQ(reader[0][0], -1);
+
+    // Fan-out to readers on other threads.
+    matrix::SharedMatrix<double> square(matrix::Matrix<double>(2, values.begin(), values.begin() + 4));
+    std::vector<double> determinants(4);
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < determinants.size(); ++i)
+        readers.emplace_back([stage = square, &determinants, i] { determinants[i] = stage.GetDeterminant(); });
+    for (std::thread &thread : readers)
+        thread.join();
+    for (double det : determinants)
+        ASSERT_NEAR(det, -2.0, 1e-12);
+    ASSERT_FALSE(square.IsShared());
+    ASSERT_TRUE(square.Transpose() == square.Get().Transpose());
+}